@@ -0,0 +1,360 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "analyze.h"
+#include "evaluate.h"
+#include "lock.h"
+#include "misc.h"
+#include "move.h"
+#include "movegen.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+
+using namespace std;
+
+namespace {
+
+  // AnalyzeState is shared by the threads analyzing the positions. Each
+  // thread reads the next line of the EPD file and writes its result, both
+  // under the lock, so that the file is streamed whatever its size.
+  struct AnalyzeState {
+    SearchLimits limits;
+    int hash;
+    TimeOptions timeOptions;
+    EvalOptions evalOptions;
+    bool sharedHash;
+    TranspositionTable tt; // Used when sharedHash
+
+    Lock lock;
+    istream* in;
+    ostream* out;
+    int nextLine;
+    int positions;
+    int64_t nodes;
+  };
+
+  AnalyzeState AS;
+
+
+  // read_epd() splits an EPD or FEN line in the FEN of the position and the
+  // value of the "id" operation, if any. Returns false if there is no
+  // position on the line.
+
+  bool read_epd(const string& line, string& fen, string& id) {
+
+    istringstream ss(line.substr(0, line.find(';')));
+    string token;
+
+    fen.clear();
+    id.clear();
+
+    // EPD lines have only four fields, followed by the operations
+    for (int i = 0; i < 6 && ss >> token; i++)
+    {
+        if (i >= 4 && token.find_first_not_of("0123456789") != string::npos)
+            break;
+
+        fen += (i ? " " : "") + token;
+    }
+
+    if (count(fen.begin(), fen.end(), ' ') < 3)
+        return false;
+
+    if (count(fen.begin(), fen.end(), ' ') == 3)
+        fen += " 0 1";
+
+    size_t idx = line.find(" id ");
+    if (idx != string::npos)
+    {
+        size_t start = line.find_first_not_of(' ', idx + 4);
+
+        if (start != string::npos && line[start] == '"')
+        {
+            // A quoted string, where a backslash escapes the next character
+            for (size_t i = start + 1; i < line.size() && line[i] != '"'; i++)
+            {
+                if (line[i] == '\\' && i + 1 < line.size())
+                    i++;
+
+                id += line[i];
+            }
+        }
+        else if (start != string::npos)
+        {
+            size_t end = line.find(';', start);
+            id = line.substr(start, end == string::npos ? string::npos : end - start);
+        }
+    }
+    return true;
+  }
+
+
+  // json_string() quotes a string for JSON
+
+  string json_string(const string& str) {
+
+    string s = "\"";
+
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        if (str[i] == '"' || str[i] == '\\')
+            s += '\\';
+
+        if ((unsigned char)str[i] >= ' ')
+            s += str[i];
+    }
+    return s + "\"";
+  }
+
+
+  // json_score() returns the score as with UCI, in centipawns or in moves to
+  // mate, as a JSON object.
+
+  string json_score(Value v) {
+
+    ostringstream s;
+
+    if (abs(v) < VALUE_MATE - PLY_MAX * ONE_PLY)
+        s << "{\"cp\":" << int(v) * 100 / int(PawnValueMidgame) << "}";
+    else
+        s << "{\"mate\":" << (v > 0 ? VALUE_MATE - v + 1 : -VALUE_MATE - v) / 2 << "}";
+
+    return s.str();
+  }
+
+
+  // save_pv() is the callback of the searches, the PV of the last iteration
+  // is the one of the result.
+
+  void save_pv(const SearchInfo& info, void* data) {
+
+    *(SearchInfo*)data = info;
+  }
+
+
+  // analyze_worker() is run by every thread analyzing the positions. It keeps
+  // taking the next line of the file until the end, searching each position
+  // in its own context.
+
+  void analyze_worker(int, int threadID) {
+
+    TranspositionTable tt;
+    SearchContext* ctx;
+    SearchInfo info;
+    MoveStack mlist[MAX_MOVES];
+    string line, fen, id;
+
+    if (!AS.sharedHash)
+        tt.set_size(AS.hash);
+
+    ctx = create_search_context(AS.sharedHash ? &AS.tt : &tt);
+    set_engine_options(ctx, AS.timeOptions, AS.evalOptions);
+    set_search_callback(ctx, save_pv, &info);
+    set_search_context(ctx);
+
+    while (true)
+    {
+        lock_grab(&AS.lock);
+        bool ok = !getline(*AS.in, line).fail();
+        int lineNumber = ++AS.nextLine;
+        lock_release(&AS.lock);
+
+        if (!ok)
+            break;
+
+        if (!read_epd(line, fen, id))
+            continue;
+
+        Position pos(fen, false, threadID);
+        Move bestMove = MOVE_NONE;
+        Value score;
+
+        info.depth = 0;
+        info.pv[0] = MOVE_NONE;
+
+        int64_t time = get_system_time();
+
+        // Our king has exploded, or we are mated or stalemated
+        if (pos.piece_count(pos.side_to_move(), KING) == 0)
+            score = -VALUE_MATE;
+
+        else if (generate<MV_LEGAL>(pos, mlist) == mlist)
+            score = pos.in_check() ? -VALUE_MATE : VALUE_DRAW;
+
+        else
+            bestMove = search_move(pos, AS.limits, &score);
+
+        time = get_system_time() - time;
+
+        ostringstream s;
+        s << "{\"line\":" << lineNumber;
+
+        if (!id.empty())
+            s << ",\"id\":" << json_string(id);
+
+        s << ",\"fen\":" << json_string(fen)
+          << ",\"bestmove\":" << (bestMove != MOVE_NONE ? json_string(move_to_uci(bestMove, false)) : "null")
+          << ",\"score\":" << json_score(score)
+          << ",\"depth\":" << info.depth
+          << ",\"seldepth\":" << (info.depth ? info.selDepth : 0)
+          << ",\"nodes\":" << pos.nodes_searched()
+          << ",\"time\":" << time
+          << ",\"pv\":[";
+
+        for (int i = 0; info.pv[i] != MOVE_NONE; i++)
+            s << (i ? "," : "") << json_string(move_to_uci(info.pv[i], false));
+
+        s << "]}\n";
+
+        lock_grab(&AS.lock);
+        *AS.out << s.str() << flush;
+        AS.positions++;
+        AS.nodes += pos.nodes_searched();
+        lock_release(&AS.lock);
+    }
+
+    set_search_context(NULL);
+    delete_search_context(ctx);
+  }
+
+} // namespace
+
+
+/// analyze() searches every position of an EPD or FEN file and writes the
+/// results as JSON lines while running, as example:
+///
+///   analyze epd positions.epd concurrency 8 per-position nodes 100000 output out.jsonl
+///
+/// Arguments, with or without a leading "--", are: "epd" file (required),
+/// "concurrency" threads (1), or "threads", the limit of each position "per-position nodes|depth|ms N",
+/// or just "nodes N", "depth N", "movetime N", defaulting to depth 12, "hash"
+/// in MB for each thread (16), "sharehash" to have all the threads search in
+/// one table of that size, good when the positions are close to each other
+/// like the ones of the same games, and "output" file, '-' being the standard
+/// output (the default). Each thread searches its own positions, one at a
+/// time, the results are in the order the searches end. Each one has the line
+/// number of the position, its EPD "id" if any, the FEN, the best move, the
+/// score, the depth, the nodes, the time in milliseconds and the PV.
+
+void analyze(istream& is) {
+
+  string token, epdFile, outputFile = "-";
+  int threads = 1;
+
+  AS.limits = SearchLimits();
+  AS.hash = 16;
+  AS.sharedHash = false;
+
+  while (is >> token)
+  {
+      token.erase(0, token.find_first_not_of('-'));
+
+      if (token == "per-position")
+          is >> token;
+
+      if (token == "epd")
+          is >> epdFile;
+      else if (token == "concurrency" || token == "threads")
+          is >> threads;
+      else if (token == "nodes")
+          is >> AS.limits.maxNodes;
+      else if (token == "depth")
+          is >> AS.limits.maxDepth;
+      else if (token == "ms" || token == "movetime")
+          is >> AS.limits.maxTime;
+      else if (token == "hash")
+          is >> AS.hash;
+      else if (token == "sharehash")
+          AS.sharedHash = true;
+      else if (token == "output")
+          is >> outputFile;
+      else
+      {
+          cout << "Unknown analyze argument: " << token << endl;
+          return;
+      }
+  }
+
+  if (!AS.limits.maxNodes && !AS.limits.maxDepth && !AS.limits.maxTime)
+      AS.limits.maxDepth = 12;
+
+  ifstream in(epdFile.c_str());
+  ofstream out;
+
+  if (!in.is_open())
+  {
+      cout << "Cannot open EPD file " << epdFile << endl;
+      return;
+  }
+
+  if (outputFile != "-")
+  {
+      out.open(outputFile.c_str());
+
+      if (!out.is_open())
+      {
+          cout << "Cannot open output file " << outputFile << endl;
+          return;
+      }
+  }
+
+  // With the results on the standard output the report goes to the errors one
+  ostream& status = (outputFile != "-" ? cout : cerr);
+
+  threads = Max(1, Min(threads, MAX_THREADS - 1));
+
+  if (AS.sharedHash)
+      AS.tt.set_size(AS.hash);
+
+  // The options of the time manager and the evaluation are read once
+  AS.timeOptions.read_uci_options();
+  AS.evalOptions.read_uci_options();
+
+  AS.in = &in;
+  AS.out = (outputFile != "-" ? &out : &cout);
+  AS.nextLine = 0;
+  AS.positions = 0;
+  AS.nodes = 0;
+  lock_init(&AS.lock);
+
+  status << "Analyze: " << epdFile << ", " << threads << " threads" << endl;
+
+  int64_t time = get_system_time();
+
+  Threads.run_workers(analyze_worker, threads);
+
+  lock_destroy(&AS.lock);
+
+  int64_t elapsed = Max(get_system_time() - time, int64_t(1));
+
+  status << "Analyzed " << AS.positions << " positions in " << elapsed / 1000.0 << " s"
+      << ", " << fixed << setprecision(1) << AS.positions * 1000.0 / elapsed << " positions/s"
+      << ", " << AS.nodes * 1000 / elapsed << " nodes/s" << endl;
+}
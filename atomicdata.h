@@ -79,6 +79,14 @@ struct ExplosionData {
 	int32_t size;
 };
 
+// the same packed in bytes, as kept for every move in StateInfo
+// entry 0 is the captured piece, the others are the pieces blown away
+struct ExplodedPieces {
+	uint8_t square[9];
+	uint8_t piece[9];
+	uint8_t size;
+};
+
 
 // 1 if the two squares directly face each other, 0 else.
 // TODO: squares_touch is just a special case of square_dist
@@ -0,0 +1,248 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bitboard.h"
+#include "misc.h"
+#include "position.h"
+#include "rkiss.h"
+#include "search.h"
+#include "stats.h"
+#include "tt.h"
+#include "ucioption.h"
+
+using namespace std;
+
+namespace {
+
+  string int_to_string(int v) {
+
+    std::ostringstream ss;
+    ss << v;
+    return ss.str();
+  }
+
+  // Atomic benchmark suite: openings, middlegames with plenty of explosions
+  // around the kings, and endgames. Keep the list stable, every change here
+  // changes the bench signature.
+  const string BenchPositions[] = {
+
+    // Openings
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "rnbqkbnr/ppppp1pp/5p2/8/8/4PN2/PPPP1PPP/RNBQKB1R b KQkq - 0 2",
+    "rnbqkb1r/pppp2pp/4p2n/7Q/3P4/4P3/PPP2PPP/RNB1KB1R b KQkq - 1 5",
+    "rnbqkbnr/ppp4p/4p1p1/3pQ3/8/4P3/PPPP1PPP/RNB1KB1R w KQkq - 0 6",
+    "r2qkbnr/ppp2p1p/n7/3pp1p1/1P1PP1b1/5P1N/P1P3PP/RNBQKB1R w KQkq - 0 6",
+
+    // Middlegames
+    "rnbqk1nr/ppp5/4ppp1/3pN2p/1b5Q/2P1P3/PP1P1PPP/RNB1KB1R w KQkq - 0 7",
+    "r1b1kb1r/pppp3p/n3pnp1/5p2/1P5P/4P3/P1PP1PP1/RNBQKB1R w KQkq - 0 8",
+    "r1bqk2r/pp1p3p/n1pPpppb/8/1P6/8/P1PNPPBP/R1BQK2R w KQkq - 2 9",
+    "rnb1kb1r/pp1p1p1p/8/4p1p1/3P4/5PPN/PPP4P/R1B1K2R w KQkq - 0 10",
+    "rnb1k2r/1p3ppp/2p1p2n/p1P5/Q5q1/b2PP1PP/PP3P2/R1BK1B1R w kq - 0 12",
+
+    // Endgames
+    "8/8/8/3k4/8/8/3PK3/8 w - - 0 1",
+    "8/2p5/8/k7/8/8/2P5/2K5 w - - 0 1",
+    "8/5k2/8/8/2N5/8/3BK3/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "r3k3/8/8/8/8/8/8/4K2R w Kq - 0 1",
+    "8/8/4k3/8/8/8/R3K3/8 b - - 0 1"
+  };
+
+  const int BenchSize = sizeof(BenchPositions) / sizeof(BenchPositions[0]);
+}
+
+
+/// benchmark() runs a simple benchmark by letting Stockfish analyze the
+/// atomic position suite above. Arguments, all optional, are read from the
+/// given stream in the order: hash size in MB, number of threads, search
+/// limit and limit type ("depth", "nodes" or "time"), as example:
+///
+///   bench 32 1 10 depth
+///
+/// The TT is cleared before each position so that with a single thread the
+/// node counts, and hence the signature, only depend on the code and not on
+/// the machine or the timing.
+
+void benchmark(istream& is) {
+
+  string ttSize = "32", threads = "1", limitType = "depth";
+  int limit = 10;
+  int64_t totalNodes = 0;
+  uint32_t signature = 2166136261U;
+  int time;
+
+  is >> ttSize >> threads >> limit >> limitType;
+
+  // Bench runs on its own options, the user ones are restored at the end
+  int oldHash     = Options["Hash"].value<int>();
+  int oldThreads  = Options["Threads"].value<int>();
+  bool oldOwnBook = Options["OwnBook"].value<bool>();
+
+  Options["Hash"].set_value(ttSize);
+  Options["Threads"].set_value(threads);
+  Options["OwnBook"].set_value("false");
+  TT.set_size(Options["Hash"].value<int>());
+
+  // Do not let the search read stdin, commands queued after "bench" must
+  // not stop it half way.
+  SearchLimits limits;
+  limits.ignoreInput = true;
+
+  if (limitType == "time")
+      limits.maxTime = limit;
+  else if (limitType == "nodes")
+      limits.maxNodes = limit;
+  else
+      limits.maxDepth = limit;
+
+  clear_stats();
+  time = get_system_time();
+
+  for (int i = 0; i < BenchSize; i++)
+  {
+      Move moves[] = { MOVE_NONE };
+      Move bestMove, ponderMove;
+      Position pos(BenchPositions[i], false, 0);
+
+      cout << "\nBench position: " << i + 1 << '/' << BenchSize << endl;
+
+      // Self-check of to_fen(), which writes all but the move counters
+      if (BenchPositions[i].find(pos.to_fen() + " ") != 0)
+          cout << "Error: to_fen() gives " << pos.to_fen() << endl;
+
+      TT.clear();
+
+      if (!think(pos, limits, moves, bestMove, ponderMove))
+          break;
+
+      totalNodes += pos.nodes_searched();
+
+      // FNV-1a over node counts and best moves, byte by byte so that
+      // the result does not depend on the endianness of the machine.
+      uint64_t data[] = { uint64_t(pos.nodes_searched()), uint64_t(bestMove) };
+
+      for (int j = 0; j < 2; j++)
+          for (int k = 0; k < 64; k += 8)
+              signature = (signature ^ uint32_t((data[j] >> k) & 0xFF)) * 16777619U;
+  }
+
+  time = get_system_time() - time;
+
+  Options["Hash"].set_value(int_to_string(oldHash));
+  Options["Threads"].set_value(int_to_string(oldThreads));
+  Options["OwnBook"].set_value(oldOwnBook ? "true" : "false");
+
+  cout << "\n==============================="
+       << "\nTotal time (ms) : " << time
+       << "\nNodes searched  : " << totalNodes
+       << "\nNodes/second    : " << (time > 0 ? totalNodes * 1000 / time : totalNodes)
+       << "\nSignature       : " << hex << setw(8) << setfill('0') << signature
+       << dec << setfill(' ') << endl << endl;
+
+#if defined(USE_STATS)
+  cout << stats_to_string() << endl;
+#endif
+}
+
+
+namespace {
+
+  // slider_lookups() xors together the rook and bishop attacks of all the
+  // occupancies, looked up as the binary would with the given indexing.
+
+  template<bool Pext>
+  Bitboard slider_lookups(const Bitboard occ[], int size, int rounds) {
+
+    Bitboard checksum = 0;
+
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < size; i++)
+        {
+            Square s = Square(i & 63);
+            checksum ^=  RookMagics[s].attacks[magic_index<Pext>(RookMagics[s], occ[i])]
+                       ^ BishopMagics[s].attacks[magic_index<Pext>(BishopMagics[s], occ[i])];
+        }
+
+    return checksum;
+  }
+}
+
+
+/// slider_benchmark() compares the two ways of indexing the slider attack
+/// table, magic multiplication and PEXT, by timing rook and bishop lookups
+/// on random occupancies. The table is rebuilt for each of them and then
+/// restored, so it must not be called while searching.
+
+void slider_benchmark() {
+
+  const int Size = 4096, Rounds = 2000;
+
+  Bitboard occ[Size];
+  Bitboard checksum[2] = { 0, 0 };
+  RKISS rk;
+
+  // About a quarter of the squares occupied, as in a middlegame
+  for (int i = 0; i < Size; i++)
+      occ[i] = rk.rand<Bitboard>() & rk.rand<Bitboard>();
+
+  cout << "lookups use " << (SliderPext ? "pext" : "magic") << ", chosen at startup, table "
+       << sizeof(SliderAttacks) / 1024 << " KB" << endl;
+
+  for (int pext = 0; pext < 2; pext++)
+  {
+#if !defined(HAS_PEXT)
+      if (pext)
+      {
+          cout << "pext : not compiled in" << endl;
+          break;
+      }
+#endif
+      if (pext && !Cpu.bmi2)
+      {
+          cout << "pext : not available on this CPU" << endl;
+          break;
+      }
+
+      init_slider_attacks(pext);
+
+      int time = get_system_time();
+
+      checksum[pext] = pext ? slider_lookups<true>(occ, Size, Rounds)
+                            : slider_lookups<false>(occ, Size, Rounds);
+
+      time = get_system_time() - time;
+
+      int64_t lookups = 2LL * Size * Rounds;
+
+      cout << (pext ? "pext : " : "magic: ") << lookups << " lookups in " << time << " ms, "
+           << (time > 0 ? lookups / time / 1000 : 0) << " Mlookups/s"
+           << (pext && !Cpu.fastPext ? " (slow pext)" : "") << endl;
+  }
+
+  if (checksum[1] && checksum[0] != checksum[1])
+      cout << "Error: magic and pext attacks differ" << endl;
+
+  init_slider_attacks(SliderPext);
+}
@@ -17,268 +17,919 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "atomicdata.h"
+#include "bitbase.h"
 #include "bitboard.h"
-#include "types.h"
+#include "lock.h"
+#include "misc.h"
+#include "position.h"
+#include "thread.h"
+
+using namespace std;
 
 namespace {
 
-  enum Result {
-    RESULT_UNKNOWN,
-    RESULT_INVALID,
-    RESULT_WIN,
-    RESULT_LOSS,
-    RESULT_DRAW
+  const int MaxPieces = 4;
+
+  // Size of the table of the available bitbases, a power of two well above
+  // the number of material configurations with up to MaxPieces pieces.
+  const int BitbaseTableSize = 256;
+
+  // Positions are processed by the generator threads in chunks of this size.
+  // It is a multiple of 4 so that a packed result byte is never shared
+  // between two chunks.
+  const uint64_t ChunkSize = 16384;
+
+  // Position states while generating: the result in the low bits, and flags
+  // for what is still to be done with it.
+  enum {
+    UNKNOWN, INVALID, DRAW, WIN, LOSS,
+    ResultMask = 7,
+    CanDraw    = 8,  // A move out of the bitbase draws
+    Pending    = 16, // Resolved, predecessors not yet updated
+    Parity     = 32  // Parity of the pass that resolved the position
+  };
+
+  // A bitbase covers one material configuration like "KPKP". Pieces are
+  // ordered white king, black king, then white and black pieces from queen
+  // down to pawn, and a position is indexed by the side to move in bit 0
+  // followed by 6 bits for the square of each piece.
+  struct Bitbase {
+
+    uint64_t entries() const { return 2ULL << (6 * size); }
+    int result(uint64_t idx) const { return (data[idx / 4] >> (2 * (idx & 3))) & 3; }
+
+    string code;
+    int size;
+    Piece pieces[MaxPieces];
+    Key keys[2]; // Material keys, as is and with the colors swapped
+    vector<uint8_t> data; // 2 bits per position: 0 draw, 1 win, 2 loss
   };
 
-  struct KPKPosition {
-    void from_index(int index);
-    bool is_legal() const;
-    bool is_immediate_draw() const;
-    bool is_immediate_win() const;
-    Bitboard wk_attacks()   const { return StepAttacksBB[WK][whiteKingSquare]; }
-    Bitboard bk_attacks()   const { return StepAttacksBB[BK][blackKingSquare]; }
-    Bitboard pawn_attacks() const { return StepAttacksBB[WP][pawnSquare]; }
+  struct PieceSquare {
+    Piece piece;
+    Square square;
+  };
 
-    Square whiteKingSquare, blackKingSquare, pawnSquare;
+  struct BitbasePosition {
+    Square squares[MaxPieces];
     Color sideToMove;
   };
 
-  // The possible pawns squares are 24, the first 4 files and ranks from 2 to 7
-  const int IndexMax = 2 * 24 * 64 * 64; // color * wp_sq * wk_sq * bk_sq
+  // Shared state of the generator threads
+  struct GeneratorState {
+    Bitbase* bb;
+    atomic<uint8_t>* state;
+    atomic<uint8_t>* remaining;
+    atomic<uint64_t> next;
+    atomic<bool> changed;
+    int pass;
+    void (*job)(uint64_t);
+  };
+
+  GeneratorState GS;
 
-  // Each uint32_t stores results of 32 positions, one per bit
-  uint32_t KPKBitbase[IndexMax / 32];
+  // The available bitbases by material key, the one of the colors swapped
+  // included. The table is filled under BitbaseLock, the probes read it
+  // without locking: an entry is published by setting its bitbase last.
+  struct BitbaseEntry {
+    Key key;
+    bool swapped;
+    atomic<Bitbase*> bb;
+  };
 
-  Result classify_wtm(const KPKPosition& pos, const Result bb[]);
-  Result classify_btm(const KPKPosition& pos, const Result bb[]);
-  int compute_index(Square wksq, Square bksq, Square wpsq, Color stm);
-}
+  BitbaseEntry BitbaseTable[BitbaseTableSize];
+  int BitbaseEntries;
+  Lock BitbaseLock;
 
+  BitbaseResult probe(PieceSquare ps[], int n, Color stm);
 
-uint32_t probe_kpk_bitbase(Square wksq, Square wpsq, Square bksq, Color stm) {
+  // Sorting order of the pieces in a bitbase, see Bitbase
+  int piece_order(Piece p) {
 
-  int index = compute_index(wksq, bksq, wpsq, stm);
+    Color c = color_of_piece(p);
+    PieceType pt = type_of_piece(p);
 
-  return KPKBitbase[index / 32] & (1 << (index & 31));
-}
+    return pt == KING ? int(c) : 2 + 8 * int(c) + int(QUEEN - pt);
+  }
 
+  bool piece_less(const PieceSquare& a, const PieceSquare& b) {
+    return piece_order(a.piece) < piece_order(b.piece);
+  }
 
-void init_kpk_bitbase() {
+  // Build the code of a set of pieces, like "KQKP", or an empty string if
+  // there is not exactly one king per side. Pieces must be sorted.
+  string code_of(const PieceSquare ps[], int n) {
 
-  Result bb[IndexMax];
-  KPKPosition pos;
-  bool repeat;
+    if (   n < 2
+        || ps[0].piece != make_piece(WHITE, KING)
+        || ps[1].piece != make_piece(BLACK, KING)
+        || (n > 2 && type_of_piece(ps[n - 1].piece) == KING))
+        return "";
 
-  // Initialize table
-  for (int i = 0; i < IndexMax; i++)
-  {
-      pos.from_index(i);
-      bb[i] = !pos.is_legal()          ? RESULT_INVALID
-             : pos.is_immediate_draw() ? RESULT_DRAW
-             : pos.is_immediate_win()  ? RESULT_WIN : RESULT_UNKNOWN;
+    string code[2] = { "K", "K" };
+
+    for (int i = 2; i < n; i++)
+        code[color_of_piece(ps[i].piece)] += piece_type_to_char(type_of_piece(ps[i].piece));
+
+    return code[WHITE] + code[BLACK];
   }
 
-  // Iterate until all positions are classified (30 cycles needed)
-  do {
-      repeat = false;
+  // material_key() computes the key of a set of pieces the way
+  // Position::get_material_key() does, with the colors swapped if asked.
+  Key material_key(const PieceSquare ps[], int n, bool swapColors) {
 
-      for (int i = 0; i < IndexMax; i++)
-          if (bb[i] == RESULT_UNKNOWN)
-          {
-              pos.from_index(i);
+    int count[2][8] = { { 0 } };
+    Key key = 0;
 
-              bb[i] = (pos.sideToMove == WHITE) ? classify_wtm(pos, bb)
-                                                : classify_btm(pos, bb);
-              if (bb[i] != RESULT_UNKNOWN)
-                  repeat = true;
-          }
+    for (int i = 0; i < n; i++)
+    {
+        Color c = color_of_piece(ps[i].piece);
+        PieceType pt = type_of_piece(ps[i].piece);
 
-  } while (repeat);
+        if (swapColors)
+            c = opposite_color(c);
 
-  // Map 32 position results into one KPKBitbase[] entry
-  for (int i = 0; i < IndexMax / 32; i++)
-      for (int j = 0; j < 32; j++)
-          if (bb[32 * i + j] == RESULT_WIN || bb[32 * i + j] == RESULT_LOSS)
-              KPKBitbase[i] |= (1 << j);
-}
+        if (pt != KING)
+            key ^= Position::material_zobrist(c, pt, count[c][pt]++);
+    }
+    return key;
+  }
 
+  // find_bitbase() returns the table entry of the given material key, or
+  // NULL if there is no bitbase for it.
+  const BitbaseEntry* find_bitbase(Key key) {
 
-namespace {
+    for (int i = int(key & (BitbaseTableSize - 1)), n = 0; n < BitbaseTableSize; i = (i + 1) & (BitbaseTableSize - 1), n++)
+    {
+        if (!BitbaseTable[i].bb.load(memory_order_acquire))
+            return NULL;
 
- // A KPK bitbase index is an integer in [0, IndexMax] range
- //
- // Information is mapped in this way
- //
- // bit     0: side to move (WHITE or BLACK)
- // bit  1- 6: black king square (from SQ_A1 to SQ_H8)
- // bit  7-12: white king square (from SQ_A1 to SQ_H8)
- // bit 13-14: white pawn file (from FILE_A to FILE_D)
- // bit 15-17: white pawn rank - 1 (from RANK_2 - 1 to RANK_7 - 1)
+        if (BitbaseTable[i].key == key)
+            return &BitbaseTable[i];
+    }
+    return NULL;
+  }
 
-  int compute_index(Square wksq, Square bksq, Square wpsq, Color stm) {
+  // add_bitbase() publishes a bitbase under the given material key, unless
+  // the key is already there. To be called with BitbaseLock held, after
+  // checking with BitbaseEntries that there is room for it.
+  void add_bitbase(Key key, bool swapped, Bitbase* bb) {
+
+    for (int i = int(key & (BitbaseTableSize - 1)); ; i = (i + 1) & (BitbaseTableSize - 1))
+    {
+        BitbaseEntry& e = BitbaseTable[i];
+
+        if (!e.bb.load(memory_order_relaxed))
+        {
+            e.key = key;
+            e.swapped = swapped;
+            e.bb.store(bb, memory_order_release);
+            BitbaseEntries++;
+            return;
+        }
 
-    assert(square_file(wpsq) <= FILE_D);
+        if (e.key == key)
+            return;
+    }
+  }
 
-    int p = int(square_file(wpsq)) + 4 * int(square_rank(wpsq) - 1);
-    int r = int(stm) + 2 * int(bksq) + 128 * int(wksq) + 8192 * p;
+  void from_index(uint64_t idx, BitbasePosition& pos, int n) {
 
-    assert(r >= 0 && r < IndexMax);
+    pos.sideToMove = Color(idx & 1);
 
-    return r;
+    for (int i = 0; i < n; i++)
+        pos.squares[i] = Square((idx >> (1 + 6 * i)) & 63);
   }
 
-  void KPKPosition::from_index(int index) {
+  Bitboard occupancy(const Square squares[], int n) {
+
+    Bitboard b = EmptyBoardBB;
+
+    for (int i = 0; i < n; i++)
+        set_bit(&b, squares[i]);
 
-    int s = (index / 8192) % 24;
+    return b;
+  }
+
+  Bitboard attacks_from(Piece p, Square s, Bitboard occ) {
 
-    sideToMove = Color(index % 2);
-    blackKingSquare = Square((index / 2) % 64);
-    whiteKingSquare = Square((index / 128) % 64);
-    pawnSquare = make_square(File(s % 4), Rank(s / 4 + 1));
+    switch (type_of_piece(p)) {
+    case BISHOP: return bishop_attacks_bb(s, occ);
+    case ROOK:   return rook_attacks_bb(s, occ);
+    case QUEEN:  return queen_attacks_bb(s, occ);
+    default:     return StepAttacksBB[p][s];
+    }
   }
 
-  bool KPKPosition::is_legal() const {
+  // in_check() tells whether the king of color c is attacked. Kings are the
+  // first two pieces. Kings can't capture, so they never give check, and
+  // adjacent kings can't be checked at all.
+  bool in_check(const Piece pieces[], const Square squares[], int n, Color c) {
+
+    Square ksq = squares[c];
 
-    if (   whiteKingSquare == pawnSquare
-        || whiteKingSquare == blackKingSquare
-        || blackKingSquare == pawnSquare)
+    if (square_distance(ksq, squares[opposite_color(c)]) <= 1)
         return false;
 
-    if (sideToMove == WHITE)
+    for (int i = 2; i < n; i++)
+        if (   color_of_piece(pieces[i]) != c
+            && bit_is_set(attacks_from(pieces[i], squares[i], occupancy(squares, n)), ksq))
+            return true;
+
+    return false;
+  }
+
+  bool is_valid(const Bitbase* bb, const BitbasePosition& pos) {
+
+    for (int i = 0; i < bb->size; i++)
     {
-        if (   bit_is_set(wk_attacks(), blackKingSquare)
-            || bit_is_set(pawn_attacks(), blackKingSquare))
+        if (   type_of_piece(bb->pieces[i]) == PAWN
+            && (square_rank(pos.squares[i]) == RANK_1 || square_rank(pos.squares[i]) == RANK_8))
             return false;
+
+        for (int j = 0; j < i; j++)
+            if (pos.squares[i] == pos.squares[j])
+                return false;
     }
-    else if (bit_is_set(bk_attacks(), whiteKingSquare))
-        return false;
 
-    return true;
+    return !in_check(bb->pieces, pos.squares, bb->size, opposite_color(pos.sideToMove));
   }
 
-  bool KPKPosition::is_immediate_draw() const {
+  // promotion_result() returns the result, for the side making it, of a
+  // promotion of piece j to the given piece type. The position must already
+  // have the pawn on the promotion square.
+  BitbaseResult promotion_result(const Bitbase* bb, const BitbasePosition& pos, int j, PieceType pt) {
+
+    PieceSquare ps[MaxPieces];
 
-    if (sideToMove == BLACK)
+    for (int i = 0; i < bb->size; i++)
     {
-        Bitboard wka = wk_attacks();
-        Bitboard bka = bk_attacks();
+        ps[i].piece = (i == j ? make_piece(color_of_piece(bb->pieces[i]), pt) : bb->pieces[i]);
+        ps[i].square = pos.squares[i];
+    }
 
-        // Case 1: Stalemate
-        if ((bka & ~(wka | pawn_attacks())) == EmptyBoardBB)
-            return true;
+    BitbaseResult r = probe(ps, bb->size, opposite_color(pos.sideToMove));
 
-        // Case 2: King can capture pawn
-        if (bit_is_set(bka, pawnSquare) && !bit_is_set(wka, pawnSquare))
-            return true;
+    assert(r != BB_NONE);
+
+    return BitbaseResult(-r);
+  }
+
+  // capture_result() returns the result, for the side making it, of the
+  // capture by piece j on square to of the piece on capsq, which is to but
+  // for en passant, or BB_NONE if the capture is illegal. The capturing and
+  // the captured pieces are removed together with all the pieces but pawns
+  // next to the capture square.
+  BitbaseResult capture_result(const Bitbase* bb, const BitbasePosition& pos, int j, Square to, Square capsq) {
+
+    Color us = pos.sideToMove;
+    Bitboard blast = explBB[to];
+
+    if (bit_is_set(blast, pos.squares[us]))
+        return BB_NONE;
+
+    if (bit_is_set(blast, pos.squares[opposite_color(us)]))
+        return BB_WIN;
+
+    Piece pieces[MaxPieces];
+    Square squares[MaxPieces];
+    PieceSquare ps[MaxPieces];
+    int n = 0;
+
+    for (int i = 0; i < bb->size; i++)
+        if (   i != j
+            && pos.squares[i] != capsq
+            && (type_of_piece(bb->pieces[i]) == PAWN || !bit_is_set(blast, pos.squares[i])))
+        {
+            pieces[n] = ps[n].piece = bb->pieces[i];
+            squares[n] = ps[n].square = pos.squares[i];
+            n++;
+        }
+
+    if (in_check(pieces, squares, n, us))
+        return BB_NONE;
+
+    BitbaseResult r = probe(ps, n, opposite_color(us));
+
+    assert(r != BB_NONE);
+
+    return BitbaseResult(-r);
+  }
+
+  // ep_result() returns the best result, for the opponent, of the en passant
+  // captures of pawn j just pushed two squares, or BB_NONE if there is none.
+  // Positions don't keep the en passant square, so the generator looks ahead
+  // for these captures at the double pushes.
+  BitbaseResult ep_result(const Bitbase* bb, const BitbasePosition& pos, int j) {
+
+    BitbasePosition p = pos;
+    Color us = opposite_color(color_of_piece(bb->pieces[j]));
+    Square capsq = pos.squares[j];
+    Square to = capsq + pawn_push(us);
+    BitbaseResult best = BB_NONE;
+
+    p.sideToMove = us;
+
+    for (int i = 2; i < bb->size; i++)
+        if (   bb->pieces[i] == make_piece(us, PAWN)
+            && square_rank(pos.squares[i]) == square_rank(capsq)
+            && file_distance(pos.squares[i], capsq) == 1)
+        {
+            BitbaseResult r = capture_result(bb, p, i, to, capsq);
+
+            if (r != BB_NONE && (best == BB_NONE || r > best))
+                best = r;
+        }
+
+    return best;
+  }
+
+  // init_position() is the first pass of the generator. It marks invalid
+  // positions, resolves the ones decided by a move leaving the bitbase,
+  // a capture or a promotion, and counts the moves staying in it for the
+  // others.
+  void init_position(uint64_t idx) {
+
+    const Bitbase* bb = GS.bb;
+    BitbasePosition pos;
+
+    from_index(idx, pos, bb->size);
+
+    if (!is_valid(bb, pos))
+    {
+        GS.state[idx].store(INVALID, memory_order_relaxed);
+        return;
     }
-    else
+
+    Color us = pos.sideToMove, them = opposite_color(us);
+    Bitboard occ = occupancy(pos.squares, bb->size);
+    Bitboard theirs = EmptyBoardBB;
+    bool win = false, canDraw = false, anyLegal = false;
+    int inside = 0;
+
+    for (int i = 2; i < bb->size; i++)
+        if (color_of_piece(bb->pieces[i]) == them)
+            set_bit(&theirs, pos.squares[i]);
+
+    for (int j = 0; j < bb->size && !win; j++)
     {
-        // Case 1: Stalemate (possible pawn files are only from A to D)
-        if (   whiteKingSquare == SQ_A8
-            && pawnSquare == SQ_A7
-            && (blackKingSquare == SQ_C7 || blackKingSquare == SQ_C8))
-            return true;
+        Piece p = bb->pieces[j];
+        Square from = pos.squares[j];
+        Bitboard quiet, captures;
+
+        if (color_of_piece(p) != us)
+            continue;
+
+        if (type_of_piece(p) == PAWN)
+        {
+            Square to = from + pawn_push(us);
+
+            quiet = captures = EmptyBoardBB;
+
+            if (!bit_is_set(occ, to))
+            {
+                set_bit(&quiet, to);
+
+                if (relative_rank(us, from) == RANK_2 && !bit_is_set(occ, to + pawn_push(us)))
+                    set_bit(&quiet, to + pawn_push(us));
+            }
+            captures = StepAttacksBB[p][from] & theirs;
+        }
+        else
+        {
+            Bitboard b = attacks_from(p, from, occ);
+
+            quiet = b & ~occ;
+            captures = (type_of_piece(p) == KING ? EmptyBoardBB : b & theirs);
+        }
+
+        while (quiet)
+        {
+            Square to = pop_1st_bit(&quiet);
+
+            pos.squares[j] = to;
+
+            if (!in_check(bb->pieces, pos.squares, bb->size, us))
+            {
+                anyLegal = true;
+
+                if (type_of_piece(p) == PAWN && relative_rank(us, to) == RANK_8)
+                {
+                    for (PieceType pt = QUEEN; pt >= KNIGHT; pt--)
+                    {
+                        BitbaseResult r = promotion_result(bb, pos, j, pt);
+
+                        win |= (r == BB_WIN);
+                        canDraw |= (r == BB_DRAW);
+                    }
+                }
+                // A double push losing to en passant is not counted, see
+                // retro_position().
+                else if (   type_of_piece(p) != PAWN
+                         || rank_distance(from, to) != 2
+                         || ep_result(bb, pos, j) != BB_WIN)
+                    inside++;
+            }
+            pos.squares[j] = from;
+        }
+
+        while (captures)
+        {
+            Square to = pop_1st_bit(&captures);
+            BitbaseResult r = capture_result(bb, pos, j, to, to);
+
+            if (r != BB_NONE)
+            {
+                anyLegal = true;
+                win |= (r == BB_WIN);
+                canDraw |= (r == BB_DRAW);
+            }
+        }
     }
-    return false;
+
+    uint8_t s;
+
+    if (win)
+        s = WIN | Pending;
+    else if (inside)
+        s = UNKNOWN | (canDraw ? CanDraw : 0);
+    else if (anyLegal)
+        s = canDraw ? DRAW : LOSS | Pending;
+    else
+        s = in_check(bb->pieces, pos.squares, bb->size, us) ? LOSS | Pending : DRAW;
+
+    GS.state[idx].store(s, memory_order_relaxed);
+    GS.remaining[idx].store(uint8_t(inside), memory_order_relaxed);
   }
 
-  bool KPKPosition::is_immediate_win() const {
+  // resolve() sets the result of a still unknown position, and marks it for
+  // the next pass unless it is a draw.
+  void resolve(uint64_t idx, uint8_t result) {
+
+    uint8_t s = GS.state[idx].load(memory_order_relaxed);
+    uint8_t newState = result;
 
-    // The position is an immediate win if it is white to move and the
-    // white pawn can be promoted without getting captured.
-    return   sideToMove == WHITE
-          && square_rank(pawnSquare) == RANK_7
-          && whiteKingSquare != pawnSquare + DELTA_N
-          && (   square_distance(blackKingSquare, pawnSquare + DELTA_N) > 1
-              || bit_is_set(wk_attacks(), pawnSquare + DELTA_N));
+    if (result != DRAW)
+        newState |= Pending | (GS.pass & 1 ? Parity : 0);
+
+    while ((s & ResultMask) == UNKNOWN)
+        if (GS.state[idx].compare_exchange_weak(s, newState, memory_order_relaxed))
+        {
+            if (result != DRAW)
+                GS.changed.store(true, memory_order_relaxed);
+            return;
+        }
   }
 
-  Result classify_wtm(const KPKPosition& pos, const Result bb[]) {
+  // retro_position() is run on every position in each following pass. A
+  // position resolved in the previous pass updates its predecessors, the
+  // positions that lead to it with a quiet move: a loss makes them a win,
+  // and they are lost, or drawn, when all their moves are found to win for
+  // the opponent.
+  void retro_position(uint64_t idx) {
+
+    const Bitbase* bb = GS.bb;
+    uint8_t s = GS.state[idx].load(memory_order_relaxed);
 
-    // If one move leads to a position classified as RESULT_LOSS, the result
-    // of the current position is RESULT_WIN. If all moves lead to positions
-    // classified as RESULT_DRAW, the current position is classified RESULT_DRAW
-    // otherwise the current position is classified as RESULT_UNKNOWN.
+    if (!(s & Pending) || bool(s & Parity) != bool((GS.pass - 1) & 1))
+        return;
 
-    bool unknownFound = false;
-    Bitboard b;
-    Square s;
-    Result r;
+    GS.state[idx].store(s & ResultMask, memory_order_relaxed);
 
-    // King moves
-    b = pos.wk_attacks();
-    while (b)
+    BitbasePosition pos;
+    from_index(idx, pos, bb->size);
+
+    Color them = opposite_color(pos.sideToMove);
+    Bitboard occ = occupancy(pos.squares, bb->size);
+    bool isLoss = ((s & ResultMask) == LOSS);
+
+    for (int j = 0; j < bb->size; j++)
     {
-        s = pop_1st_bit(&b);
-        r = bb[compute_index(s, pos.blackKingSquare, pos.pawnSquare, BLACK)];
+        Piece p = bb->pieces[j];
+        Square to = pos.squares[j];
+        Bitboard froms;
 
-        if (r == RESULT_LOSS)
-            return RESULT_WIN;
+        if (color_of_piece(p) != them)
+            continue;
+
+        if (type_of_piece(p) == PAWN)
+        {
+            Square from = to - pawn_push(them);
 
-        if (r == RESULT_UNKNOWN)
-            unknownFound = true;
+            froms = EmptyBoardBB;
+
+            if (relative_rank(them, to) >= RANK_3 && !bit_is_set(occ, from))
+            {
+                set_bit(&froms, from);
+
+                if (relative_rank(them, to) == RANK_4 && !bit_is_set(occ, from - pawn_push(them)))
+                    set_bit(&froms, from - pawn_push(them));
+            }
+        }
+        else
+            froms = attacks_from(p, to, occ) & ~occ;
+
+        int shift = 1 + 6 * j;
+
+        while (froms)
+        {
+            Square from = pop_1st_bit(&froms);
+            uint64_t prev = ((idx ^ 1) & ~(63ULL << shift)) | (uint64_t(from) << shift);
+            uint8_t ps = GS.state[prev].load(memory_order_relaxed);
+            BitbaseResult ep = BB_NONE;
+
+            if ((ps & ResultMask) != UNKNOWN)
+                continue;
+
+            // After a double push the opponent may capture en passant: a win
+            // for him was not counted by init_position(), a draw turns our
+            // win into a draw.
+            if (type_of_piece(p) == PAWN && rank_distance(from, to) == 2)
+                ep = ep_result(bb, pos, j);
+
+            if (ep == BB_WIN)
+                continue;
+
+            if (isLoss && ep != BB_DRAW)
+                resolve(prev, WIN);
+
+            else
+            {
+                if (isLoss)
+                    GS.state[prev].fetch_or(CanDraw, memory_order_relaxed);
+
+                if (GS.remaining[prev].fetch_sub(1, memory_order_acq_rel) == 1)
+                    resolve(prev, GS.state[prev].load(memory_order_relaxed) & CanDraw ? DRAW : LOSS);
+            }
+        }
     }
+  }
+
+  // pack_position() stores the final result of a position, still unknown
+  // ones are draws.
+  void pack_position(uint64_t idx) {
+
+    int r = GS.state[idx].load(memory_order_relaxed) & ResultMask;
+    int v = (r == WIN ? 1 : r == LOSS ? 2 : 0);
+
+    GS.bb->data[idx / 4] |= uint8_t(v << (2 * (idx & 3)));
+  }
+
+  void generator_worker(int, int) {
+
+    uint64_t entries = GS.bb->entries(), idx;
+
+    while ((idx = GS.next.fetch_add(ChunkSize)) < entries)
+        for (uint64_t end = Min(idx + ChunkSize, entries); idx < end; idx++)
+            GS.job(idx);
+  }
+
+  // run_job() runs the given job on all the positions of the bitbase being
+  // generated, with the given number of threads.
+  void run_job(void (*job)(uint64_t), int threads) {
+
+    GS.job = job;
+    GS.next = 0;
+    Threads.run_workers(generator_worker, threads);
+  }
+
+  // generate() computes the results of all the positions of a bitbase. The
+  // bitbases reached by a promotion must already be available.
+  void generate(Bitbase* bb, int threads) {
+
+    uint64_t entries = bb->entries();
+
+    GS.bb = bb;
+    GS.state = new atomic<uint8_t>[entries];
+    GS.remaining = new atomic<uint8_t>[entries];
+    GS.pass = 0;
+
+    run_job(init_position, threads);
 
-    // Pawn moves
-    if (square_rank(pos.pawnSquare) < RANK_7)
+    do {
+        GS.pass++;
+        GS.changed = false;
+        run_job(retro_position, threads);
+
+    } while (GS.changed);
+
+    bb->data.assign(entries / 4, 0);
+    run_job(pack_position, threads);
+
+    delete [] GS.state;
+    delete [] GS.remaining;
+  }
+
+  // Parse a code like "KRPKP" in a sorted piece list, returns false if the
+  // code is not one of a supported bitbase.
+  bool parse_code(const string& code, Bitbase* bb) {
+
+    PieceSquare ps[MaxPieces];
+    Color c = WHITE;
+    int n = 0;
+
+    for (size_t i = 0; i < code.length(); i++)
     {
-        s = pos.pawnSquare + DELTA_N;
-        r = bb[compute_index(pos.whiteKingSquare, pos.blackKingSquare, s, BLACK)];
+        size_t pt = string(" PNBRQK").find(char(toupper(code[i])));
 
-        if (r == RESULT_LOSS)
-            return RESULT_WIN;
+        if (pt == string::npos || pt == 0)
+            return false;
 
-        if (r == RESULT_UNKNOWN)
-            unknownFound = true;
+        if (i > 0 && pt == KING)
+            c = BLACK;
 
-        // Double pawn push
-        if (   square_rank(s) == RANK_3
-            && s != pos.whiteKingSquare
-            && s != pos.blackKingSquare)
-        {
-            s += DELTA_N;
-            r = bb[compute_index(pos.whiteKingSquare, pos.blackKingSquare, s, BLACK)];
+        if (n == MaxPieces)
+            return false;
+
+        ps[n].piece = make_piece(c, PieceType(pt));
+        ps[n++].square = SQ_A1;
+    }
 
-            if (r == RESULT_LOSS)
-                return RESULT_WIN;
+    sort(ps, ps + n, piece_less);
+    bb->code = code_of(ps, n);
+    bb->size = n;
 
-            if (r == RESULT_UNKNOWN)
-                unknownFound = true;
+    for (int i = 0; i < n; i++)
+        bb->pieces[i] = ps[i].piece;
+
+    bb->keys[0] = material_key(ps, n, false);
+    bb->keys[1] = material_key(ps, n, true);
+
+    return n > 2 && !bb->code.empty();
+  }
+
+  string file_name(const string& code, const string& path) {
+    return path.empty() ? code + ".bb" : path + "/" + code + ".bb";
+  }
+
+  bool load(Bitbase* bb, const string& path) {
+
+    FILE* f = fopen(file_name(bb->code, path).c_str(), "rb");
+
+    if (!f)
+        return false;
+
+    char header[8];
+    bb->data.resize(bb->entries() / 4);
+
+    bool ok =   fread(header, 1, 8, f) == 8
+             && !memcmp(header, "ATOMBB01", 8)
+             && fread(&bb->data[0], 1, bb->data.size(), f) == bb->data.size()
+             && fgetc(f) == EOF;
+
+    fclose(f);
+    return ok;
+  }
+
+  void save(const Bitbase* bb, const string& path) {
+
+    FILE* f = fopen(file_name(bb->code, path).c_str(), "wb");
+
+    if (   !f
+        || fwrite("ATOMBB01", 1, 8, f) != 8
+        || fwrite(&bb->data[0], 1, bb->data.size(), f) != bb->data.size())
+        cout << "Failed to write bitbase " << file_name(bb->code, path) << endl;
+
+    if (f)
+        fclose(f);
+  }
+
+  // probe() looks up a set of pieces, in any order, in the bitbases. The
+  // result is from the point of view of the side to move.
+  BitbaseResult probe(PieceSquare ps[], int n, Color stm) {
+
+    sort(ps, ps + n, piece_less);
+
+    // Exactly one king per side, they are sorted first
+    if (   n < 2
+        || ps[0].piece != make_piece(WHITE, KING)
+        || ps[1].piece != make_piece(BLACK, KING)
+        || (n > 2 && type_of_piece(ps[n - 1].piece) == KING))
+        return BB_NONE;
+
+    if (n == 2)
+        return BB_DRAW;
+
+    const BitbaseEntry* e = find_bitbase(material_key(ps, n, false));
+
+    if (!e)
+        return BB_NONE;
+
+    if (e->swapped)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            ps[i].piece = make_piece(opposite_color(color_of_piece(ps[i].piece)), type_of_piece(ps[i].piece));
+            ps[i].square = flip_square(ps[i].square);
         }
+
+        stm = opposite_color(stm);
+        sort(ps, ps + n, piece_less);
+    }
+
+    uint64_t idx = stm;
+
+    for (int i = 0; i < n; i++)
+        idx |= uint64_t(ps[i].square) << (1 + 6 * i);
+
+    int r = e->bb.load(memory_order_relaxed)->result(idx);
+
+    return r == 1 ? BB_WIN : r == 2 ? BB_LOSS : BB_DRAW;
+  }
+
+  // Known results checked when a bitbase is made available from the UCI
+  // command, regression tests of the generator.
+  struct KnownResult {
+    const char* code;
+    const char* fen;
+    BitbaseResult result;
+  };
+
+  const KnownResult KnownResults[] = {
+    // White's double push is met by bxa3 e.p., the kings are left alone
+    { "KPKP", "8/8/8/8/1pk5/8/P7/K7 w - - 0 1", BB_DRAW }
+  };
+
+  void check_known_results(const Bitbase* bb) {
+
+    for (size_t i = 0; i < sizeof(KnownResults) / sizeof(KnownResult); i++)
+    {
+        if (bb->code != KnownResults[i].code)
+            continue;
+
+        BitbaseResult r = probe_bitbase(Position(KnownResults[i].fen, false, 0));
+
+        if (r != KnownResults[i].result)
+            cout << "Error: bitbase " << bb->code << " gives " << int(r)
+                 << " instead of " << int(KnownResults[i].result)
+                 << " for " << KnownResults[i].fen << endl;
     }
-    return unknownFound ? RESULT_UNKNOWN : RESULT_DRAW;
   }
 
+  // load_or_generate() does the work of load_or_generate_bitbase(), with
+  // BitbaseLock held: the generator state is shared.
+  bool load_or_generate(const string& code, const string& path, int threads) {
 
-  Result classify_btm(const KPKPosition& pos, const Result bb[]) {
+    Bitbase* bb = new Bitbase();
 
-    // If one move leads to a position classified as RESULT_DRAW, the result
-    // of the current position is RESULT_DRAW. If all moves lead to positions
-    // classified as RESULT_WIN, the current position is classified as
-    // RESULT_LOSS. Otherwise, the current position is classified as
-    // RESULT_UNKNOWN.
+    if (!parse_code(code, bb))
+    {
+        cout << "Unsupported bitbase " << code << ", at most "
+             << MaxPieces << " pieces kings included" << endl;
+        delete bb;
+        return false;
+    }
 
-    bool unknownFound = false;
-    Bitboard b;
-    Square s;
-    Result r;
+    if (find_bitbase(bb->keys[0]))
+    {
+        delete bb;
+        return true;
+    }
 
-    // King moves
-    b = pos.bk_attacks();
-    while (b)
+    // First the bitbases reached by a promotion. Captures can only leave
+    // bare kings behind, or a king alone.
+    for (int i = 2; i < bb->size; i++)
+        if (type_of_piece(bb->pieces[i]) == PAWN)
+            for (PieceType pt = KNIGHT; pt <= QUEEN; pt++)
+            {
+                string child = bb->code;
+                size_t k = child.find('K', 1);
+                size_t p = child.find('P', color_of_piece(bb->pieces[i]) == WHITE ? 0 : k);
+
+                child[p] = piece_type_to_char(pt);
+
+                if (!load_or_generate(child, path, threads))
+                {
+                    delete bb;
+                    return false;
+                }
+            }
+
+    // Room for both keys, an empty slot is always left to end the lookups
+    if (BitbaseEntries + 2 >= BitbaseTableSize)
     {
-        s = pop_1st_bit(&b);
-        r = bb[compute_index(pos.whiteKingSquare, s, pos.pawnSquare, WHITE)];
+        cout << "Too many bitbases, " << bb->code << " not added" << endl;
+        delete bb;
+        return false;
+    }
+
+    int64_t time = get_system_time();
+    bool cached = !path.empty() && load(bb, path);
+
+    if (!cached)
+        generate(bb, Max(1, Min(threads, MAX_THREADS - 1)));
+
+    add_bitbase(bb->keys[0], false, bb);
+    add_bitbase(bb->keys[1], true, bb);
+
+    if (!path.empty())
+    {
+        uint64_t count[3] = { 0, 0, 0 };
+
+        for (uint64_t idx = 0; idx < bb->entries(); idx++)
+            count[bb->result(idx)]++;
+
+        cout << "Bitbase " << bb->code << (cached ? " loaded" : " generated")
+             << " in " << get_system_time() - time << " ms: "
+             << count[1] << " wins, " << count[2] << " losses, "
+             << count[0] << " draws or invalid" << endl;
 
-        if (r == RESULT_DRAW)
-            return RESULT_DRAW;
+        if (!cached)
+            save(bb, path);
 
-        if (r == RESULT_UNKNOWN)
-            unknownFound = true;
+        check_known_results(bb);
     }
-    return unknownFound ? RESULT_UNKNOWN : RESULT_LOSS;
+
+    return true;
   }
+}
+
+
+/// load_or_generate_bitbase() makes available the bitbase for the material
+/// given as code, like "KQKP", together with the ones reached from it by a
+/// promotion. A bitbase is read from the given directory when cached there,
+/// otherwise it is generated and, if a directory is given, written to it.
+/// It can be called while other threads probe the bitbases.
+
+bool load_or_generate_bitbase(const string& code, const string& path, int threads) {
+
+  lock_grab(&BitbaseLock);
+  bool ok = load_or_generate(code, path, threads);
+  lock_release(&BitbaseLock);
+
+  return ok;
+}
+
+
+/// init_bitbases() generates the three pieces bitbases at startup. They are
+/// small enough to not need a cache on disk.
+
+void init_bitbases(int threads) {
+
+  lock_init(&BitbaseLock);
+
+  const char* codes[] = { "KQK", "KRK", "KBK", "KNK", "KPK" };
+
+  for (int i = 0; i < 5; i++)
+      load_or_generate_bitbase(codes[i], "", threads);
+}
+
+
+/// bitbase_exists() tells whether a bitbase covers the given material
+
+bool bitbase_exists(Key materialKey) {
+
+  return find_bitbase(materialKey) != NULL;
+}
+
+
+/// probe_bitbase() looks up a position in the bitbases. The result is from
+/// the point of view of the side to move.
+
+BitbaseResult probe_bitbase(const Position& pos) {
+
+  if (   pos.can_castle(WHITE)
+      || pos.can_castle(BLACK)
+      || pos.ep_square() != SQ_NONE)
+      return BB_NONE;
+
+  PieceSquare ps[MaxPieces];
+  Bitboard b = pos.occupied_squares();
+  int n = 0;
+
+  while (b)
+  {
+      if (n == MaxPieces)
+          return BB_NONE;
+
+      ps[n].square = pop_1st_bit(&b);
+      ps[n].piece = pos.piece_on(ps[n].square);
+      n++;
+  }
+
+  return probe(ps, n, pos.side_to_move());
+}
+
+
+/// probe_kpk_bitbase() returns non zero if the side with the pawn, white,
+/// wins the given KP vs K position.
+
+uint32_t probe_kpk_bitbase(Square wksq, Square wpsq, Square bksq, Color stm) {
+
+  PieceSquare ps[3] = { { make_piece(WHITE, KING), wksq },
+                        { make_piece(BLACK, KING), bksq },
+                        { make_piece(WHITE, PAWN), wpsq } };
 
+  return probe(ps, 3, stm) == (stm == WHITE ? BB_WIN : BB_LOSS);
 }
@@ -0,0 +1,29 @@
+/*
+  Atomic endgame bitbases for Atomkraft
+*/
+
+#if !defined(BITBASE_H_INCLUDED)
+#define BITBASE_H_INCLUDED
+
+#include <string>
+
+#include "types.h"
+
+class Position;
+
+/// Win/draw/loss bitbases for atomic endgames with up to four pieces, kings
+/// included. Results are from the side to move point of view. Positions with
+/// castling rights or an en passant square are not covered and return
+/// BB_NONE, as does a material configuration without a bitbase.
+
+enum BitbaseResult {
+  BB_LOSS = -1, BB_DRAW = 0, BB_WIN = 1, BB_NONE = 2
+};
+
+extern void init_bitbases(int threads);
+extern bool load_or_generate_bitbase(const std::string& code, const std::string& path, int threads);
+extern bool bitbase_exists(Key materialKey);
+extern BitbaseResult probe_bitbase(const Position& pos);
+extern uint32_t probe_kpk_bitbase(Square wksq, Square wpsq, Square bksq, Color stm);
+
+#endif // !defined(BITBASE_H_INCLUDED)
@@ -17,6 +17,7 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cassert>
 #include <iostream>
 
 #include "bitboard.h"
@@ -158,13 +159,17 @@ const int RShift[64] = {
 
 // Global bitboards definitions with static storage duration are
 // automatically set to zero before enter main().
-Bitboard RMask[64];
-int RAttackIndex[64];
-Bitboard RAttacks[0x19000];
+Magic RookMagics[64];
+Magic BishopMagics[64];
 
-Bitboard BMask[64];
-int BAttackIndex[64];
-Bitboard BAttacks[0x1480];
+// Whether the slider lookups use PEXT, see slider_index()
+bool SliderPext;
+
+// Slider attacks of all the squares, the rook slices followed by the bishop
+// ones. It is as big as two separate tables would be: both indexings use
+// every entry of a slice, and no two slices hold the same attacks, so the
+// slices cannot overlap to make the table smaller.
+Bitboard SliderAttacks[0x19000 + 0x1480];
 
 Bitboard SetMaskBB[65];
 Bitboard ClearMaskBB[65];
@@ -197,8 +202,8 @@ namespace {
   Bitboard index_to_bitboard(int index, Bitboard mask);
   Bitboard sliding_attacks(int sq, Bitboard occupied, int deltas[][2],
                            int fmin, int fmax, int rmin, int rmax);
-  void init_sliding_attacks(Bitboard attacks[], int attackIndex[], Bitboard mask[],
-                            const int shift[], const Bitboard mult[], int deltas[][2]);
+  Bitboard* init_sliding_attacks(Magic magics[], Bitboard* table, const int shift[],
+                                 const uint64_t mult[], int deltas[][2], bool pext);
 }
 
 
@@ -303,17 +308,33 @@ Square pop_1st_bit(Bitboard* bb) {
 
 void init_bitboards() {
 
-  int rookDeltas[4][2] = {{0,1},{0,-1},{1,0},{-1,0}};
-  int bishopDeltas[4][2] = {{1,1},{-1,1},{1,-1},{-1,-1}};
-
   init_masks();
   init_step_attacks();
-  init_sliding_attacks(RAttacks, RAttackIndex, RMask, RShift, RMult, rookDeltas);
-  init_sliding_attacks(BAttacks, BAttackIndex, BMask, BShift, BMult, bishopDeltas);
+
+  SliderPext = Cpu.fastPext;
+  init_slider_attacks(SliderPext);
+
   init_pseudo_attacks();
   init_between_bitboards();
 }
 
+
+/// init_slider_attacks() fills the slider attack table to be indexed with
+/// PEXT or with the magic multipliers. The lookups expect the indexing chosen
+/// at startup, SliderPext: the slider microbenchmark fills it the other way
+/// and then back again, which is not to be done while searching.
+
+void init_slider_attacks(bool pext) {
+
+  int rookDeltas[4][2] = {{0,1},{0,-1},{1,0},{-1,0}};
+  int bishopDeltas[4][2] = {{1,1},{-1,1},{1,-1},{-1,-1}};
+
+  Bitboard* table = init_sliding_attacks(RookMagics, SliderAttacks, RShift, RMult, rookDeltas, pext);
+  table = init_sliding_attacks(BishopMagics, table, BShift, BMult, bishopDeltas, pext);
+
+  assert(table == SliderAttacks + sizeof(SliderAttacks) / sizeof(Bitboard));
+}
+
 namespace {
 
   // All functions below are used to precompute various bitboards during
@@ -433,25 +454,33 @@ namespace {
     return result;
   }
 
-  void init_sliding_attacks(Bitboard attacks[], int attackIndex[], Bitboard mask[],
-                            const int shift[], const Bitboard mult[], int deltas[][2]) {
-    Bitboard b, v;
-    int i, j, index;
+  Bitboard* init_sliding_attacks(Magic magics[], Bitboard* table, const int shift[],
+                                 const uint64_t mult[], int deltas[][2], bool pext) {
+    Bitboard b;
+    int size;
 
-    for (i = index = 0; i < 64; i++)
+    for (int i = 0; i < 64; i++)
     {
-        attackIndex[i] = index;
-        mask[i] = sliding_attacks(i, 0, deltas, 1, 6, 1, 6);
-        j = 1 << ((CpuIs64Bit ? 64 : 32) - shift[i]);
+        Magic& m = magics[i];
+
+        m.mask = sliding_attacks(i, 0, deltas, 1, 6, 1, 6);
+        m.mult = mult[i];
+        m.shift = shift[i];
+        m.attacks = table;
+
+        // Both indexings need a slice of the size of the occupancy subsets
+        size = 1 << count_1s<CNT32>(m.mask);
+
+        assert(size == 1 << ((CpuIs64Bit ? 64 : 32) - shift[i]));
 
-        for (int k = 0; k < j; k++)
+        for (int k = 0; k < size; k++)
         {
-            b = index_to_bitboard(k, mask[i]);
-            v = CpuIs64Bit ? b * mult[i] : unsigned(b * mult[i] ^ (b >> 32) * (mult[i] >> 32));
-            attacks[index + (v >> shift[i])] = sliding_attacks(i, b, deltas, 0, 7, 0, 7);
+            b = index_to_bitboard(k, m.mask);
+            m.attacks[pext ? magic_index<true>(m, b) : magic_index<false>(m, b)] = sliding_attacks(i, b, deltas, 0, 7, 0, 7);
         }
-        index += j;
+        table += size;
     }
+    return table;
   }
 
   void init_pseudo_attacks() {
@@ -60,17 +60,21 @@ extern Bitboard SquaresInFrontMask[2][64];
 extern Bitboard PassedPawnMask[2][64];
 extern Bitboard AttackSpanMask[2][64];
 
-extern const uint64_t RMult[64];
-extern const int RShift[64];
-extern Bitboard RMask[64];
-extern int RAttackIndex[64];
-extern Bitboard RAttacks[0x19000];
-
-extern const uint64_t BMult[64];
-extern const int BShift[64];
-extern Bitboard BMask[64];
-extern int BAttackIndex[64];
-extern Bitboard BAttacks[0x1480];
+/// Magic holds what is needed to look up the attacks of a slider on a given
+/// square: the mask of the relevant occupied squares, the magic multiplier
+/// and shift, and the slice of the attack table. All the slices are in one
+/// table, the rook ones first.
+
+struct Magic {
+  Bitboard mask;
+  uint64_t mult;
+  Bitboard* attacks;
+  int shift;
+};
+
+extern Magic RookMagics[64];
+extern Magic BishopMagics[64];
+extern Bitboard SliderAttacks[0x19000 + 0x1480];
 
 extern Bitboard BishopPseudoAttacks[64];
 extern Bitboard RookPseudoAttacks[64];
@@ -171,34 +175,60 @@ inline Bitboard in_front_bb(Color c, Square s) {
 /// bitboard of occupied squares as input, and return a bitboard representing
 /// all squares attacked by a rook, bishop or queen on the given square.
 
-#if defined(IS_64BIT)
+/// The slice of a square is indexed either with PEXT, which packs the bits
+/// of the occupancy under the mask, or by multiplication with the magic.
+/// SliderPext is set once at startup, by init_bitboards(), to use PEXT on
+/// the CPUs where it is fast: the test is on a global that never changes,
+/// so its branch is always predicted. magic_index() takes the indexing as a
+/// template parameter for the table setup and the slider benchmark.
 
-inline Bitboard rook_attacks_bb(Square s, Bitboard blockers) {
-  Bitboard b = blockers & RMask[s];
-  return RAttacks[RAttackIndex[s] + ((b * RMult[s]) >> RShift[s])];
+#if defined(HAS_PEXT)
+
+FORCE_INLINE uint64_t pext(uint64_t b, uint64_t mask) {
+  uint64_t r;
+  __asm__("pextq %2, %1, %0" : "=r" (r) : "r" (b), "r" (mask));
+  return r;
 }
 
-inline Bitboard bishop_attacks_bb(Square s, Bitboard blockers) {
-  Bitboard b = blockers & BMask[s];
-  return BAttacks[BAttackIndex[s] + ((b * BMult[s]) >> BShift[s])];
+#endif
+
+extern bool SliderPext;
+
+template<bool Pext>
+FORCE_INLINE unsigned magic_index(const Magic& m, Bitboard occupied) {
+
+#if defined(HAS_PEXT)
+  if (Pext)
+      return unsigned(pext(occupied, m.mask));
+#endif
+
+  Bitboard b = occupied & m.mask;
+
+#if defined(IS_64BIT)
+  return unsigned((b * m.mult) >> m.shift);
+#else
+  return unsigned(int(b) * int(m.mult) ^ int(b >> 32) * int(m.mult >> 32)) >> m.shift;
+#endif
 }
 
-#else // if !defined(IS_64BIT)
+FORCE_INLINE unsigned slider_index(const Magic& m, Bitboard occupied) {
+
+#if defined(HAS_PEXT)
+  if (SliderPext)
+      return magic_index<true>(m, occupied);
+#endif
+
+  return magic_index<false>(m, occupied);
+}
 
 inline Bitboard rook_attacks_bb(Square s, Bitboard blockers) {
-  Bitboard b = blockers & RMask[s];
-  return RAttacks[RAttackIndex[s] +
-        (unsigned(int(b) * int(RMult[s]) ^ int(b >> 32) * int(RMult[s] >> 32)) >> RShift[s])];
+  return RookMagics[s].attacks[slider_index(RookMagics[s], blockers)];
 }
 
 inline Bitboard bishop_attacks_bb(Square s, Bitboard blockers) {
-  Bitboard b = blockers & BMask[s];
-  return BAttacks[BAttackIndex[s] +
-        (unsigned(int(b) * int(BMult[s]) ^ int(b >> 32) * int(BMult[s] >> 32)) >> BShift[s])];
+  return BishopMagics[s].attacks[slider_index(BishopMagics[s], blockers)];
 }
 
-#endif
-
 inline Bitboard queen_attacks_bb(Square s, Bitboard blockers) {
   return rook_attacks_bb(s, blockers) | bishop_attacks_bb(s, blockers);
 }
@@ -291,5 +321,6 @@ extern Square pop_1st_bit(Bitboard* b);
 
 extern void print_bitboard(Bitboard b);
 extern void init_bitboards();
+extern void init_slider_attacks(bool pext);
 
 #endif // !defined(BITBOARD_H_INCLUDED)
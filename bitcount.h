@@ -95,4 +95,21 @@ inline int count_1s<CNT_POPCNT>(Bitboard b) {
 #endif
 }
 
+/// count_1s() and count_1s_max15() without a template argument use the
+/// hardware popcount when init_cpu() has found it, so that one binary is
+/// fast everywhere. In the hot loops prefer to test Cpu.popcnt once and call
+/// a function templated on it, as evaluate() does.
+
+inline int count_1s(Bitboard b) {
+
+  return Cpu.popcnt ? count_1s<CNT_POPCNT>(b)
+       : CpuIs64Bit ? count_1s<CNT64>(b) : count_1s<CNT32>(b);
+}
+
+inline int count_1s_max15(Bitboard b) {
+
+  return Cpu.popcnt ? count_1s<CNT_POPCNT>(b)
+       : CpuIs64Bit ? count_1s<CNT64_MAX15>(b) : count_1s<CNT32_MAX15>(b);
+}
+
 #endif // !defined(BITCOUNT_H_INCLUDED)
@@ -24,16 +24,34 @@
   Public License, and can be downloaded from http://wbec-ridderkerk.nl
 */
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
 #include "book.h"
+#include "misc.h"
 #include "movegen.h"
 
 using namespace std;
 
 namespace {
 
+  // Number of book entries in a 4KB page, the in memory index has the
+  // first key of each of them.
+  const int EntriesPerPage = 4096 / sizeof(BookEntry);
+
+  // get_number() converts sizeof(T) bytes, highest byte first, in a number
+  template<typename T>
+  T get_number(const unsigned char* p) {
+
+    T n = 0;
+
+    for (size_t i = 0; i < sizeof(T); i++)
+        n = T((n << 8) | p[i]);
+
+    return n;
+  }
+
   // Random numbers from PolyGlot, used to compute book hash keys
   const uint64_t Random64[781] = {
     0x9D39247E33776D41ULL, 0x2AF7398005AAA5C7ULL, 0x44DB015024623547ULL,
@@ -350,7 +368,7 @@ uint64_t book_key(const Position& pos) {
 
 
 /// Book c'tor. Make random number generation less deterministic, for book moves
-Book::Book() {
+Book::Book() : bookData(NULL), bookBytes(0), bookSize(0) {
 
   OLD for (int i = abs(get_system_time() % 10000); i > 0; i--)
       RKiss.rand<unsigned>();
@@ -363,7 +381,7 @@ Book::Book() {
 }
 
 
-/// Book destructor. Be sure file is closed before we leave.
+/// Book destructor. Be sure file is unmapped before we leave.
 
 Book::~Book() {
 
@@ -371,43 +389,45 @@ Book::~Book() {
 }
 
 
-/// Book::close() closes the file only if it is open, otherwise
-/// we can end up in a little mess due to how std::ifstream works.
+/// Book::close() unmaps the file only if it is mapped
 
 void Book::close() {
 
-  if (bookFile.is_open())
-      bookFile.close();
+  unmap_file((const char*)bookData, bookBytes);
 
+  bookData = NULL;
+  bookBytes = 0;
+  bookSize = 0;
+  pageKeys.clear();
   bookName = "";
 }
 
 
-/// Book::open() opens a book file with a given file name
+/// Book::open() maps a book file with a given file name read-only in memory
+/// and builds the index of the first key of each page.
 
 void Book::open(const string& fileName) {
 
   // Close old file before opening the new
   close();
-  
-  OLD bookFile.open(fileName.c_str(), ifstream::in | ifstream::binary);
-  NEW bookFile.open(fileName.c_str(), 
-		  ifstream::in | ifstream::binary | ofstream::binary | ofstream::out);
-
-  // Silently return when asked to open a non-exsistent file
-  if (!bookFile.is_open())
-      return;
 
-  // Get the book size in number of entries
-  bookFile.seekg(0, ios::end);
-  bookSize = long(bookFile.tellg()) / sizeof(BookEntry);
+  // Silently return when asked to open a non-exsistent or empty file
+  size_t bytes;
+  const char* data = map_file(fileName, &bytes);
 
-  if (!bookFile.good())
+  if (bytes < sizeof(BookEntry))
   {
-      cerr << "Failed to open book file " << fileName << endl;
-      exit(EXIT_FAILURE);
+      unmap_file(data, bytes);
+      return;
   }
 
+  bookData = (const unsigned char*)data;
+  bookBytes = bytes;
+  bookSize = int(bytes / sizeof(BookEntry));
+
+  for (int idx = 0; idx < bookSize; idx += EntriesPerPage)
+      pageKeys.push_back(read_key(idx));
+
   // Set only if successful
   bookName = fileName;
 }
@@ -419,7 +439,7 @@ void Book::open(const string& fileName) {
 
 Move Book::get_move(const Position& pos, bool findBestMove) {
 
-  if (!bookFile.is_open() || bookSize == 0)
+  if (!bookData)
       return MOVE_NONE;
   
 
@@ -486,28 +506,32 @@ Move Book::get_move(const Position& pos, bool findBestMove) {
 }
 
 
-/// Book::find_entry() takes a book key as input, and does a binary search
-/// through the book file for the given key. The index to the first book
-/// entry with the same key as the input is returned. When the key is not
-/// found in the book file, bookSize is returned.
+/// Book::find_entry() takes a book key as input, and returns the index of
+/// the first book entry with that key, or bookSize when the key is not in
+/// the book. The in memory index gives the page that can hold the key, the
+/// binary search is then done inside it.
 
-int Book::find_entry(uint64_t key) {
+int Book::find_entry(uint64_t key) const {
 
   int left, right, mid;
 
-  // Binary search (finds the leftmost entry)
-  left = 0;
-  right = bookSize - 1;
+  // The first page starting with a key not smaller than the given one. The
+  // leftmost entry with the key is after the start of the page before it.
+  int page = int(lower_bound(pageKeys.begin(), pageKeys.end(), key) - pageKeys.begin());
+
+  left  = page ? (page - 1) * EntriesPerPage : 0;
+  right = Min(page * EntriesPerPage, bookSize - 1);
 
   assert(left <= right);
 
+  // Binary search (finds the leftmost entry)
   while (left < right)
   {
       mid = (left + right) / 2;
 
       assert(mid >= left && mid < right);
 
-      if (key <= read_entry(mid).key)
+      if (key <= read_key(mid))
           right = mid;
       else
           left = mid + 1;
@@ -515,97 +539,44 @@ int Book::find_entry(uint64_t key) {
 
   assert(left == right);
 
-  return read_entry(left).key == key ? left : bookSize;
+  return read_key(left) == key ? left : bookSize;
 }
 
 
-/// Book::get_number() reads sizeof(T) chars from the file's binary byte
-/// stream and converts them in a number of type T.
-template<typename T>
-void Book::get_number(T& n) {
+/// Book::read_key() returns the key of the book entry at the given index
 
-  n = 0;
+uint64_t Book::read_key(int idx) const {
 
-  for (size_t i = 0; i < sizeof(T); i++) {
-      n = (n << 8) + (T)bookFile.get();
-      
-//      int get = bookFile.get();
-//      n = (n << 8) + (T)get;
-//      if (sizeof(T) == 8) {
-//    	  cout << get << " ";
-//      } 
-  }
+  assert(idx >= 0 && idx < bookSize);
+
+  return get_number<uint64_t>(bookData + idx * sizeof(BookEntry));
 }
 
 
 /// Book::read_entry() takes an integer index, and returns the BookEntry
 /// at the given index in the book file.
 
-BookEntry Book::read_entry(int idx) {
+BookEntry Book::read_entry(int idx) const {
 
   assert(idx >= 0 && idx < bookSize);
-  assert(bookFile.is_open());
+  assert(bookData);
 
+  const unsigned char* p = bookData + idx * sizeof(BookEntry);
   BookEntry e;
 
-  bookFile.seekg(idx * sizeof(BookEntry), ios_base::beg);
-
-  get_number(e.key);
-  get_number(e.move);
-  get_number(e.count);
-  get_number(e.learn);
+  e.key   = get_number<uint64_t>(p);
+  e.move  = get_number<uint16_t>(p + 8);
+  e.count = get_number<uint16_t>(p + 10);
+  e.learn = get_number<uint32_t>(p + 12);
 
-  if (!bookFile.good())
-  {
-      cerr << "Failed to read book entry at index " << idx << endl;
-      exit(EXIT_FAILURE);
-  }
   return e;
 }
 
 
 
 STARTNEW
-template<typename T>
-void Book::write_number(T& n) {
-
-
-  for (size_t i = 0; i < sizeof(T); i++) {
-	  char c = char((n >> ((sizeof(T) - 1) * 8)));
-	  n <<= 8;
-	  bookFile.write(&c, 1);
-  }
-      
-}
-
-void Book::write_entry(uint64_t key, Move move, uint16_t count) {
-	// convert Move to polyglot move
-	uint16_t m = make_move(move_from(move), move_to(move)) | (move_promotion_piece(move) << 12);
-	uint32_t learn = 0;
-	
-	write_number(key);
-	write_number(m);
-	write_number(count);
-	write_number(learn);
-	
-	++bookSize;
-	
-	if (!bookFile.good()) {
-		cerr << "Failed to write book." << endl;
-		exit(EXIT_FAILURE);
-	}
-	
-//	bookFile.flush();
-//	
-//	if (!bookFile.good()) {
-//		cerr << "Failed to flush book." << endl;
-//		exit(EXIT_FAILURE);
-//	}
-}
-
-
 void Book::print_all_moves(const Position& pos) {
-	  if (!bookFile.is_open() || bookSize == 0) {
+	  if (!bookData) {
 		  cout << "book is empty" << endl;
 		  return;
 	  }
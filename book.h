@@ -20,8 +20,8 @@
 #if !defined(BOOK_H_INCLUDED)
 #define BOOK_H_INCLUDED
 
-#include <fstream>
 #include <string>
+#include <vector>
 
 #include "move.h"
 #include "position.h"
@@ -40,6 +40,11 @@ struct BookEntry {
 
 NEW uint64_t book_key(const Position& pos);
 
+/// Book maps the book file read-only in memory, so that the entries are read
+/// in place and the pages are shared by all the engine processes using the
+/// same book. An index with the first key of every page of the file is kept
+/// in memory, a lookup then touches a single page of the book.
+
 class Book {
 public:
   Book();
@@ -50,18 +55,15 @@ public:
   const std::string name() const { return bookName; }
   
   NEW void print_all_moves(const Position& pos);
-  NEW void write_entry(uint64_t key, Move move, uint16_t count);
-  NEW BookEntry read_entry(int idx);
+  NEW BookEntry read_entry(int idx) const;
 
 private:
-  template<typename T> void get_number(T& n);
-  NEW template<typename T> void write_number(T& n);
-
-  //OLD BookEntry read_entry(int idx);
-  int find_entry(uint64_t key);
+  uint64_t read_key(int idx) const;
+  int find_entry(uint64_t key) const;
 
-  //OLD std::ifstream bookFile;
-  NEW std::fstream bookFile;
+  const unsigned char* bookData;
+  size_t bookBytes;
+  std::vector<uint64_t> pageKeys;
   std::string bookName;
   int bookSize;
   RKISS RKiss;
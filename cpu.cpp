@@ -0,0 +1,105 @@
+/*
+  Runtime CPU feature detection for Atomkraft
+*/
+
+#include <cstring>
+#include <string>
+
+#include "bitboard.h"
+#include "misc.h"
+#include "nnue.h"
+#include "types.h"
+
+CpuFeatures Cpu;
+
+namespace {
+
+  // xgetbv0() reads the XCR0 register, where the OS tells which vector
+  // registers it saves on a context switch.
+  uint64_t xgetbv0() {
+
+#if defined(USE_SIMD)
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return eax | (uint64_t(edx) << 32);
+#else
+    return 0;
+#endif
+  }
+}
+
+
+/// init_cpu() detects the CPU features once, at startup. It must be called
+/// before init_bitboards() and nnue::init_kernels(), which choose their code
+/// paths from the result.
+
+void init_cpu() {
+
+  int CPUInfo[4] = {-1};
+
+  memset(&Cpu, 0, sizeof(Cpu));
+
+  __cpuid(CPUInfo, 0x00000000);
+
+  int maxLeaf = CPUInfo[0];
+  bool isAMD = (CPUInfo[1] == 0x68747541); // "Auth" of "AuthenticAMD"
+
+  if (maxLeaf < 1)
+      return;
+
+  __cpuid(CPUInfo, 0x00000001);
+
+  int family = ((CPUInfo[0] >> 8) & 0xF) + ((CPUInfo[0] >> 20) & 0xFF);
+  bool osxsave = (CPUInfo[2] >> 27) & 1;
+  bool avx = (CPUInfo[2] >> 28) & 1;
+  uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+
+  Cpu.popcnt = (CPUInfo[2] >> 23) & 1;
+
+  if (maxLeaf >= 7)
+  {
+      __cpuid(CPUInfo, 0x00000007);
+
+      Cpu.bmi2   = (CPUInfo[1] >> 8) & 1;
+      Cpu.avx2   = avx && (CPUInfo[1] >> 5) & 1 && (xcr0 & 0x06) == 0x06;
+      Cpu.avx512 =    ((CPUInfo[1] >> 16) & 1)  // AVX512F
+                   && ((CPUInfo[1] >> 30) & 1)  // AVX512BW
+                   && (xcr0 & 0xE6) == 0xE6;
+  }
+
+  // PEXT is microcoded, and very slow, on AMD CPUs before Zen 3
+  Cpu.fastPext = Cpu.bmi2 && (!isAMD || family >= 0x19);
+
+  // Report only what the binary can use
+#if !defined(USE_POPCNT)
+  Cpu.popcnt = false;
+#endif
+
+#if !defined(HAS_PEXT)
+  Cpu.bmi2 = Cpu.fastPext = false;
+#endif
+
+#if !defined(USE_SIMD)
+  Cpu.avx2 = Cpu.avx512 = false;
+#endif
+}
+
+
+/// cpu_info() returns a line with the detected features and the code paths
+/// chosen for the hot kernels, printed at startup.
+
+std::string cpu_info() {
+
+  std::string s = "CPU:";
+
+  if (Cpu.popcnt) s += " popcnt";
+  if (Cpu.bmi2)   s += Cpu.fastPext ? " bmi2" : " bmi2(slow pext)";
+  if (Cpu.avx2)   s += " avx2";
+  if (Cpu.avx512) s += " avx512";
+
+  s += std::string(", popcount: ") + (Cpu.popcnt ? "hardware" : "software");
+  s += std::string(", sliders: ") + (SliderPext ? "pext" : "magic");
+  s += std::string(", nnue: ") + nnue::kernel_name();
+
+  return s;
+}
@@ -13,9 +13,20 @@
 #include "movegen.h"
 #include "book.h"
 #include "debug.h"
+#include "misc.h"
+#include "pgn.h"
+#include "thread.h"
+#include "ucioption.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <list>
 #include <queue>
-#include <cctype>
+#include <sstream>
+#include <unordered_map>
 
 using namespace std;
 
@@ -33,6 +44,7 @@ void findChildren(MoveTreeNode* node, Position& pos, int* index) {
 	SearchLimits limits;
 	limits.maxTime = MAX_SEARCH_TIME;
     limits.increment = 0;
+    limits.collectRootMoves = true;
 
     Move bestmove, pondermove;
 
@@ -70,126 +82,6 @@ void killChildren(MoveTreeNode* node) {
 
 
 
-File getFile(char c) {
-	return (c >= 'a' && c <= 'h') ? File(c - 'a') : FILE_NONE;
-}
-
-Rank getRank(char c) {
-	return (c >= '1' && c <= '7') ? Rank(c - '1') : RANK_NONE;
-}
-
-PieceType getPiece(char c) {
-	switch (c) {
-	case 'N': return KNIGHT;
-	case 'B': return BISHOP;
-	case 'R': return ROOK;
-	case 'Q': return QUEEN;
-	case 'K': return KING;
-	default:
-		return PIECE_TYPE_NONE;
-	}
-}
-
-
-/*
- * converts san string to a Move
- * Note that it doesn't work for all san strings, but for those used in the eao
- */
-Move san_to_move(Position& pos, char* s) {
-	char str[10];
-	strcpy(str, s);
-
-	// generate legal moves
-	MoveStack mlist[MAX_MOVES];
-	MoveStack* last = generate<MV_LEGAL>(pos, mlist);
-
-
-	// get rid of 'x' chars
-	char* x = strchr(str, 'x');
-	if (x) while (*x) *x++ = *(x+1);
-
-
-	// get piece type
-	int p = 1;
-	PieceType pt = getPiece(str[0]);
-	if (pt == PIECE_TYPE_NONE) {
-		pt = PAWN;
-		p = 0;
-	}
-
-	// there may be additional info regarding the file/rank
-	File fromFile = getFile(str[p+0]);
-	Rank fromRank = getRank(str[p+0]);
-	Square to;
-
-	// TODO: san can be like Bf3e4
-
-	if (fromRank != RANK_NONE || getFile(str[p+1]) != FILE_NONE) {
-		// san begins with a number e.g. B8d6 or with two letters e.g. Bfd6
-		to = make_square(File(str[p+1] - 'a'), Rank(str[p+2] - '1'));
-	} else {
-		// san is like Bd6
-		to = make_square(File(str[p+0] - 'a'), Rank(str[p+1] - '1'));
-		fromFile = FILE_NONE;
-	}
-
-
-	// traverse legal moves and pick the right one
-	Move m = MOVE_NONE;
-	int possible_move_count = 0; // used to detect errors
-
-	for (MoveStack* cur = mlist; cur != last; cur++) {
-		Square sqfrom = move_from(cur->move);
-		Square sqto = move_to(cur->move);
-
-		if (strcmp(str, "O-O") == 0) {
-			if (move_is_short_castle(cur->move)) {
-				m = cur->move;
-				possible_move_count = 1;
-				break;
-			}
-		} else if (strcmp(str, "O-O-O") == 0) {
-			if (move_is_long_castle(cur->move)) {
-				m = cur->move;
-				possible_move_count = 1;
-				break;
-			}
-		} else {
-
-			if (sqto == to && pt == pos.type_of_piece_on(sqfrom)) {
-				if (fromFile != FILE_NONE) {
-					if (square_file(sqfrom) == fromFile) {
-						m = cur->move;
-						++possible_move_count;
-						//break;
-					}
-				} else if (fromRank != RANK_NONE) {
-					if (square_rank(sqfrom) == fromRank) {
-						m = cur->move;
-						++possible_move_count;
-						//break;
-					}
-				} else {
-					m = cur->move;
-					++possible_move_count;
-					//break;
-				}
-			}
-		}
-	}
-
-
-	if (possible_move_count != 1) {
-		m = MOVE_NONE;
-		cout << "incorrect SAN! (it may be ambiguous )" << endl;
-	}
-
-
-	return m;
-}
-
-
-
 void printTree(MoveTreeNode* node) {
 
 	if (node->child_count == 0) {
@@ -244,7 +136,10 @@ void write_number(FILE* file, T& n) {
 
 void write_entry(FILE* file, uint64_t key, Move move, uint16_t count) {
 	// convert Move to polyglot move
-	uint16_t m = make_move(move_from(move), move_to(move)) | (move_promotion_piece(move) << 12);
+	// polyglot promotion pieces are numbered from 1 (knight) to 4 (queen)
+	uint16_t m = make_move(move_from(move), move_to(move));
+	if (move_is_promotion(move))
+		m |= (move_promotion_piece(move) - 1) << 12;
 	uint32_t learn = 0;
 
 	write_number(file, key);
@@ -386,7 +281,8 @@ void createBookEAO() {
 				// we have a new token
 				bool playable = (*token != '?');
 
-				Move m = san_to_move(pos, playable ? token : token+1);
+				char* san = playable ? token : token+1;
+				Move m = move_from_san(pos, san, int(strlen(san)));
 
 				//cout << "  " << token << " ";
 				if (m == MOVE_NONE) {
@@ -598,17 +494,499 @@ void createBookEAO() {
 }
 
 
+/*
+ * makebook: builds a polyglot book from PGN files of any size. The reader
+ * hands batches of games to worker threads, which replay them and count
+ * the (position, move) pairs in sharded hash tables. When the tables grow
+ * past the memory budget they are spilled to a sorted run file, and the
+ * runs are merged into the book at the end.
+ */
+
+namespace {
+
+  // A (position, move) pair with its statistics. The score is in half points
+  // of the side to move, two for a win and one for a draw.
+  struct BookRecord {
+    uint64_t key;
+    uint16_t move;
+    uint32_t games;
+    uint32_t score;
+  };
+
+  inline bool operator<(const BookRecord& r1, const BookRecord& r2) {
+    return r1.key < r2.key || (r1.key == r2.key && r1.move < r2.move);
+  }
+
+  struct RecordKey {
+    uint64_t key;
+    uint16_t move;
+
+    bool operator==(const RecordKey& k) const { return key == k.key && move == k.move; }
+  };
+
+  struct RecordKeyHash {
+    size_t operator()(const RecordKey& k) const { return size_t(k.key ^ (uint64_t(k.move) << 40)); }
+  };
+
+  struct RecordStats {
+    uint32_t games;
+    uint32_t score;
+  };
+
+  typedef unordered_map<RecordKey, RecordStats, RecordKeyHash> RecordMap;
+
+  // The pairs are spread on many shards, each with its own lock, so that
+  // the workers seldom wait for each other.
+  const int ShardCount = 64;
+
+  // Estimated memory used by a record in the hash tables
+  const size_t RecordBytes = 64;
+
+  // Games are handed to the workers in batches of this size
+  const size_t BatchSize = 256;
+
+  struct Shard {
+    Lock lock;
+    RecordMap records;
+  };
+
+  struct MakeBookState {
+    Shard shards[ShardCount];
+    atomic<size_t> records;
+    size_t maxRecords;
+    int maxPly;
+
+    Lock queueLock;
+    WaitCondition queueNotEmpty, queueNotFull;
+    deque<vector<PgnGame> > queue;
+    size_t maxQueue;
+    bool readerDone;
+
+    atomic<uint64_t> games, positions, badGames;
+    vector<PgnReader>* pgns;
+    vector<string> runFiles;
+    string bookFile;
+  };
+
+  MakeBookState MB;
+
+  const string BookStartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+
+  // add_record() counts a move played in the position with the given book key
+  void add_record(uint64_t key, Move m, int score) {
+
+    Shard& sh = MB.shards[key >> 58];
+    RecordKey rk = { key, uint16_t(m) };
+
+    lock_grab(&sh.lock);
+
+    RecordStats& rs = sh.records[rk];
+
+    if (!rs.games)
+        MB.records++;
+
+    rs.games++;
+    rs.score += score;
+
+    lock_release(&sh.lock);
+  }
+
+
+  // replay_game() plays the moves of a game, up to the maximum ply, and
+  // counts each of them. A move that can not be decoded ends the game.
+
+  void replay_game(const PgnGame& game, int threadID) {
 
+    Position pos(BookStartFEN, false, threadID);
+    PgnMoveIterator it(game);
+    PgnToken san;
+    ResultPGN r = game.result();
+    int result = (r == WHITE_WINS ? 2 : r == DRAW ? 1 : 0);
 
+    for (int ply = 0; ply < MB.maxPly && it.next(san); ply++)
+    {
+        Move m = move_from_san(pos, san.str, san.len);
 
+        if (m == MOVE_NONE)
+        {
+            MB.badGames++;
+            break;
+        }
 
+        add_record(book_key(pos), m, pos.side_to_move() == WHITE ? result : 2 - result);
+        pos.do_setup_move(m);
+        MB.positions++;
+    }
 
+    MB.games++;
+  }
 
 
+  // book_worker() replays the batches of games in the queue until the reader
+  // is done and the queue is empty.
 
+  void book_worker(int, int threadID) {
 
+    vector<PgnGame> batch;
 
+    while (true)
+    {
+        lock_grab(&MB.queueLock);
 
+        while (MB.queue.empty() && !MB.readerDone)
+            cond_wait(&MB.queueNotEmpty, &MB.queueLock);
 
+        if (MB.queue.empty())
+        {
+            // Wake up the next worker waiting to quit
+            cond_signal(&MB.queueNotEmpty);
+            lock_release(&MB.queueLock);
+            return;
+        }
 
+        batch.swap(MB.queue.front());
+        MB.queue.pop_front();
+        cond_signal(&MB.queueNotFull);
+        lock_release(&MB.queueLock);
 
+        for (size_t i = 0; i < batch.size(); i++)
+            replay_game(batch[i], threadID);
+    }
+  }
+
+  // spill_run() moves the records of the hash tables to a new run file,
+  // sorted by key and move.
+
+  void spill_run(const string& bookFile) {
+
+    vector<BookRecord> run;
+    run.reserve(MB.records);
+
+    for (int i = 0; i < ShardCount; i++)
+    {
+        RecordMap records;
+
+        lock_grab(&MB.shards[i].lock);
+        records.swap(MB.shards[i].records);
+        lock_release(&MB.shards[i].lock);
+
+        MB.records -= records.size();
+
+        for (RecordMap::const_iterator it = records.begin(); it != records.end(); ++it)
+        {
+            BookRecord r = { it->first.key, it->first.move, it->second.games, it->second.score };
+            run.push_back(r);
+        }
+    }
+
+    if (run.empty())
+        return;
+
+    sort(run.begin(), run.end());
+
+    ostringstream ss;
+    ss << bookFile << ".run" << MB.runFiles.size();
+
+    FILE* f = fopen(ss.str().c_str(), "wb");
+
+    if (!f || fwrite(&run[0], sizeof(BookRecord), run.size(), f) != run.size())
+    {
+        cerr << "Failed to write " << ss.str() << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(f);
+    MB.runFiles.push_back(ss.str());
+  }
+
+
+  // push_batch() queues a batch of games for the workers, waiting if they
+  // are behind, and spills the tables when they are over the budget.
+
+  void push_batch(vector<PgnGame>& batch, const string& bookFile) {
+
+    lock_grab(&MB.queueLock);
+
+    while (MB.queue.size() >= MB.maxQueue)
+        cond_wait(&MB.queueNotFull, &MB.queueLock);
+
+    MB.queue.push_back(vector<PgnGame>());
+    MB.queue.back().swap(batch);
+    cond_signal(&MB.queueNotEmpty);
+    lock_release(&MB.queueLock);
+
+    if (MB.records > MB.maxRecords)
+        spill_run(bookFile);
+  }
+
+
+  // read_games() queues the games of a PGN file. Only finished atomic games
+  // from the starting position are kept.
+
+  void read_games(PgnReader& pgn, const string& bookFile) {
+
+    vector<PgnGame> batch;
+    PgnGame game;
+    PgnToken value;
+
+    while (pgn.next_game(game))
+    {
+        if (   game.result() == NO_RESULT
+            || game.tag("FEN", value)
+            || (game.tag("Variant", value) && value.to_string() != "Atomic" && value.to_string() != "atomic"))
+            continue;
+
+        batch.push_back(game);
+
+        if (batch.size() >= BatchSize)
+            push_batch(batch, bookFile);
+    }
+
+    if (!batch.empty())
+        push_batch(batch, bookFile);
+  }
+
+
+  // book_reader() queues the games of all the PGN files, it is run by the
+  // caller of the workers. The files that failed to open have no games.
+
+  void book_reader() {
+
+    for (size_t i = 0; i < MB.pgns->size(); i++)
+        read_games((*MB.pgns)[i], MB.bookFile);
+
+    lock_grab(&MB.queueLock);
+    MB.readerDone = true;
+    cond_signal(&MB.queueNotEmpty);
+    lock_release(&MB.queueLock);
+  }
+
+
+  // write_position() writes the book entries of a position. The weights are
+  // the scores, scaled down if needed to fit in 16 bits.
+
+  int write_position(FILE* f, const vector<BookRecord>& moves) {
+
+    uint32_t maxScore = 0;
+    int entries = 0;
+
+    for (size_t i = 0; i < moves.size(); i++)
+        maxScore = Max(maxScore, moves[i].score);
+
+    for (size_t i = 0; i < moves.size(); i++)
+    {
+        uint32_t weight = (maxScore > 0xFFFF ? uint32_t(uint64_t(moves[i].score) * 0xFFFF / maxScore)
+                                             : moves[i].score);
+        if (weight)
+        {
+            write_entry(f, moves[i].key, Move(moves[i].move), uint16_t(weight));
+            entries++;
+        }
+    }
+
+    return entries;
+  }
+
+
+  // merge_runs() merges the sorted run files into the book, summing the
+  // statistics of the same pair from different runs. Only one record per
+  // run and the moves of one position are kept in memory.
+
+  uint64_t merge_runs(const string& bookFile, uint32_t minCount) {
+
+    typedef pair<BookRecord, size_t> Head;
+
+    struct HeadGreater {
+      bool operator()(const Head& h1, const Head& h2) const { return h2.first < h1.first; }
+    };
+
+    vector<FILE*> runs;
+    priority_queue<Head, vector<Head>, HeadGreater> heads;
+    vector<BookRecord> moves;
+    BookRecord r;
+    uint64_t entries = 0;
+
+    FILE* out = fopen(bookFile.c_str(), "wb");
+
+    if (!out)
+    {
+        cerr << "Failed to open " << bookFile << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < MB.runFiles.size(); i++)
+    {
+        runs.push_back(fopen(MB.runFiles[i].c_str(), "rb"));
+
+        if (!runs[i])
+        {
+            cerr << "Failed to open " << MB.runFiles[i] << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        if (fread(&r, sizeof(BookRecord), 1, runs[i]) == 1)
+            heads.push(Head(r, i));
+    }
+
+    while (!heads.empty())
+    {
+        Head h = heads.top();
+        heads.pop();
+
+        if (fread(&r, sizeof(BookRecord), 1, runs[h.second]) == 1)
+            heads.push(Head(r, h.second));
+
+        if (!moves.empty() && moves.back().key == h.first.key && moves.back().move == h.first.move)
+        {
+            moves.back().games += h.first.games;
+            moves.back().score += h.first.score;
+            continue;
+        }
+
+        if (!moves.empty() && moves.back().games < minCount)
+            moves.pop_back();
+
+        if (!moves.empty() && moves.back().key != h.first.key)
+        {
+            entries += write_position(out, moves);
+            moves.clear();
+        }
+
+        moves.push_back(h.first);
+    }
+
+    if (!moves.empty() && moves.back().games < minCount)
+        moves.pop_back();
+
+    entries += write_position(out, moves);
+
+    fclose(out);
+
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        fclose(runs[i]);
+        remove(MB.runFiles[i].c_str());
+    }
+
+    return entries;
+  }
+
+
+  // is_keyword() tells whether a makebook argument is the name of a
+  // parameter rather than a PGN file: a lowercase word that is not a file.
+
+  bool is_keyword(const string& token) {
+
+    if (token.find_first_not_of("abcdefghijklmnopqrstuvwxyz-") != string::npos)
+        return false;
+
+    FILE* f = fopen(token.c_str(), "rb");
+
+    if (f)
+        fclose(f);
+
+    return !f;
+  }
+
+} // namespace
+
+
+/// make_book() builds a polyglot book from PGN files of atomic games. The
+/// book file comes first, then the PGN files and the optional parameters:
+/// the number of plies of each game to use (default 30), the minimum number
+/// of games for a move (default 1), the "concurrency" of the worker threads
+/// and the memory budget in MB of the tables (default 256), as example:
+///
+///   makebook atomic.bin lichess1.pgn lichess2.pgn plies 24 mincount 3 concurrency 4
+///
+/// Memory is bounded whatever the size of the PGN files, the tables are
+/// spilled to run files next to the book when they reach the budget.
+
+void make_book(istream& is) {
+
+  string bookFile, token;
+  vector<string> pgnFiles;
+  int threads = Options["Threads"].value<int>();
+  int memory = 256;
+  uint32_t minCount = 1;
+
+  MB.maxPly = 30;
+
+  is >> bookFile;
+
+  while (is >> token)
+  {
+      if (token == "plies")
+          is >> MB.maxPly;
+      else if (token == "mincount")
+          is >> minCount;
+      else if (token == "concurrency")
+          is >> threads;
+      else if (token == "memory")
+          is >> memory;
+      else if (is_keyword(token))
+      {
+          cout << "Unknown makebook argument: " << token << endl;
+          return;
+      }
+      else
+          pgnFiles.push_back(token);
+  }
+
+  if (bookFile.empty() || pgnFiles.empty())
+  {
+      cout << "Usage: makebook <book file> <pgn file>... [plies <n>] [mincount <n>]"
+              " [concurrency <n>] [memory <MB>]" << endl;
+      return;
+  }
+
+  threads = Max(1, Min(threads, MAX_THREADS - 1));
+  MB.maxPly = Max(1, MB.maxPly);
+  MB.maxRecords = Max(memory, 1) * (size_t(1) << 20) / RecordBytes;
+  MB.maxQueue = 2 * threads;
+  MB.readerDone = false;
+  MB.records = 0;
+  MB.games = MB.positions = MB.badGames = 0;
+  MB.runFiles.clear();
+
+  for (int i = 0; i < ShardCount; i++)
+      lock_init(&MB.shards[i].lock);
+
+  lock_init(&MB.queueLock);
+  cond_init(&MB.queueNotEmpty);
+  cond_init(&MB.queueNotFull);
+
+  int64_t time = get_system_time();
+
+  // The games point inside the mapped files, keep them open until the
+  // workers are done.
+  vector<PgnReader> pgns(pgnFiles.size());
+
+  for (size_t i = 0; i < pgnFiles.size(); i++)
+      if (!pgns[i].open(pgnFiles[i]))
+          cout << "Failed to open " << pgnFiles[i] << endl;
+
+  MB.pgns = &pgns;
+  MB.bookFile = bookFile;
+
+  // The workers replay the games, the caller reads the PGN files
+  Threads.run_workers(book_worker, threads, book_reader);
+
+  spill_run(bookFile);
+
+  uint64_t entries = merge_runs(bookFile, minCount);
+
+  for (int i = 0; i < ShardCount; i++)
+      lock_destroy(&MB.shards[i].lock);
+
+  lock_destroy(&MB.queueLock);
+  cond_destroy(&MB.queueNotEmpty);
+  cond_destroy(&MB.queueNotFull);
+
+  cout << "Games: " << MB.games << " (" << MB.badGames << " with an unknown move)"
+       << "\nPositions: " << MB.positions
+       << "\nRuns: " << MB.runFiles.size()
+       << "\nBook entries: " << entries
+       << "\nTime (ms): " << get_system_time() - time << endl;
+}
@@ -10,6 +10,8 @@
 
 #include "position.h"
 #include "move.h"
+#include <iostream>
+#include <string>
 #include <vector>
 #include "book.h"
 #include "position.h"
@@ -39,7 +41,7 @@ void findChildren(MoveTreeNode* node, Position& pos, int* index);
 void killChildren(MoveTreeNode* node);
 
 void createBookEAO();
-Move san_to_move(Position&, char*);
+void make_book(std::istream& is);
 
 
 #endif /* CREATE_BOOK_H_ */
@@ -0,0 +1,221 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "datagen.h"
+#include "evaluate.h"
+#include "lock.h"
+#include "match.h"
+#include "misc.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "tt.h"
+
+using namespace std;
+
+namespace {
+
+  // DataState is shared by the threads playing the games. Games are handed
+  // out one at a time under the lock, and their positions written under it.
+  struct DataState {
+    GameSettings gs;
+    vector<Opening> openings;
+    int hash;
+    TimeOptions timeOptions;
+    EvalOptions evalOptions;
+
+    Lock lock;
+    ofstream out;
+    int nextGame, games;
+    int64_t positions;
+  };
+
+  DataState DS;
+
+  const char* ResultStrings[] = { "1-0", "0-1", "1/2-1/2" };
+
+
+  // data_worker() is run by every thread playing the games. The engine plays
+  // both colors, in one context, and the quiet positions after the opening
+  // are labeled with the result of the game.
+
+  void data_worker(int, int threadID) {
+
+    TranspositionTable tt;
+    SearchContext* ctx;
+    vector<Move> moves;
+
+    tt.set_size(DS.hash);
+    ctx = create_search_context(&tt);
+    set_engine_options(ctx, DS.timeOptions, DS.evalOptions);
+
+    while (true)
+    {
+        lock_grab(&DS.lock);
+        int game = (DS.nextGame < DS.games ? DS.nextGame++ : -1);
+        lock_release(&DS.lock);
+
+        if (game < 0)
+            break;
+
+        const Opening& o = DS.openings[game % DS.openings.size()];
+
+        tt.clear();
+        moves.clear();
+
+        ResultPGN result = play_game(DS.gs, o, ctx, ctx, threadID, moves);
+
+        // Replay the game, keeping the positions where the side to move is
+        // not in check and the move played is not a capture, whose score the
+        // static evaluation cannot see.
+        Position pos(o.fen, false, threadID);
+        ostringstream s;
+        int count = 0;
+
+        for (size_t i = 0; i < moves.size(); i++)
+        {
+            if (   i >= o.moves.size()
+                && !pos.in_check()
+                && !pos.move_is_capture_or_promotion(moves[i]))
+            {
+                s << pos.to_fen() << " c9 \"" << ResultStrings[result] << "\";\n";
+                count++;
+            }
+
+            pos.do_setup_move(moves[i]);
+        }
+
+        lock_grab(&DS.lock);
+        DS.out << s.str();
+        DS.positions += count;
+        lock_release(&DS.lock);
+    }
+
+    set_search_context(NULL);
+    delete_search_context(ctx);
+  }
+
+} // namespace
+
+
+/// datagen() plays self-play games and writes their quiet positions, labeled
+/// with the result, in the EPD format read by the texel command, as example:
+///
+///   datagen games 10000 concurrency 8 nodes 5000 output data.epd
+///
+/// Arguments, all optional, are: "games" (100), "concurrency" (1), the game
+/// settings read by GameSettings::read() with the limit of each move
+/// defaulting to "nodes 5000", "hash" in MB for each thread (16), "openings"
+/// file in FEN, EPD or PGN format, "openplies" taken from the PGN games or
+/// played at random when there is no openings file (8), "seed" of the random
+/// openings (0), and "output" file (data.epd), which is appended to.
+
+void datagen(istream& is) {
+
+  string token, openingsFile, outputFile = "data.epd";
+  int threads = 1, openPlies = 8, seed = 0;
+
+  DS.gs = GameSettings();
+  DS.openings.clear();
+  DS.games = 100;
+  DS.hash = 16;
+
+  while (is >> token)
+  {
+      if (DS.gs.read(token, is))
+          continue;
+
+      if (token == "games")
+          is >> DS.games;
+      else if (token == "concurrency")
+          is >> threads;
+      else if (token == "hash")
+          is >> DS.hash;
+      else if (token == "openings")
+          is >> openingsFile;
+      else if (token == "openplies")
+          is >> openPlies;
+      else if (token == "seed")
+          is >> seed;
+      else if (token == "output")
+          is >> outputFile;
+      else
+      {
+          cout << "Unknown datagen argument: " << token << endl;
+          return;
+      }
+  }
+
+  if (!DS.gs.tcBase && !DS.gs.limits.maxNodes && !DS.gs.limits.maxDepth && !DS.gs.limits.maxTime)
+      DS.gs.limits.maxNodes = 5000;
+
+  DS.games = Max(1, DS.games);
+  threads = Max(1, Min(threads, Min(MAX_THREADS - 1, DS.games)));
+
+  if (!openingsFile.empty())
+  {
+      if (!read_openings(openingsFile, openPlies, DS.openings))
+      {
+          cout << "No openings read from " << openingsFile << endl;
+          return;
+      }
+  }
+  else
+      random_openings(DS.games, openPlies, DS.openings, seed);
+
+  DS.out.open(outputFile.c_str(), ios::out | ios::app);
+
+  if (!DS.out.is_open())
+  {
+      cout << "Cannot open output file " << outputFile << endl;
+      return;
+  }
+
+  cout << "Datagen: " << DS.games << " games, " << threads << " threads, "
+       << DS.openings.size() << " openings" << endl;
+
+  // The options of the time manager and the evaluation are read once
+  DS.timeOptions.read_uci_options();
+  DS.evalOptions.read_uci_options();
+
+  DS.nextGame = 0;
+  DS.positions = 0;
+  lock_init(&DS.lock);
+
+  int64_t time = get_system_time();
+
+  Threads.run_workers(data_worker, threads);
+
+  lock_destroy(&DS.lock);
+  DS.out.close();
+
+  int64_t elapsed = Max(get_system_time() - time, int64_t(1));
+
+  cout << "Wrote " << DS.positions << " positions of " << DS.games << " games to "
+       << outputFile << " in " << elapsed / 1000.0 << " s, " << fixed << setprecision(1)
+       << DS.games * 1000.0 / elapsed << " games/s" << endl;
+}
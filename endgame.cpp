@@ -19,6 +19,7 @@
 
 #include <cassert>
 
+#include "bitbase.h"
 #include "bitcount.h"
 #include "endgame.h"
 #include "pawns.h"
@@ -27,7 +28,6 @@
 
 using std::string;
 
-extern uint32_t probe_kpk_bitbase(Square wksq, Square wpsq, Square bksq, Color stm);
 
 namespace {
 
@@ -73,26 +73,27 @@ namespace {
   }
 
   // Get the material key of a position out of the given endgame key code
-  // like "KBPKN". The trick here is to first build up a FEN string and then
-  // let a Position object to do the work for us. Note that the FEN string
-  // could correspond to an illegal position.
+  // like "KBPKN", as Position::compute_material_key() does. No Position is
+  // built: the tables are set up while other threads may search.
   Key mat_key(const string& keyCode) {
 
     assert(keyCode.length() > 0 && keyCode.length() < 8);
     assert(keyCode[0] == 'K');
 
-    string fen;
-    size_t i = 0;
+    int count[2][8] = { { 0 } };
+    Color c = WHITE;
+    Key key = 0;
 
-    // First add white and then black pieces
-    do fen += keyCode[i];                while (keyCode[++i] != 'K');
-    do fen += char(tolower(keyCode[i])); while (++i < keyCode.length());
+    for (size_t i = 1; i < keyCode.length(); i++)
+    {
+        PieceType pt = PieceType(string(" PNBRQK").find(keyCode[i]));
 
-    // Add file padding and remaining empty ranks
-    fen += string(1, '0' + int(8 - keyCode.length())) + "/8/8/8/8/8/8/8 w - -";
-
-    // Build a Position out of the fen string and get its material key
-    return Position(fen, false, 0).get_material_key();
+        if (pt == KING)
+            c = BLACK;
+        else
+            key ^= Position::material_zobrist(c, pt, count[c][pt]++);
+    }
+    return key;
   }
 
   typedef EndgameBase<Value> EF;
@@ -388,6 +389,33 @@ Value Endgame<Value, PAWNITIZATION_ATOMIC>::apply(const Position& pos) const {
 	return VALUE_DRAW;
 }
 
+/// Perfect knowledge from the bitbases. Won positions are scored above
+/// VALUE_KNOWN_WIN with a bonus that drives the lone king to the edge and
+/// the pawns to promotion, the search has to find the way to the win.
+template<>
+Value Endgame<Value, BITBASE_ATOMIC>::apply(const Position& pos) const {
+
+  BitbaseResult r = probe_bitbase(pos);
+
+  if (r == BB_NONE)
+      return VALUE_NONE;
+
+  if (r == BB_DRAW)
+      return VALUE_DRAW;
+
+  Color winner = (r == BB_WIN ? pos.side_to_move() : opposite_color(pos.side_to_move()));
+  Bitboard b = pos.pieces(PAWN, winner);
+
+  Value result =  VALUE_KNOWN_WIN
+                + pos.non_pawn_material(winner)
+                + MateTable[pos.king_square(opposite_color(winner))];
+
+  while (b)
+      result += Value(16 * int(relative_rank(winner, pop_1st_bit(&b))));
+
+  return r == BB_WIN ? result : -result;
+}
+
 //
 // Scaling functions
 // 
@@ -407,10 +435,10 @@ Value Endgame<Value, KXK>::apply(const Position& pos) const {
   assert(pos.non_pawn_material(weakerSide) == VALUE_ZERO);
   assert(pos.piece_count(weakerSide, PAWN) == VALUE_ZERO);
 
-  STARTOLD
   Square winnerKSq = pos.king_square(strongerSide);
   Square loserKSq = pos.king_square(weakerSide);
-  
+
+  STARTOLD
   Value result =   pos.non_pawn_material(strongerSide)
                  + pos.piece_count(strongerSide, PAWN) * PawnValueEndgame
                  + MateTable[loserKSq]
@@ -423,16 +451,21 @@ Value Endgame<Value, KXK>::apply(const Position& pos) const {
       result += VALUE_KNOWN_WIN;
   ENDOLD
 
-  if (    pos.piece_count(strongerSide, QUEEN) 
-	  && (   pos.piece_count(strongerSide, ROOK)
-		  || pos.piece_count(strongerSide, BISHOP)
-		  || pos.piece_count(strongerSide, KNIGHT)
-	)) {
-	  return strongerSide == pos.side_to_move() ? VALUE_KNOWN_WIN : -VALUE_KNOWN_WIN;
-  }
-  
-  if (pos.piece_count(strongerSide, PAWN) > 1) {
-	  return strongerSide == pos.side_to_move() ? VALUE_KNOWN_WIN : -VALUE_KNOWN_WIN;
+  if (   (    pos.piece_count(strongerSide, QUEEN)
+	      && (   pos.piece_count(strongerSide, ROOK)
+		      || pos.piece_count(strongerSide, BISHOP)
+		      || pos.piece_count(strongerSide, KNIGHT)))
+      || pos.piece_count(strongerSide, PAWN) > 1)
+  {
+      // A known win, the lone king is driven to the edge and ours brought
+      // closer, but not next to it: kings that touch can not be checked.
+      Value result =  VALUE_KNOWN_WIN
+                    + pos.non_pawn_material(strongerSide)
+                    + pos.piece_count(strongerSide, PAWN) * PawnValueEndgame
+                    + MateTable[loserKSq]
+                    + DistanceBonus[square_distance(winnerKSq, loserKSq)];
+
+      return strongerSide == pos.side_to_move() ? result : -result;
   }
 
   return VALUE_NONE;
@@ -699,7 +732,7 @@ Value Endgame<Value, KBBKN>::apply(const Position& pos) const {
   result += Value(square_distance(bksq, nsq) * 32);
 
   // Bonus for restricting the knight's mobility
-  result += Value((8 - count_1s<CNT32_MAX15>(pos.attacks_from<KNIGHT>(nsq))) * 8);
+  result += Value((8 - count_1s_max15(pos.attacks_from<KNIGHT>(nsq))) * 8);
 
   return strongerSide == pos.side_to_move() ? result : -result;
 }
@@ -74,6 +74,7 @@ enum EndgameType {
   KPsKPs_ATOMIC,		// K+pawns vs K+pawns
   KXKP_ATOMIC,			// K+piece vs KP
   PAWNITIZATION_ATOMIC,	// Pawnitization
+  BITBASE_ATOMIC,		// Any material with a bitbase
   
   ENDNEW
 };
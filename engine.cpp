@@ -0,0 +1,301 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "atomicdata.h"
+#include "bitbase.h"
+#include "bitboard.h"
+#include "engine.h"
+#include "lock.h"
+#include "misc.h"
+#include "nnue.h"
+#include "position.h"
+#include "thread.h"
+#include "ucioption.h"
+
+using namespace std;
+
+namespace {
+
+  // The slow part of the startup runs in the background, see init_engine()
+  Lock InitLock;
+  bool InitDone;
+  string InitEvalFile, InitError;
+
+#if defined(_MSC_VER)
+  HANDLE InitThread;
+#else
+  pthread_t InitThread;
+#endif
+
+  // background_init() generates the bitbases and loads the network, it is
+  // run by the startup thread.
+
+  void background_init() {
+
+    init_bitbases(cpu_count());
+
+    if (!nnue::load(InitEvalFile))
+        InitError = nnue::last_error();
+  }
+
+#if defined(_MSC_VER)
+
+  DWORD WINAPI init_start_routine(LPVOID) {
+
+    background_init();
+    return 0;
+  }
+
+#else
+
+  void* init_start_routine(void*) {
+
+    background_init();
+    return NULL;
+  }
+
+#endif
+
+}
+
+
+/// init_engine() sets up the tables shared by all the engines of the
+/// process, the UCI one included. To be called once, at startup. The
+/// bitbases and the network, which take most of the time, are made ready by
+/// a thread of their own while the caller goes on, up to the first call of
+/// wait_for_engine_init(). Without a thread they are made ready here.
+
+void init_engine() {
+
+  init_cpu();
+  init_bitboards();
+  Position::init_zobrist();
+  Position::init_piece_square_tables();
+  init_search();
+  init_evaluation();
+  generate_explosionSquares();
+  generate_squaresTouch();
+  nnue::init_kernels();
+  lock_init(&InitLock);
+
+  // The thread pool is started first, the bitbases are generated by workers
+  Threads.init();
+
+  InitEvalFile = resolve_path_from_exe(Options["EvalFile"].value<string>());
+  Options["EvalFile"].set_value(InitEvalFile);
+
+#if defined(_MSC_VER)
+  InitThread = CreateThread(NULL, 0, init_start_routine, NULL, 0, NULL);
+  InitDone = (InitThread == NULL);
+#else
+  InitDone = (pthread_create(&InitThread, NULL, init_start_routine, NULL) != 0);
+#endif
+
+  if (InitDone)
+      background_init();
+
+  if (InitDone && !InitError.empty())
+      cout << "NNUE: " << InitError << endl;
+}
+
+
+/// wait_for_engine_init() returns when the startup begun by init_engine() is
+/// complete. To be called before anything but answering the UCI handshake:
+/// the searches probe the bitbases and evaluate with the network.
+
+void wait_for_engine_init() {
+
+  lock_grab(&InitLock);
+
+  if (!InitDone)
+  {
+#if defined(_MSC_VER)
+      WaitForSingleObject(InitThread, INFINITE);
+      CloseHandle(InitThread);
+#else
+      pthread_join(InitThread, NULL);
+#endif
+      InitDone = true;
+
+      if (!InitError.empty())
+          cout << "NNUE: " << InitError << endl;
+  }
+
+  lock_release(&InitLock);
+}
+
+
+/// EngineConfig::EngineConfig() sets the defaults of the UCI options
+
+EngineConfig::EngineConfig() : hash(16), skillLevel(20) {
+
+  for (int i = 0; i < SEARCH_PARAM_NB; i++)
+      params[i] = SearchParams[i].defaultValue;
+}
+
+
+/// EngineConfig::set_option() sets one of the options "Hash", "Skill Level",
+/// a search parameter or an option of the time manager or the evaluation, as
+/// the UCI option of the same name. Returns false if there is no such option.
+
+bool EngineConfig::set_option(const string& name, const string& value) {
+
+  if (name == "Hash")
+      hash = atoi(value.c_str());
+  else if (name == "Skill Level")
+      skillLevel = atoi(value.c_str());
+  else if (time.set_option(name, value) || eval.set_option(name, value))
+      return true;
+  else
+  {
+      for (int i = 0; i < SEARCH_PARAM_NB; i++)
+          if (name == SearchParams[i].name)
+          {
+              params[i] = atof(value.c_str());
+              return true;
+          }
+
+      return false;
+  }
+  return true;
+}
+
+
+/// Engine::Engine() takes a free thread slot, the transposition table is
+/// allocated by the first search. Without a slot the engine is not is_ok().
+
+Engine::Engine() : configChanged(true), ownBook(false), bestBookMove(false) {
+
+  slot = Threads.acquire_slot();
+  ctx = create_search_context(&tt);
+}
+
+
+Engine::~Engine() {
+
+  delete_search_context(ctx);
+
+  if (slot != -1)
+      Threads.release_slot(slot);
+}
+
+
+/// Engine::set_option() sets an option as the UCI option of the same name:
+/// the ones of EngineConfig, "OwnBook", "Book File" and "Best Book Move".
+/// Returns false if there is no such option. Not to be called while the
+/// engine is searching.
+
+bool Engine::set_option(const string& name, const string& value) {
+
+  if (name == "OwnBook")
+      ownBook = (value == "true");
+  else if (name == "Book File")
+      bookFile = value;
+  else if (name == "Best Book Move")
+      bestBookMove = (value == "true");
+  else if (config.set_option(name, value))
+      configChanged = true;
+  else
+      return false;
+
+  return true;
+}
+
+
+/// Engine::new_game() forgets what was learned in the previous searches
+
+void Engine::new_game() {
+
+  tt.clear();
+}
+
+
+/// Engine::search() searches the position given by a FEN string and the
+/// moves played from there, in coordinate notation separated by spaces, and
+/// returns the best move and its score. The callback is called, on the
+/// calling thread, at the end of each iteration. Moves are first looked up
+/// in the book when "OwnBook" is set. Returns MOVE_NONE if the engine is
+/// not is_ok().
+
+Move Engine::search(const string& fen, const string& moves, const SearchLimits& limits,
+                    SearchCallback callback, void* data, Value* score) {
+
+  if (slot == -1)
+      return MOVE_NONE;
+
+  wait_for_engine_init();
+
+  Position pos(fen, false, slot);
+  istringstream ss(moves);
+  string token;
+
+  while (ss >> token)
+  {
+      Move m = move_from_uci(pos, token);
+      if (m == MOVE_NONE)
+          break;
+
+      pos.do_setup_move(m);
+  }
+
+  if (ownBook && !bookFile.empty())
+  {
+      if (book.name() != bookFile)
+          book.open(bookFile);
+
+      Move bookMove = book.get_move(pos, bestBookMove);
+      if (bookMove != MOVE_NONE)
+      {
+          if (score)
+              *score = VALUE_ZERO;
+
+          return bookMove;
+      }
+  }
+
+  if (configChanged)
+  {
+      tt.set_size(config.hash);
+      set_search_options(ctx, config.skillLevel, config.params);
+      set_engine_options(ctx, config.time, config.eval);
+      configChanged = false;
+  }
+
+  set_search_callback(ctx, callback, data);
+
+  SearchContext* previous = set_search_context(ctx);
+  Move bestMove = search_move(pos, limits, score);
+  set_search_context(previous);
+
+  return bestMove;
+}
+
+
+/// Engine::stop() makes the running search return as soon as possible. It
+/// can be called from any thread.
+
+void Engine::stop() {
+
+  stop_search(ctx);
+}
@@ -0,0 +1,88 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(ENGINE_H_INCLUDED)
+#define ENGINE_H_INCLUDED
+
+#include <string>
+
+#include "book.h"
+#include "evaluate.h"
+#include "move.h"
+#include "search.h"
+#include "timeman.h"
+#include "tt.h"
+
+/// EngineConfig keeps the settings of an engine searching in its own
+/// context: its hash size, skill level, search parameters and the options
+/// of its time manager and evaluation.
+
+struct EngineConfig {
+
+  EngineConfig();
+  bool set_option(const std::string& name, const std::string& value);
+
+  int hash;
+  int skillLevel;
+  double params[SEARCH_PARAM_NB];
+  TimeOptions time;
+  EvalOptions eval;
+};
+
+
+/// Engine is an instance of the engine which can be embedded in a process
+/// next to other ones, as by linking libatomkraft.a. It owns its
+/// transposition table, search context, settings and book, and searches on
+/// the thread calling search(), using a thread slot of its own for the pawn
+/// and material tables, see ThreadsManager::acquire_slot(). Slots are added
+/// as engines are created, up to MAX_SLOTS; an engine which could not get
+/// one is not is_ok() and its searches return MOVE_NONE. The attack tables,
+/// the bitbases and the network weights are shared by all of them, and set
+/// up once by init_engine().
+
+class Engine {
+public:
+  Engine();
+  ~Engine();
+
+  bool is_ok() const { return slot != -1; }
+  bool set_option(const std::string& name, const std::string& value);
+  void new_game();
+  Move search(const std::string& fen, const std::string& moves, const SearchLimits& limits,
+              SearchCallback callback = NULL, void* data = NULL, Value* score = NULL);
+  void stop();
+
+private:
+  Engine(const Engine&);
+  Engine& operator=(const Engine&);
+
+  EngineConfig config;
+  bool configChanged;
+  bool ownBook, bestBookMove;
+  std::string bookFile;
+  Book book;
+  TranspositionTable tt;
+  SearchContext* ctx;
+  int slot;
+};
+
+extern void init_engine();
+extern void wait_for_engine_init();
+
+#endif // !defined(ENGINE_H_INCLUDED)
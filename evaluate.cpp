@@ -36,21 +36,6 @@
 NEW int matDifFactor = 200;
 
 namespace {
-  inline bool has_explosion_threat(const Position& pos, Color attacker, Color victim) {
-    if (pos.piece_count(attacker, KING) == 0 || pos.piece_count(victim, KING) == 0)
-      return false;
-
-    Bitboard targets = pos.attacks_from<KING>(pos.king_square(victim)) & pos.pieces_of_color(victim);
-    while (targets) {
-      const Square sq = pop_1st_bit(&targets);
-      Bitboard attackers = pos.attackers_to(sq) & pos.pieces_of_color(attacker);
-      attackers &= ~pos.pieces(KING, attacker); // kings can't capture in atomic
-      if (attackers)
-        return true;
-    }
-
-    return false;
-  }
 
   // Struct EvalInfo contains various information computed and collected
   // by the evaluation functions.
@@ -100,6 +85,9 @@ namespace {
     
     int file_is_half_open_mp(Color c, File f) const;
     ENDNEW
+
+    // Weighted terms collected for the tuner, NULL when not tuning
+    EvalTerms* terms;
   };
   
   STARTNEW
@@ -111,9 +99,25 @@ namespace {
   // Evaluation grain size, must be a power of 2
   const int GrainSize = 8;
 
-  // Evaluation weights, initialized from UCI options
+  // Lazy evaluation margin. The incrementally updated material and PSQT score
+  // is trusted, and the network skipped, only when it lies this far above
+  // beta. On the bench positions the network agrees in sign and
+  // by at least half the size with 96% of the PSQT scores above 1200, and with
+  // 89% of those above 800.
+  const Value LazyMargin = Value(1000);
+
+  // Evaluation weights, initialized from UCI options. The ones of the UCI
+  // search, also used by the threads outside of a search context, and the
+  // ones of the calling thread.
   enum { Mobility, PassedPawns, Space, KingDangerUs, KingDangerThem };
-  Score Weights[6];
+  EvalWeights UCIWeights;
+  THREAD_LOCAL const EvalWeights* Weights = &UCIWeights;
+
+  // Names of the UCI options of the weights, by EvalOption
+  const char* const EvalOptionNames[] = {
+    "Mobility (Middle Game)", "Mobility (Endgame)", "Passed Pawns (Middle Game)",
+    "Passed Pawns (Endgame)", "Space", "Cowardice", "Aggressiveness"
+  };
 
   typedef Value V;
   #define S(mg, eg) make_score(mg, eg)
@@ -276,9 +280,10 @@ namespace {
     15, 15, 15, 15, 15, 15, 15, 15
   };
 
-  // KingDangerTable[Color][attackUnits] contains the actual king danger
-  // weighted scores, indexed by color and by a calculated integer number.
-  Score KingDangerTable[2][128];
+  // EvalWeights::kingDangerTable[Color][attackUnits] contains the actual king danger
+  // weighted scores, indexed by color and by a calculated integer number,
+  // SafetyTable[attackUnits] the same scores before the weights.
+  Value SafetyTable[100];
 
   // TracedTerms[Color][PieceType || TracedType] contains a breakdown of the
   // evaluation terms, used when tracing.
@@ -292,7 +297,7 @@ namespace {
 
   // Function prototypes
   template<bool HasPopCnt, bool Trace>
-  Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat);
+  Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat, EvalTerms* terms = NULL);
 
   template<Color Us, bool HasPopCnt>
   void init_eval_info(const Position& pos, EvalInfo& ei);
@@ -317,10 +322,10 @@ namespace {
 
   inline Score apply_weight(Score v, Score weight);
   Value scale_by_game_phase(const Score& v, Phase ph, ScaleFactor sf);
-  Score weight_option(const std::string& mgOpt, const std::string& egOpt, Score internalWeight);
-  void init_safety();
+  Score weight_option(int mg, int eg, Score internalWeight);
   double to_cp(Value v);
   void trace_add(int idx, Score term_w, Score term_b = SCORE_ZERO);
+  void terms_add(EvalTerms* terms, EvalWeight w, Color c, Score term, Score internalWeight, Score weighted);
 }
 
 
@@ -329,41 +334,83 @@ namespace {
 /// between them based on the remaining material.
 NEW // the argument bool* expl_threat is set to true if the side to move has to react
 NEW // on an explosion threat by the enemey else it is set to false
-Value evaluate(const Position& pos, Value& margin, bool* expl_threat) {
+NEW // when lazy is given and the material and PSQT score is far above beta
+NEW // that score is returned instead of the network one, and *lazy is set.
+NEW // It is only good for a fail high, not to be stored or reused.
+Value evaluate(const Position& pos, Value& margin, bool* expl_threat, Value beta, bool* lazy) {
   const Color us = pos.side_to_move();
   const Color them = opposite_color(us);
 
+  margin = VALUE_ZERO;
+
   if (expl_threat)
     *expl_threat = false;
 
+  if (lazy)
+    *lazy = false;
+
   if (pos.piece_count(us, KING) == 0)
     return VALUE_MATED_IN_PLY_MAX;
 
-  if (has_explosion_threat(pos, us, them))
+  if (pos.explosion_threats(us))
     return VALUE_KNOWN_WIN;
 
+  Bitboard theirThreats = pos.explosion_threats(them);
+
   if (expl_threat)
-    *expl_threat = has_explosion_threat(pos, them, us);
+    *expl_threat = theirThreats != EmptyBoardBB;
+
+  // Known atomic endgames are scored by their specialized evaluator, found
+  // with a cheap material hash probe, without touching the accumulators.
+  // Some of them return VALUE_NONE when the outcome is unclear, in that
+  // case we fall back on the network.
+  MaterialInfo* mi = Threads[pos.thread()].materialTable.get_material_info(pos);
+
+  if (mi->specialized_eval_exists())
+  {
+      Value v = mi->evaluate(pos);
+      if (v != VALUE_NONE)
+          return v;
+  }
 
   margin = Value(128);
+
+  // Lazy evaluation, lopsided positions right after an explosion do not need
+  // the network to fail high. Not trusted under explosion threats, as the
+  // material is about to change.
+  if (lazy && !theirThreats)
+  {
+      Value v = scale_by_game_phase(pos.value(), mi->game_phase(), SCALE_FACTOR_NORMAL);
+
+      if (us == BLACK)
+          v = -v;
+
+      if (v > beta + LazyMargin)
+      {
+          *lazy = true;
+          return v;
+      }
+  }
+
   return Value(nnue::evaluate(pos.nnue_accumulators(), us));
 }
 
 namespace {
 
 template<bool HasPopCnt, bool Trace>
-Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat) {
+Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat, EvalTerms* terms) {
 
   NEW *expl_threat = false;
   
   
   
   EvalInfo ei;
+  ei.terms = terms;
   Value margins[2];
   Score score, mobilityWhite, mobilityBlack;
 
   assert(pos.is_ok());
-  assert(pos.thread() >= 0 && pos.thread() < MAX_THREADS);
+  assert(pos.thread() >= 0 && pos.thread() < MAX_SLOTS);
   assert(!pos.in_check());
 
   // Initialize score by reading the incrementally updated scores included
@@ -457,7 +504,11 @@ Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat) {
   *expl_threat = (expl_threat_squares != 0ULL);
   ENDNEW
 
-  score += apply_weight(mobilityWhite - mobilityBlack, Weights[Mobility]);
+  score += apply_weight(mobilityWhite - mobilityBlack, Weights->weights[Mobility]);
+
+  if (terms)
+      terms_add(terms, MOBILITY_WEIGHT, WHITE, mobilityWhite - mobilityBlack, WeightsInternal[Mobility],
+                apply_weight(mobilityWhite - mobilityBlack, Weights->weights[Mobility]));
 
   // Evaluate kings after all other pieces because we need complete attack
   // information when computing the king safety evaluation.
@@ -480,7 +531,11 @@ Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat) {
   if (ei.mi->space_weight())
   {
       int s = evaluate_space<WHITE, HasPopCnt>(pos, ei) - evaluate_space<BLACK, HasPopCnt>(pos, ei);
-      score += apply_weight(make_score(s * ei.mi->space_weight(), 0), Weights[Space]);
+      score += apply_weight(make_score(s * ei.mi->space_weight(), 0), Weights->weights[Space]);
+
+      if (terms)
+          terms_add(terms, SPACE_WEIGHT, WHITE, make_score(s * ei.mi->space_weight(), 0), WeightsInternal[Space],
+                    apply_weight(make_score(s * ei.mi->space_weight(), 0), Weights->weights[Space]));
   }
 
   // Scale winning side if position is more drawish that what it appears
@@ -554,6 +609,13 @@ Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat) {
   // Interpolate between the middle game and the endgame score
   margin = margins[pos.side_to_move()];
   Value v = scale_by_game_phase(score, ei.mi->game_phase(), sf);
+
+  if (terms)
+  {
+      terms->score = score;
+      terms->phase = ei.mi->game_phase();
+      terms->scaleFactor = sf;
+  }
   
 
   
@@ -568,13 +630,13 @@ Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat) {
       trace_add(PST, pos.value());
       trace_add(IMBALANCE, ei.mi->material_value());
       trace_add(PAWN, ei.pi->pawns_value());
-      trace_add(MOBILITY, apply_weight(mobilityWhite, Weights[Mobility]), apply_weight(mobilityBlack, Weights[Mobility]));
+      trace_add(MOBILITY, apply_weight(mobilityWhite, Weights->weights[Mobility]), apply_weight(mobilityBlack, Weights->weights[Mobility]));
       trace_add(THREAT, evaluate_threats<WHITE>(pos, ei), evaluate_threats<BLACK>(pos, ei));
       trace_add(PASSED, evaluate_passed_pawns<WHITE>(pos, ei), evaluate_passed_pawns<BLACK>(pos, ei));
       trace_add(UNSTOPPABLE, evaluate_unstoppable_pawns<false>(pos, ei));
       Score w = make_score(ei.mi->space_weight() * evaluate_space<WHITE, false>(pos, ei), 0);
       Score b = make_score(ei.mi->space_weight() * evaluate_space<BLACK, false>(pos, ei), 0);
-      trace_add(SPACE, apply_weight(w, Weights[Space]), apply_weight(b, Weights[Space]));
+      trace_add(SPACE, apply_weight(w, Weights->weights[Space]), apply_weight(b, Weights->weights[Space]));
       trace_add(TOTAL, score);
       TraceStream << "\nUncertainty margin: White: " << to_cp(margins[WHITE])
                   << ", Black: " << to_cp(margins[BLACK])
@@ -591,27 +653,119 @@ Value do_evaluate(const Position& pos, Value& margin, bool* expl_threat) {
 } // namespace
 
 
-/// read_weights() reads evaluation weights from the corresponding UCI parameters
+/// init_evaluation() computes the king safety table before the weights and
+/// sets the weights of the UCI search to the defaults. To be called once at
+/// startup.
 
-void read_evaluation_uci_options(Color us) {
+void init_evaluation() {
+
+  const Value MaxSlope = Value(30);
+  const Value Peak = Value(1280);
+
+  for (int i = 0; i < 100; i++)
+  {
+      SafetyTable[i] = Value(int(0.4 * i * i));
+
+      if (i > 0)
+          SafetyTable[i] = Min(SafetyTable[i], SafetyTable[i - 1] + MaxSlope);
+
+      SafetyTable[i] = Min(SafetyTable[i], Peak);
+  }
+
+  set_evaluation_weights(UCIWeights, EvalOptions(), WHITE);
+}
+
+
+/// EvalOptions::EvalOptions() sets the defaults of the UCI options
+
+EvalOptions::EvalOptions() : analyseMode(false) {
+
+  for (int i = 0; i < EVAL_OPTION_NB; i++)
+      weights[i] = 100;
+}
+
+
+/// EvalOptions::set_option() sets one of the options as the UCI option of
+/// the same name. Returns false if there is no such option.
+
+bool EvalOptions::set_option(const std::string& name, const std::string& value) {
+
+  if (name == "UCI_AnalyseMode")
+  {
+      analyseMode = (value == "true");
+      return true;
+  }
+
+  for (int i = 0; i < EVAL_OPTION_NB; i++)
+      if (name == EvalOptionNames[i])
+      {
+          weights[i] = atoi(value.c_str());
+          return true;
+      }
+
+  return false;
+}
+
+
+/// EvalOptions::read_uci_options() copies the values of the UCI options
+
+void EvalOptions::read_uci_options() {
+
+  for (int i = 0; i < EVAL_OPTION_NB; i++)
+      weights[i] = Options[EvalOptionNames[i]].value<int>();
+
+  analyseMode = Options["UCI_AnalyseMode"].value<bool>();
+}
+
+
+/// set_evaluation_weights() computes the weights of the evaluation from the
+/// options, for the given side to move.
+
+void set_evaluation_weights(EvalWeights& ew, const EvalOptions& options, Color us) {
+
+  const int* w = options.weights;
 
   // King safety is asymmetrical. Our king danger level is weighted by
   // "Cowardice" UCI parameter, instead the opponent one by "Aggressiveness".
   const int kingDangerUs   = (us == WHITE ? KingDangerUs   : KingDangerThem);
   const int kingDangerThem = (us == WHITE ? KingDangerThem : KingDangerUs);
 
-  Weights[Mobility]       = weight_option("Mobility (Middle Game)", "Mobility (Endgame)", WeightsInternal[Mobility]);
-  Weights[PassedPawns]    = weight_option("Passed Pawns (Middle Game)", "Passed Pawns (Endgame)", WeightsInternal[PassedPawns]);
-  Weights[Space]          = weight_option("Space", "Space", WeightsInternal[Space]);
-  Weights[kingDangerUs]   = weight_option("Cowardice", "Cowardice", WeightsInternal[KingDangerUs]);
-  Weights[kingDangerThem] = weight_option("Aggressiveness", "Aggressiveness", WeightsInternal[KingDangerThem]);
+  ew.weights[Mobility]       = weight_option(w[MOBILITY_MG_OPTION], w[MOBILITY_EG_OPTION], WeightsInternal[Mobility]);
+  ew.weights[PassedPawns]    = weight_option(w[PASSED_PAWNS_MG_OPTION], w[PASSED_PAWNS_EG_OPTION], WeightsInternal[PassedPawns]);
+  ew.weights[Space]          = weight_option(w[SPACE_OPTION], w[SPACE_OPTION], WeightsInternal[Space]);
+  ew.weights[kingDangerUs]   = weight_option(w[COWARDICE_OPTION], w[COWARDICE_OPTION], WeightsInternal[KingDangerUs]);
+  ew.weights[kingDangerThem] = weight_option(w[AGGRESSIVENESS_OPTION], w[AGGRESSIVENESS_OPTION], WeightsInternal[KingDangerThem]);
 
   // If running in analysis mode, make sure we use symmetrical king safety. We do this
-  // by replacing both Weights[kingDangerUs] and Weights[kingDangerThem] by their average.
-  if (Options["UCI_AnalyseMode"].value<bool>())
-      Weights[kingDangerUs] = Weights[kingDangerThem] = (Weights[kingDangerUs] + Weights[kingDangerThem]) / 2;
+  // by replacing both weights[kingDangerUs] and weights[kingDangerThem] by their average.
+  if (options.analyseMode)
+      ew.weights[kingDangerUs] = ew.weights[kingDangerThem] = (ew.weights[kingDangerUs] + ew.weights[kingDangerThem]) / 2;
+
+  // Then apply the weights to the king safety table
+  for (Color c = WHITE; c <= BLACK; c++)
+      for (int i = 0; i < 100; i++)
+          ew.kingDangerTable[c][i] = apply_weight(make_score(SafetyTable[i], 0), ew.weights[KingDangerUs + c]);
+}
 
-  init_safety();
+
+/// use_evaluation_weights() sets the weights used by the evaluations of the
+/// calling thread, NULL for the ones of the UCI search.
+
+void use_evaluation_weights(const EvalWeights* ew) {
+
+  Weights = ew ? ew : &UCIWeights;
+}
+
+
+/// read_evaluation_uci_options() sets the weights of the UCI search from the
+/// UCI options, for the given side to move.
+
+void read_evaluation_uci_options(Color us) {
+
+  EvalOptions options;
+
+  options.read_uci_options();
+  set_evaluation_weights(UCIWeights, options, us);
 }
 
 
@@ -1329,8 +1483,12 @@ namespace {
         // value that will be used for pruning because this value can sometimes
         // be very big, and so capturing a single attacking piece can therefore
         // result in a score change far bigger than the value of the captured piece.
-        score -= KingDangerTable[Us][attackUnits];
-        margins[Us] += mg_value(KingDangerTable[Us][attackUnits]);
+        score -= Weights->kingDangerTable[Us][attackUnits];
+        margins[Us] += mg_value(Weights->kingDangerTable[Us][attackUnits]);
+
+        if (ei.terms)
+            terms_add(ei.terms, KING_DANGER_WEIGHT, Us, -make_score(SafetyTable[attackUnits], 0),
+                      WeightsInternal[KingDangerUs + Us], -Weights->kingDangerTable[Us][attackUnits]);
     } 
     
     STARTNEW
@@ -1546,8 +1704,12 @@ namespace {
 
     } while (b);
 
+    if (ei.terms)
+        terms_add(ei.terms, PASSED_PAWNS_WEIGHT, Us, score, WeightsInternal[PassedPawns],
+                  apply_weight(score, Weights->weights[PassedPawns]));
+
     // Add the scores to the middle game and endgame eval
-    return apply_weight(score, Weights[PassedPawns]);
+    return apply_weight(score, Weights->weights[PassedPawns]);
   }
 
 
@@ -1781,43 +1943,27 @@ namespace {
 
 
   // weight_option() computes the value of an evaluation weight, by combining
-  // two UCI-configurable weights (midgame and endgame) with an internal weight.
+  // two UCI-configurable weights (midgame and endgame) in percent with an
+  // internal weight.
 
-  Score weight_option(const std::string& mgOpt, const std::string& egOpt, Score internalWeight) {
+  Score weight_option(int mg, int eg, Score internalWeight) {
 
     // Scale option value from 100 to 256
-    int mg = Options[mgOpt].value<int>() * 256 / 100;
-    int eg = Options[egOpt].value<int>() * 256 / 100;
-
-    return apply_weight(make_score(mg, eg), internalWeight);
+    return apply_weight(make_score(mg * 256 / 100, eg * 256 / 100), internalWeight);
   }
 
 
-  // init_safety() initizes the king safety evaluation, based on UCI
-  // parameters. It is called from read_weights().
-
-  void init_safety() {
-
-    const Value MaxSlope = Value(30);
-    const Value Peak = Value(1280);
-    Value t[100];
+  // terms_add() adds a term of the given color, before and after applying
+  // the weight, to the terms collected for the tuner. Weights are the UCI
+  // option in percent times the internal weight, see weight_option().
 
-    // First setup the base table
-    for (int i = 0; i < 100; i++)
-    {
-        t[i] = Value(int(0.4 * i * i));
-
-        if (i > 0)
-            t[i] = Min(t[i], t[i - 1] + MaxSlope);
+  void terms_add(EvalTerms* terms, EvalWeight w, Color c, Score term, Score internalWeight, Score weighted) {
 
-        t[i] = Min(t[i], Peak);
-    }
+    int sign = (c == WHITE ? 1 : -1);
 
-    // Then apply the weights and get the final KingDangerTable[] array
-    for (Color c = WHITE; c <= BLACK; c++)
-        for (int i = 0; i < 100; i++)
-            KingDangerTable[c][i] = apply_weight(make_score(t[i], 0), Weights[KingDangerUs + c]);
-    
+    terms->mg[w] += sign * int(mg_value(term)) * int(mg_value(internalWeight)) / 25600.0;
+    terms->eg[w] += sign * int(eg_value(term)) * int(eg_value(internalWeight)) / 25600.0;
+    terms->weighted += sign * weighted;
   }
 
 
@@ -1874,7 +2020,10 @@ std::string trace_evaluate(const Position& pos) {
     memset(TracedScores, 0, 2 * 16 * sizeof(Score));
 
     NEW bool expl_threat;
-    do_evaluate<false, true>(pos, margin, &expl_threat);
+    if (Cpu.popcnt)
+        do_evaluate<true, true>(pos, margin, &expl_threat);
+    else
+        do_evaluate<false, true>(pos, margin, &expl_threat);
 
     totals = TraceStream.str();
     TraceStream.str("");
@@ -1903,3 +2052,32 @@ std::string trace_evaluate(const Position& pos) {
 
     return TraceStream.str();
 }
+
+
+/// evaluate_terms() evaluates the position with the handcrafted evaluation
+/// and collects its weighted terms, for the tuner. Returns false when the
+/// position is not evaluated by the terms: in check, with a specialized
+/// endgame evaluation or with a king that can be exploded at once.
+
+bool evaluate_terms(const Position& pos, EvalTerms& terms) {
+
+  Value margin;
+  bool expl_threat;
+
+  memset(&terms, 0, sizeof(EvalTerms));
+  terms.phase = -1;
+
+  if (   pos.in_check()
+      || !pos.piece_count(WHITE, KING)
+      || !pos.piece_count(BLACK, KING))
+      return false;
+
+  // The popcount is chosen once here, the terms are templated on it
+  if (Cpu.popcnt)
+      do_evaluate<true, false>(pos, margin, &expl_threat, &terms);
+  else
+      do_evaluate<false, false>(pos, margin, &expl_threat, &terms);
+
+  // The phase is set only when the evaluation reaches the interpolation
+  return terms.phase >= 0;
+}
@@ -20,14 +20,68 @@
 #if !defined(EVALUATE_H_INCLUDED)
 #define EVALUATE_H_INCLUDED
 
+#include <string>
+
 #include "types.h"
 
 extern int matDifFactor;
 
 class Position;
 
-extern Value evaluate(const Position& pos, Value& margin, bool* expl_threat);
+/// EvalTerms is filled by evaluate_terms() for the evaluation tuner. The
+/// terms scaled by the UCI evaluation weights are given by their change for
+/// each unit, 1%, of the weight, the king danger of both colors under the
+/// same weight. All scores are from white point of view.
+
+enum EvalWeight {
+  MOBILITY_WEIGHT, PASSED_PAWNS_WEIGHT, SPACE_WEIGHT, KING_DANGER_WEIGHT, EVAL_WEIGHT_NB
+};
+
+struct EvalTerms {
+  double mg[EVAL_WEIGHT_NB], eg[EVAL_WEIGHT_NB]; // Change of the score by 1% of each weight
+  Score weighted;  // Sum of the weighted terms, as evaluated with the current weights
+  Score score;     // The whole score before the interpolation
+  int phase;       // Game phase, from PHASE_ENDGAME to PHASE_MIDGAME
+  int scaleFactor; // Scale factor of the endgame score
+};
+
+/// EvalOptions are the UCI options of the evaluation: the weights of the
+/// terms in percent, and "UCI_AnalyseMode" which makes the king safety
+/// symmetrical. The defaults are the ones of the UCI options.
+
+enum EvalOption {
+  MOBILITY_MG_OPTION, MOBILITY_EG_OPTION, PASSED_PAWNS_MG_OPTION, PASSED_PAWNS_EG_OPTION,
+  SPACE_OPTION, COWARDICE_OPTION, AGGRESSIVENESS_OPTION, EVAL_OPTION_NB
+};
+
+struct EvalOptions {
+
+  EvalOptions();
+  bool set_option(const std::string& name, const std::string& value);
+  void read_uci_options();
+
+  int weights[EVAL_OPTION_NB];
+  bool analyseMode;
+};
+
+
+/// EvalWeights are the weights computed from the options for one side to
+/// move, the king safety being asymmetrical, with the king danger table.
+/// Each search context has its own, evaluate() uses the ones given to
+/// use_evaluation_weights() by the calling thread.
+
+struct EvalWeights {
+  Score weights[6];
+  Score kingDangerTable[2][128];
+};
+
+extern Value evaluate(const Position& pos, Value& margin, bool* expl_threat,
+                      Value beta = VALUE_INFINITE, bool* lazy = NULL);
 extern std::string trace_evaluate(const Position& pos);
+extern bool evaluate_terms(const Position& pos, EvalTerms& terms);
+extern void init_evaluation();
+extern void set_evaluation_weights(EvalWeights& ew, const EvalOptions& options, Color sideToMove);
+extern void use_evaluation_weights(const EvalWeights* ew);
 extern void read_evaluation_uci_options(Color sideToMove);
 
 #endif // !defined(EVALUATE_H_INCLUDED)
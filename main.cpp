@@ -5,6 +5,7 @@
 
 #include "main.h"
 
+#include "bitbase.h"
 #include "bitboard.h"
 #include "movegen.h"
 #include "debug.h"
@@ -21,6 +22,7 @@
 #include "pgn.h"
 #include "evaluate.h"
 #include "nnue.h"
+#include "engine.h"
 
 #include <pthread.h>
 #include <queue>
@@ -31,25 +33,6 @@
 // #include <conio.h>
 using namespace std;
 
-#if defined ANALYZE_VERSION
-	extern void main_analyze();
-#elif defined BOOK_VERSION
-	extern void main_book_from_thinking();
-	extern void main_book_from_file();
-#elif defined FICS_VERSION
-	extern void main_fics();
-#elif defined UCI_VERSION
-	extern void main_uci(int argc);
-#endif
-
-
-
-
-extern void init_kpk_bitbase();
-
-//#define TEST1
-#define TEST2
-
 int main(int argc, char* argv[]) {
 	srand(time(0));
 	
@@ -61,81 +44,25 @@ int main(int argc, char* argv[]) {
 	cin.rdbuf()->pubsetbuf(NULL, 0);
 	
 	// Startup initializations
-	init_bitboards();
-	Position::init_zobrist();
-	Position::init_piece_square_tables();
-	init_kpk_bitbase();
-	init_search();
-	Threads.init();
-	generate_explosionSquares();
-	generate_squaresTouch();
-
-	string eval_file = resolve_path_from_exe(Options["EvalFile"].value<string>());
-	Options["EvalFile"].set_value(eval_file);
-	if (!nnue::load(eval_file)) {
-		const string& err = nnue::last_error();
-		if (!err.empty())
-			cout << "NNUE: " << err << endl;
-	}
+	init_engine();
 	
+	// The subcommands other than "uci" keep the standard output for their
+	// results, as the JSON lines of "analyze".
+	bool uci = (argc < 2 || string(argv[1]) == "uci");
+	ostream& banner = (uci ? cout : cerr);
 	
 #ifndef NDEBUG
-	cout << "Debug version of atomkraft, define NDEBUG to get the release version." << endl;
+	banner << "Debug version of atomkraft, define NDEBUG to get the release version." << endl;
 #endif
 	
 	// Print copyright notice
-	cout << engine_name() << endl;
-	cout << "by " << engine_authors() << endl;
-	cout << "built " << __DATE__ << " " << __TIME__ << endl << endl;
-	
-	if (CpuHasPOPCNT)
-		cout << "Good! CPU has hardware POPCNT." << endl;
-	
-	
-#ifdef SWEN_VERSION
-	Options["Threads"] = UCIOption(2, 1, MAX_THREADS);
-	Options["Hash"] = UCIOption(512, 4, 8192);
-	Options["Book File"] = UCIOption("eao.bin");
-#endif
-	
-	
-	
-	
-#if defined ANALYZE_VERSION
-    
-    main_analyze();
-
-#elif defined BOOK_VERSION
-	
-	main_book_from_file();
-	//main_book_from_thinking();
-	
-#elif defined FICS_VERSION
-	
-	main_fics();
-
-
-#elif defined UCI_VERSION
-
-	main_uci(argc);
-	
-#else
-	
-	cout << "no version specified" << endl;
-	
-#endif
-	
+	banner << engine_name() << endl;
+	banner << "by " << engine_authors() << endl;
+	banner << "built " << __DATE__ << " " << __TIME__ << endl << endl;
 	
+	banner << cpu_info() << endl;
 	
+	main_uci(argc, argv);
 	
 	return 0;
 }
-
-
-
-
-
-
-
-
-
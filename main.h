@@ -11,39 +11,19 @@
 #ifndef MAIN_H_
 #define MAIN_H_
 
-// choose one version
-// it effects the functionality and the console output
-
-
-
-#define UCI_VERSION		// intended to run on a common gui like arena, uci output
-//#define FICS_VERSION		// fics client version, minimal output
-// #define TEST_VERSION		// testing and debug version, maximal output, reduced uci output
-//#define BOOK_VERSION		// automated book creation version
-//#define ANALYZE_VERSION	// position analysis tool, mainly used for manual book creation
-
-
-//#define SWEN_VERSION
+// One binary does it all, the first argument selects what:
+//
+//   atomkraft [uci]                 UCI engine reading commands from stdin
+//   atomkraft bench [args]          search benchmark, see benchmark.cpp
+//   atomkraft perft <depth> [args]  move generator check
+//   atomkraft analyze [args]        batch EPD analysis, see analyze.cpp
+//   atomkraft makebook [args]       opening book from PGN, see create_book.cpp
+//   atomkraft datagen [args]        self-play training positions, see datagen.cpp
+//
+// Any other UCI command, as "match" or "texel", can also be given on the
+// command line, it is run once and the program exits.
 
+extern void main_uci(int argc, char* argv[]);
 
 
 #endif /* MAIN_H_ */
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
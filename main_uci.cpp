@@ -7,6 +7,7 @@
 
 
 #include "main.h"
+#include "engine.h"
 #include "thread.h"
 
 #include <iostream>
@@ -17,15 +18,14 @@ using namespace std;
 extern bool execute_uci_command(const string& cmd);
 
 
-void main_uci(int argc) {
+void main_uci(int argc, char* argv[]) {
 
-	if (argc < 2)
+	if (argc < 2 || string(argv[1]) == "uci")
 	{
 		// Print copyright notice
 		//cout << engine_name() << " by " << engine_authors() << endl;
 
-		//if (CpuHasPOPCNT)
-		//	cout << "Good! CPU has hardware POPCNT." << endl;
+		//cout << cpu_info() << endl;
 
 		// Wait for a command from the user, and passes this command to
 		// execute_uci_command() and also intercepts EOF from stdin to
@@ -33,6 +33,19 @@ void main_uci(int argc) {
 		string cmd;
 		while (getline(cin, cmd) && execute_uci_command(cmd)) {}
 	}
+	else
+	{
+		// Command line arguments are run as a single command and then
+		// we exit, as example "atomkraft bench 32 1 10 depth".
+		string cmd = argv[1];
+
+		for (int i = 2; i < argc; i++)
+			cmd += string(" ") + argv[i];
+
+		execute_uci_command(cmd);
+	}
 
+	// Not to exit while the startup thread runs
+	wait_for_engine_init();
 	Threads.exit();
 }
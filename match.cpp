@@ -0,0 +1,600 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "evaluate.h"
+#include "lock.h"
+#include "match.h"
+#include "misc.h"
+#include "move.h"
+#include "movegen.h"
+#include "pgn.h"
+#include "position.h"
+#include "rkiss.h"
+#include "search.h"
+#include "thread.h"
+#include "tt.h"
+
+using namespace std;
+
+namespace {
+
+  const string StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+  // PairState is shared by the threads playing the game pairs. Pairs are
+  // handed out one at a time under the lock, and reported under it.
+  struct PairState {
+    const GameSettings* gs;
+    const vector<Opening>* openings;
+    const EngineConfig* engines;
+    PairCallback onPair;
+    int firstOpening;
+
+    Lock lock;
+    int nextPair, pairs;
+    bool stop;
+  };
+
+  // MatchState keeps the results of the match command
+  struct MatchState {
+
+    // Sequential probability ratio test of elo0 against elo1
+    bool sprt;
+    double elo0, elo1, alpha, beta;
+
+    int pentanomial[5]; // Pairs by score of the first engine: 0, 1/2, 1, 3/2, 2
+    int wins, draws, losses;
+  };
+
+  PairState PS;
+  MatchState MS;
+
+  const char* EngineNames[] = { "engine1", "engine2" };
+
+  // elo() and elo_to_score() convert between a score in [0, 1] and the Elo
+  // difference it corresponds to with the logistic model.
+
+  double elo(double score) {
+
+    score = Max(1e-6, Min(score, 1.0 - 1e-6));
+    return 400.0 * log10(score / (1.0 - score));
+  }
+
+  double elo_to_score(double e) {
+
+    return 1.0 / (1.0 + pow(10.0, -e / 400.0));
+  }
+
+  // report() prints the score of the match so far with the Elo difference and
+  // its 95% confidence interval, estimated from the distribution of the pair
+  // scores, which is not fooled by the correlation of the two games played
+  // on the same opening. When running a SPRT the log-likelihood ratio is
+  // computed with the normal approximation of the pair scores and true is
+  // returned when it crosses one of the bounds. Called under the lock.
+
+  bool report(bool final) {
+
+    int n = 0;
+    double mean = 0, var = 0;
+
+    for (int i = 0; i < 5; i++)
+        n += MS.pentanomial[i];
+
+    for (int i = 0; i < 5; i++)
+        mean += MS.pentanomial[i] * (i / 4.0) / n;
+
+    for (int i = 0; i < 5; i++)
+        var += MS.pentanomial[i] * (i / 4.0 - mean) * (i / 4.0 - mean) / n;
+
+    double margin = 1.96 * sqrt(var / n);
+    bool done = false;
+    ostringstream s;
+
+    s << fixed << setprecision(2)
+      << "Score of " << EngineNames[0] << " vs " << EngineNames[1] << ": "
+      << MS.wins << " - " << MS.losses << " - " << MS.draws
+      << " [" << mean << "] " << 2 * n
+      << "\nElo difference: " << setprecision(1) << elo(mean)
+      << " +/- " << (elo(mean + margin) - elo(mean - margin)) / 2;
+
+    if (MS.sprt)
+    {
+        double s0 = elo_to_score(MS.elo0), s1 = elo_to_score(MS.elo1);
+        double llr = var > 0 ? n * (s1 - s0) * (2 * mean - s0 - s1) / (2 * var) : 0;
+        double lower = log(MS.beta / (1 - MS.alpha));
+        double upper = log((1 - MS.beta) / MS.alpha);
+
+        s << setprecision(2) << ", LLR " << llr << " (" << lower << ", " << upper << ")"
+          << " [" << MS.elo0 << ", " << MS.elo1 << "]";
+
+        if (llr >= upper || llr <= lower)
+        {
+            s << "\nSPRT: " << (llr >= upper ? "H1" : "H0") << " accepted";
+            done = true;
+        }
+    }
+
+    cout << s.str() << endl;
+
+    if (final)
+        cout << "Pentanomial: " << MS.pentanomial[0] << " " << MS.pentanomial[1] << " "
+             << MS.pentanomial[2] << " " << MS.pentanomial[3] << " "
+             << MS.pentanomial[4] << endl;
+
+    return done;
+  }
+
+
+  // pair_worker() is run by every thread playing the game pairs. It keeps
+  // taking the next pair, the two engines play the opening once with each
+  // color, until all the pairs are played or the callback stops them.
+
+  void pair_worker(int, int threadID) {
+
+    TranspositionTable tt[2];
+    SearchContext* ctx[2];
+    vector<Move> moves;
+
+    for (int k = 0; k < 2; k++)
+        ctx[k] = create_search_context(&tt[k]);
+
+    while (true)
+    {
+        lock_grab(&PS.lock);
+        int pair = (PS.stop || PS.nextPair >= PS.pairs ? -1 : PS.nextPair++);
+        lock_release(&PS.lock);
+
+        if (pair < 0)
+            break;
+
+        const GameSettings& gs = *PS.gs;
+        const Opening& o = (*PS.openings)[(PS.firstOpening + pair) % PS.openings->size()];
+        int points[2]; // Half points of the first engine in each game
+
+        // Resizing is skipped when the hash size does not change
+        for (int k = 0; k < 2; k++)
+        {
+            const EngineConfig& e = PS.engines[2 * pair + k];
+
+            tt[k].set_size(e.hash);
+            set_search_options(ctx[k], e.skillLevel, e.params);
+            set_engine_options(ctx[k], e.time, e.eval);
+        }
+
+        for (int g = 0; g < 2; g++)
+        {
+            tt[0].clear();
+            tt[1].clear();
+            moves.clear();
+
+            // In the first game of the pair the first engine has white
+            ResultPGN result = play_game(gs, o, ctx[g], ctx[1 - g], threadID, moves);
+            points[g] = (result == DRAW ? 1 : (result == WHITE_WINS) == (g == 0) ? 2 : 0);
+
+            if (!gs.pgnFile.empty())
+            {
+                lock_grab(&PS.lock);
+                appendPGN(gs.pgnFile.c_str(), EngineNames[g], EngineNames[1 - g], result,
+                          gs.tcBase / 1000, gs.tcInc / 1000, o.fen.c_str(),
+                          moves.empty() ? NULL : &moves[0], int(moves.size()));
+                lock_release(&PS.lock);
+            }
+        }
+
+        lock_grab(&PS.lock);
+
+        if (!PS.stop && PS.onPair && PS.onPair(pair, points))
+            PS.stop = true;
+
+        lock_release(&PS.lock);
+    }
+
+    set_search_context(NULL);
+
+    for (int k = 0; k < 2; k++)
+        delete_search_context(ctx[k]);
+  }
+
+  // match_pair() is the callback of the match command, it collects the
+  // results and reports them.
+
+  bool match_pair(int, const int points[2]) {
+
+    for (int g = 0; g < 2; g++)
+    {
+        MS.wins += (points[g] == 2);
+        MS.draws += (points[g] == 1);
+        MS.losses += (points[g] == 0);
+    }
+
+    MS.pentanomial[points[0] + points[1]]++;
+
+    return report(false);
+  }
+
+} // namespace
+
+
+/// play_game() plays a game from the given opening between the engines
+/// searching in the white and black contexts, and returns the result. As
+/// in the search, the game is drawn at the first repetition. All the moves,
+/// the opening ones included, are appended to 'moves'.
+
+ResultPGN play_game(const GameSettings& gs, const Opening& o, SearchContext* white,
+                    SearchContext* black, int threadID, vector<Move>& moves) {
+
+  Position pos(o.fen, false, threadID);
+  MoveStack mlist[MAX_MOVES];
+  int clock[2] = { gs.tcBase, gs.tcBase };
+
+  for (size_t i = 0; i < o.moves.size(); i++)
+  {
+      moves.push_back(o.moves[i]);
+      pos.do_setup_move(o.moves[i]);
+  }
+
+  for (int ply = 0; true; ply++)
+  {
+      Color us = pos.side_to_move();
+      ResultPGN loss = (us == WHITE ? BLACK_WINS : WHITE_WINS);
+
+      // Our king has exploded, or we are mated or stalemated
+      if (pos.piece_count(us, KING) == 0)
+          return loss;
+
+      if (generate<MV_LEGAL>(pos, mlist) == mlist)
+          return pos.in_check() ? loss : DRAW;
+
+      if (pos.is_draw<false>() || ply >= gs.maxPlies)
+          return DRAW;
+
+      SearchLimits limits = gs.limits;
+
+      if (gs.tcBase)
+      {
+          limits.time = clock[us];
+          limits.increment = gs.tcInc;
+      }
+
+      set_search_context(us == WHITE ? white : black);
+
+      int64_t time = get_system_time();
+      Move m = search_move(pos, limits, NULL);
+
+      if (gs.tcBase)
+      {
+          clock[us] -= int(get_system_time() - time);
+
+          if (clock[us] < 0)
+              return loss; // Flag fell
+
+          clock[us] += gs.tcInc;
+      }
+
+      assert(m != MOVE_NONE);
+
+      moves.push_back(m);
+      pos.do_setup_move(m);
+  }
+}
+
+
+/// GameSettings::read() reads the argument starting with 'token' if it is one
+/// of the game settings: the limit of each move "nodes", "depth", "movetime"
+/// or a clock "tc 10+0.1" in seconds, "maxplies" after which the game is drawn
+/// and "pgn" file where the games are appended. Returns false otherwise.
+
+bool GameSettings::read(const string& token, istream& is) {
+
+  if (token == "nodes")
+      is >> limits.maxNodes;
+  else if (token == "depth")
+      is >> limits.maxDepth;
+  else if (token == "movetime")
+      is >> limits.maxTime;
+  else if (token == "tc")
+  {
+      double base = 0, inc = 0;
+      char plus;
+      string tc;
+
+      is >> tc;
+      istringstream ss(tc);
+      ss >> base >> plus >> inc;
+      tcBase = int(base * 1000);
+      tcInc = int(inc * 1000);
+  }
+  else if (token == "maxplies")
+      is >> maxPlies;
+  else if (token == "pgn")
+      is >> pgnFile;
+  else
+      return false;
+
+  return true;
+}
+
+
+/// read_openings() appends to 'openings' the start positions read from a file.
+/// A PGN file gives the first 'plies' moves of each game, any other file a FEN
+/// or EPD position on each line. Returns false if no opening was read.
+
+bool read_openings(const string& fileName, int plies, vector<Opening>& openings) {
+
+  size_t size = openings.size();
+
+  if (fileName.size() > 4 && fileName.substr(fileName.size() - 4) == ".pgn")
+  {
+      PgnReader pgn;
+      PgnGame game;
+      PgnToken fen, san;
+
+      if (!pgn.open(fileName))
+          return false;
+
+      while (pgn.next_game(game))
+      {
+          Opening o;
+          o.fen = game.tag("FEN", fen) ? fen.to_string() : StartFEN;
+
+          Position pos(o.fen, false, 0);
+          PgnMoveIterator it(game);
+
+          while (int(o.moves.size()) < plies && it.next(san))
+          {
+              Move m = move_from_san(pos, san.str, san.len);
+              if (m == MOVE_NONE)
+                  break;
+
+              o.moves.push_back(m);
+              pos.do_setup_move(m);
+          }
+          openings.push_back(o);
+      }
+      return openings.size() > size;
+  }
+
+  ifstream file(fileName.c_str());
+  string line, token;
+
+  while (getline(file, line))
+  {
+      // EPD lines have only four fields, followed by the operations
+      istringstream ss(line.substr(0, line.find(';')));
+      Opening o;
+
+      for (int i = 0; i < 6 && ss >> token; i++)
+      {
+          if (i >= 4 && token.find_first_not_of("0123456789") != string::npos)
+              break;
+
+          o.fen += (i ? " " : "") + token;
+      }
+
+      if (count(o.fen.begin(), o.fen.end(), ' ') < 3)
+          continue;
+
+      if (count(o.fen.begin(), o.fen.end(), ' ') == 3)
+          o.fen += " 0 1";
+
+      openings.push_back(o);
+  }
+  return openings.size() > size;
+}
+
+
+/// random_openings() appends 'count' openings playing 'plies' random moves
+/// from the initial position. The same seed gives the same openings.
+
+void random_openings(int count, int plies, vector<Opening>& openings, int seed) {
+
+  RKISS rk;
+  MoveStack mlist[MAX_MOVES];
+
+  for (int i = 0; i < seed; i++)
+      rk.rand<unsigned>();
+
+  for (int i = 0; i < count; i++)
+  {
+      Opening o;
+      o.fen = StartFEN;
+
+      Position pos(o.fen, false, 0);
+
+      for (int ply = 0; ply < plies && pos.piece_count(pos.side_to_move(), KING); ply++)
+      {
+          MoveStack* last = generate<MV_LEGAL>(pos, mlist);
+          if (last == mlist)
+              break;
+
+          Move m = mlist[rk.rand<unsigned>() % unsigned(last - mlist)].move;
+
+          o.moves.push_back(m);
+          pos.do_setup_move(m);
+      }
+      openings.push_back(o);
+  }
+}
+
+
+/// play_pairs() plays 'pairs' game pairs on 'threads' threads. Pair i starts
+/// from the opening firstOpening + i, repeating the openings if needed, and
+/// is played between the engines engines[2 * i] and engines[2 * i + 1]. The
+/// threads playing are 1 to 'threads', the UCI search uses thread 0 and,
+/// only while searching, the ones after it.
+
+void play_pairs(const GameSettings& gs, const vector<Opening>& openings, int firstOpening,
+                const EngineConfig* engines, int pairs, int threads, PairCallback onPair) {
+
+  assert(!openings.empty());
+
+  PS.gs = &gs;
+  PS.openings = &openings;
+  PS.engines = engines;
+  PS.onPair = onPair;
+  PS.firstOpening = firstOpening;
+  PS.nextPair = 0;
+  PS.pairs = pairs;
+  PS.stop = false;
+  lock_init(&PS.lock);
+
+  threads = Max(1, Min(threads, Min(MAX_THREADS - 1, pairs)));
+
+  Threads.run_workers(pair_worker, threads);
+
+  lock_destroy(&PS.lock);
+}
+
+
+/// match() runs a self-play match between two engines, which are this engine
+/// with different settings, as example:
+///
+///   match games 1000 concurrency 8 nodes 20000 openings book.epd
+///         engine2 name Skill Level value 15 sprt 0 10
+///
+/// Arguments, all optional, are: "games" (100), "concurrency" (1), the game
+/// settings read by GameSettings::read(), the limit of each move defaulting
+/// to "nodes 10000", "hash" in MB for each engine (16), "openings" file in
+/// FEN, EPD or PGN format, "openplies" taken from the PGN games or played at
+/// random when there is no openings file (8), "sprt elo0 elo1" with "alpha"
+/// and "beta" (0.05), and the settings of each engine "engine1" or "engine2"
+/// followed by "name <option> value <value>", as with setoption, for the
+/// options "Hash", "Skill Level" and the search parameters.
+
+void match(istream& is) {
+
+  string token, openingsFile;
+  int games = 100, concurrency = 1, openPlies = 8;
+  EngineConfig engines[2];
+  GameSettings gs;
+  vector<Opening> openings;
+
+  MS.sprt = false;
+  MS.alpha = MS.beta = 0.05;
+
+  // The engines start from the UCI options of the time manager and the
+  // evaluation, then take their own ones.
+  for (int k = 0; k < 2; k++)
+  {
+      engines[k].time.read_uci_options();
+      engines[k].eval.read_uci_options();
+  }
+
+  while (is >> token)
+  {
+      if (gs.read(token, is))
+          continue;
+
+      if (token == "games")
+          is >> games;
+      else if (token == "concurrency")
+          is >> concurrency;
+      else if (token == "hash")
+      {
+          is >> engines[0].hash;
+          engines[1].hash = engines[0].hash;
+      }
+      else if (token == "openings")
+          is >> openingsFile;
+      else if (token == "openplies")
+          is >> openPlies;
+      else if (token == "sprt")
+      {
+          MS.sprt = true;
+          is >> MS.elo0 >> MS.elo1;
+      }
+      else if (token == "alpha")
+          is >> MS.alpha;
+      else if (token == "beta")
+          is >> MS.beta;
+      else if (token == "engine1" || token == "engine2")
+      {
+          EngineConfig& e = engines[token == "engine2"];
+          string name, value;
+
+          is >> token; // Consume "name" token
+          is >> name;
+
+          while (is >> token && token != "value")
+              name += " " + token;
+
+          is >> value;
+
+          if (!e.set_option(name, value))
+              cout << "No such option: " << name << endl;
+      }
+      else
+      {
+          cout << "Unknown match argument: " << token << endl;
+          return;
+      }
+  }
+
+  if (!gs.tcBase && !gs.limits.maxNodes && !gs.limits.maxDepth && !gs.limits.maxTime)
+      gs.limits.maxNodes = 10000;
+
+  int pairs = Max(1, (games + 1) / 2);
+  concurrency = Max(1, Min(concurrency, Min(MAX_THREADS - 1, pairs)));
+
+  if (!openingsFile.empty())
+  {
+      if (!read_openings(openingsFile, openPlies, openings))
+      {
+          cout << "No openings read from " << openingsFile << endl;
+          return;
+      }
+  }
+  else
+      random_openings(pairs, openPlies, openings);
+
+  cout << "Match: " << 2 * pairs << " games, " << concurrency << " threads, "
+       << openings.size() << " openings" << endl;
+
+  MS.wins = MS.draws = MS.losses = 0;
+  memset(MS.pentanomial, 0, sizeof(MS.pentanomial));
+
+  // All the pairs are played by the same two engines
+  vector<EngineConfig> pairEngines;
+
+  for (int i = 0; i < pairs; i++)
+  {
+      pairEngines.push_back(engines[0]);
+      pairEngines.push_back(engines[1]);
+  }
+
+  int64_t time = get_system_time();
+
+  play_pairs(gs, openings, 0, &pairEngines[0], pairs, concurrency, match_pair);
+
+  cout << "\nFinished match in " << (get_system_time() - time) / 1000 << " s" << endl;
+
+  if (MS.wins + MS.draws + MS.losses)
+      report(true);
+}
@@ -0,0 +1,69 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(MATCH_H_INCLUDED)
+#define MATCH_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "move.h"
+#include "pgn.h"
+#include "search.h"
+
+/// An opening is a start position and the moves played from there before
+/// the engines take over.
+
+struct Opening {
+  std::string fen;
+  std::vector<Move> moves;
+};
+
+
+/// GameSettings are the rules of the games, the same for both engines
+
+struct GameSettings {
+
+  GameSettings() : tcBase(0), tcInc(0), maxPlies(400) {}
+  bool read(const std::string& token, std::istream& is);
+
+  SearchLimits limits; // Limits of each move, unless playing with a clock
+  int tcBase, tcInc;   // Clock in milliseconds, used when tcBase > 0
+  int maxPlies;        // Games are drawn after this number of plies
+  std::string pgnFile;
+};
+
+
+/// PairCallback is called after each game pair, one call at a time, with the
+/// index of the pair and the half points, 0 to 2, of its first engine in each
+/// of the two games. The remaining pairs are not played if it returns true.
+
+typedef bool (*PairCallback)(int pair, const int points[2]);
+
+extern bool read_openings(const std::string& fileName, int plies, std::vector<Opening>& openings);
+extern ResultPGN play_game(const GameSettings& gs, const Opening& o, SearchContext* white,
+                           SearchContext* black, int threadID, std::vector<Move>& moves);
+extern void random_openings(int count, int plies, std::vector<Opening>& openings, int seed = 0);
+extern void play_pairs(const GameSettings& gs, const std::vector<Opening>& openings, int firstOpening,
+                       const EngineConfig* engines, int pairs, int threads, PairCallback onPair);
+extern void match(std::istream& is);
+
+#endif // !defined(MATCH_H_INCLUDED)
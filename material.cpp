@@ -20,6 +20,7 @@
 #include <cassert>
 #include <cstring>
 
+#include "bitbase.h"
 #include "material.h"
 
 #include "debug.h"
@@ -54,6 +55,7 @@ namespace {
   // the function maps because correspond to more then one material hash key.
   Endgame<Value, KmmKm> EvaluateKmmKm[] = { Endgame<Value, KmmKm>(WHITE), Endgame<Value, KmmKm>(BLACK) };
   Endgame<Value, KXK>   EvaluateKXK[]   = { Endgame<Value, KXK>(WHITE),   Endgame<Value, KXK>(BLACK) };
+  Endgame<Value, BITBASE_ATOMIC> EvaluateBitbase = Endgame<Value, BITBASE_ATOMIC>(WHITE);
 
   Endgame<ScaleFactor, KBPsK>  ScaleKBPsK[]  = { Endgame<ScaleFactor, KBPsK>(WHITE),  Endgame<ScaleFactor, KBPsK>(BLACK) };
   Endgame<ScaleFactor, KQKRPs> ScaleKQKRPs[] = { Endgame<ScaleFactor, KQKRPs>(WHITE), Endgame<ScaleFactor, KQKRPs>(BLACK) };
@@ -172,6 +174,13 @@ MaterialInfo* MaterialInfoTable::get_material_info(const Position& pos) const {
   ENDNEW
   
 
+  NEW // perfect knowledge first
+  if (bitbase_exists(key))
+  {
+      mi->evaluationFunction = &EvaluateBitbase;
+      return mi;
+  }
+
   // Let's look if we have a specialized evaluation function for this
   // particular material configuration. First we look for a fixed
   // configuration one, then a generic one if previous search failed.
@@ -31,7 +31,10 @@
 
 #else
 
+#include <fcntl.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -174,43 +177,84 @@ string resolve_path_from_exe(const string& path) {
 }
 
 
-/// Debug stuff. Helper functions used mainly for debugging purposes
+/// map_file() maps a file read-only in memory and returns its contents and
+/// size, or NULL without any message if the file does not exist or is empty.
+/// The pages are read by the OS on demand and shared by the processes that
+/// map the same file.
 
-static uint64_t dbg_hit_cnt0;
-static uint64_t dbg_hit_cnt1;
-static uint64_t dbg_mean_cnt0;
-static uint64_t dbg_mean_cnt1;
+const char* map_file(const string& fileName, size_t* size) {
 
-void dbg_print_hit_rate() {
+  *size = 0;
 
-  if (dbg_hit_cnt0)
-      cout << "Total " << dbg_hit_cnt0 << " Hit " << dbg_hit_cnt1
-           << " hit rate (%) " << 100 * dbg_hit_cnt1 / dbg_hit_cnt0 << endl;
-}
+#if defined(_WIN32)
+  HANDLE fd = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 
-void dbg_print_mean() {
+  if (fd == INVALID_HANDLE_VALUE)
+      return NULL;
 
-  if (dbg_mean_cnt0)
-      cout << "Total " << dbg_mean_cnt0 << " Mean "
-           << (float)dbg_mean_cnt1 / dbg_mean_cnt0 << endl;
-}
+  DWORD sizeHigh;
+  DWORD sizeLow = GetFileSize(fd, &sizeHigh);
+  size_t bytes = size_t((uint64_t(sizeHigh) << 32) | sizeLow);
+  HANDLE mapping = bytes ? CreateFileMapping(fd, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
 
-void dbg_mean_of(int v) {
+  CloseHandle(fd);
 
-  dbg_mean_cnt0++;
-  dbg_mean_cnt1 += v;
-}
+  if (!mapping)
+      return NULL;
+
+  // The view keeps the mapping alive until it is unmapped
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+
+  if (!data)
+  {
+      cerr << "Failed to map file " << fileName << endl;
+      return NULL;
+  }
+#else
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  struct stat st;
+
+  if (fd == -1)
+      return NULL;
+
+  if (fstat(fd, &st) == -1 || st.st_size <= 0)
+  {
+      ::close(fd);
+      return NULL;
+  }
 
-void dbg_hit_on(bool b) {
+  size_t bytes = size_t(st.st_size);
+  void* data = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
 
-  dbg_hit_cnt0++;
-  if (b)
-      dbg_hit_cnt1++;
+  ::close(fd);
+
+  if (data == MAP_FAILED)
+  {
+      cerr << "Failed to map file " << fileName << endl;
+      return NULL;
+  }
+#endif
+
+  *size = bytes;
+  return (const char*)data;
 }
 
-void dbg_hit_on_c(bool c, bool b) { if (c) dbg_hit_on(b); }
-void dbg_before() { dbg_hit_on(false); }
-void dbg_after()  { dbg_hit_on(true); dbg_hit_cnt0--; }
+
+/// unmap_file() releases a file mapped by map_file()
+
+void unmap_file(const char* data, size_t size) {
+
+  if (!data)
+      return;
+
+#if defined(_WIN32)
+  UnmapViewOfFile((LPCVOID)data);
+#else
+  munmap((void*)data, size);
+#endif
+}
 
 
 /// get_system_time() returns the current system time, measured in milliseconds
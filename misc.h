@@ -26,18 +26,13 @@
 extern const std::string engine_name();
 extern const std::string engine_authors();
 extern std::string resolve_path_from_exe(const std::string& path);
+extern const char* map_file(const std::string& fileName, size_t* size);
+extern void unmap_file(const char* data, size_t size);
 extern int64_t get_system_time();
 extern int64_t get_cpu_usage();
 extern int cpu_count();
+extern std::string cpu_info();
 extern int input_available();
 extern void prefetch(char* addr);
 
-extern void dbg_hit_on(bool b);
-extern void dbg_hit_on_c(bool c, bool b);
-extern void dbg_before();
-extern void dbg_after();
-extern void dbg_mean_of(int v);
-extern void dbg_print_hit_rate();
-extern void dbg_print_mean();
-
 #endif // !defined(MISC_H_INCLUDED)
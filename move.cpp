@@ -18,6 +18,7 @@
 */
 
 #include <cassert>
+#include <cctype>
 #include <cstring>
 #include <iomanip>
 #include <string>
@@ -148,6 +149,143 @@ Move move_from_uci(const Position& pos, const string& str) {
 }
 
 
+/// move_from_san() takes a position and a move in short algebraic notation,
+/// as found in PGN files, and returns the legal move it stands for or
+/// MOVE_NONE. The candidates are read from the bitboards of the pieces of
+/// the given type that reach the destination square, without generating a
+/// move list. Check and annotation marks are ignored, castling may also be
+/// written with zeros and a pawn capture to the last rank, that explodes
+/// instead of promoting, with or without a promotion piece.
+
+Move move_from_san(const Position& pos, const char* san, int len) {
+
+  static const char PieceChars[] = " PNBRQK";
+
+  Color us = pos.side_to_move();
+  char s[8];
+  int n = 0;
+
+  // Keep only the significant characters
+  for (int i = 0; i < len; i++)
+      if (!strchr("x:+#=!?", san[i]))
+      {
+          if (n == 7)
+              return MOVE_NONE;
+
+          s[n++] = (san[i] == '0' ? 'O' : san[i]);
+      }
+
+  s[n] = 0;
+
+  if (!n || !pos.piece_count(us, KING))
+      return MOVE_NONE;
+
+  if (!strcmp(s, "O-O") || !strcmp(s, "O-O-O"))
+  {
+      bool kingSide = (n == 3);
+
+      if (!(kingSide ? pos.can_castle_kingside(us) : pos.can_castle_queenside(us)))
+          return MOVE_NONE;
+
+      Move m = make_castle_move(pos.king_square(us), kingSide ? pos.initial_kr_square(us)
+                                                              : pos.initial_qr_square(us));
+      return pos.move_is_legal(m) ? m : MOVE_NONE;
+  }
+
+  PieceType pt = PAWN, promotion = PIECE_TYPE_NONE;
+  File fromFile = FILE_NONE;
+  Rank fromRank = RANK_NONE;
+  const char* cur = s;
+  const char* end = s + n;
+
+  if (isupper((unsigned char)*cur))
+  {
+      const char* c = strchr(PieceChars + 2, *cur++);
+
+      if (!c || !*c)
+          return MOVE_NONE;
+
+      pt = PieceType(c - PieceChars);
+  }
+  else if (strchr("NBRQ", end[-1]))
+      promotion = PieceType(strchr(PieceChars, *--end) - PieceChars);
+
+  // Destination square last, optional disambiguation before it
+  if (   end - cur < 2 || end - cur > 4
+      || end[-2] < 'a' || end[-2] > 'h'
+      || end[-1] < '1' || end[-1] > '8')
+      return MOVE_NONE;
+
+  Square to = make_square(file_from_char(end[-2]), rank_from_char(end[-1]));
+
+  for ( ; cur < end - 2; cur++)
+      if (*cur >= 'a' && *cur <= 'h')
+          fromFile = file_from_char(*cur);
+      else if (*cur >= '1' && *cur <= '8')
+          fromRank = rank_from_char(*cur);
+      else
+          return MOVE_NONE;
+
+  Bitboard b;
+
+  if (pt == PAWN && relative_rank(us, to) < RANK_3)
+      return MOVE_NONE;
+
+  if (pt != PAWN)
+      b = pos.attacks_from(make_piece(us, pt), to) & pos.pieces(pt, us);
+
+  // Pawn captures always name the file they come from
+  else if (fromFile != FILE_NONE)
+      b = bit_is_set(pos.pieces(PAWN, us), make_square(fromFile, square_rank(to - pawn_push(us))));
+
+  else if (bit_is_set(pos.pieces(PAWN, us), to - pawn_push(us)))
+      b = SetMaskBB[to - pawn_push(us)];
+
+  else if (   relative_rank(us, to) == RANK_4
+           && pos.square_is_empty(to - pawn_push(us)))
+      b = bit_is_set(pos.pieces(PAWN, us), to - 2 * pawn_push(us));
+  else
+      return MOVE_NONE;
+
+  if (fromFile != FILE_NONE)
+      b &= file_bb(fromFile);
+
+  if (fromRank != RANK_NONE)
+      b &= rank_bb(fromRank);
+
+  Bitboard pinned = pos.pinned_pieces(us);
+  Move m, found = MOVE_NONE;
+
+  while (b)
+  {
+      Square from = pop_1st_bit(&b);
+
+      if (pt == PAWN && to == pos.ep_square() && fromFile != square_file(to))
+          m = make_ep_move(from, to);
+
+      else if (pt == PAWN && relative_rank(us, to) == RANK_8 && pos.square_is_empty(to))
+      {
+          if (promotion == PIECE_TYPE_NONE)
+              return MOVE_NONE;
+
+          m = make_promotion_move(from, to, promotion);
+      }
+      else
+          m = make_move(from, to);
+
+      if (pos.move_is_legal(m, pinned))
+      {
+          if (found != MOVE_NONE)
+              return MOVE_NONE; // Ambiguous
+
+          found = m;
+      }
+  }
+
+  return found;
+}
+
+
 /// move_to_san() takes a position and a move as input, where it is assumed
 /// that the move is a legal move from the position. The return value is
 /// a string containing the move in short algebraic notation.
@@ -191,6 +191,7 @@ extern const std::string move_to_uci(Move m, bool chess960);
 extern const std::string move_to_uci(const Position& pos, Move m, bool chess960);
 extern const std::string move_to_string(Move m);
 extern Move move_from_uci(const Position& pos, const std::string& str);
+extern Move move_from_san(const Position& pos, const char* san, int len);
 extern const std::string move_to_san(Position& pos, Move m);
 extern const std::string pretty_pv(Position& pos, int depth, Value score, int time, Move pv[]);
 
@@ -43,6 +43,8 @@ namespace {
   template<Color, MoveType>
   MoveStack* generate_pawn_moves(const Position&, MoveStack*, Bitboard, Square);
 
+  Bitboard king_danger_squares(const Position& pos, Color us);
+
   template<PieceType Pt>
   inline MoveStack* generate_discovered_checks(const Position& pos, MoveStack* mlist, Square from) {
 	NEW assert(pos.piece_count(WHITE, KING) && pos.piece_count(BLACK, KING));
@@ -452,12 +454,64 @@ MoveStack* generate<MV_LEGAL>(const Position& pos, MoveStack* mlist) {
 
   last = generate<MV_PSEUDO_LEGAL>(pos, mlist);
   
-  
+  STARTNEW
+  // Legality is decided with masks computed once per position, only the
+  // captures which could open a slider line to our king still need the
+  // explosion to be simulated by pl_move_is_legal().
+  Color us = pos.side_to_move();
+  Color them = opposite_color(us);
+  Square ksq = pos.king_square(us);
+
+  // Captures next to our king blow it up, captures next to their king win
+  Bitboard ourBlast = explBB[ksq];
+  Bitboard theirBlast = explBB[pos.king_square(them)];
+
+  // Without an enemy slider on a line to our king no explosion can expose it
+  Bitboard sliders =  (pos.pieces(ROOK, QUEEN, them) & RookPseudoAttacks[ksq])
+                    | (pos.pieces(BISHOP, QUEEN, them) & BishopPseudoAttacks[ksq]);
+
+  // Squares our king can not step on, computed on the first king move
+  Bitboard danger = EmptyBoardBB;
+  bool dangerDone = false;
+  ENDNEW
   
   // Remove illegal moves from the list
   while (cur != last) {
 	  //NEW assert(pos.color_of_piece_on(move_from(cur->move)) == pos.side_to_move());
-      if (!pos.pl_move_is_legal(cur->move, pinned))
+      STARTNEW
+      Move m = cur->move;
+      Square from = move_from(m);
+      Square to = move_to(m);
+      bool legal;
+
+      if (move_is_castle(m))
+          legal = true;
+
+      else if (pos.type_of_piece_on(to) || move_is_ep(m))
+          legal =   !bit_is_set(ourBlast, to)
+                 && (   bit_is_set(theirBlast, to)
+                     || !sliders
+                     || pos.pl_move_is_legal(m, pinned));
+
+      else if (from == ksq)
+      {
+          if (!dangerDone)
+          {
+              danger = king_danger_squares(pos, us);
+              dangerDone = true;
+          }
+          // Kings touching each other can not be captured
+          legal = bit_is_set(theirBlast, to) || !bit_is_set(danger, to);
+      }
+      else
+          legal =   !pinned
+                 || !bit_is_set(pinned, from)
+                 ||  squares_aligned(from, to, ksq);
+
+      assert(legal == pos.pl_move_is_legal(m, pinned));
+
+      if (!legal)
+      ENDNEW
           cur->move = (--last)->move;
       else
           cur++;
@@ -478,6 +532,35 @@ namespace {
            Delta == DELTA_NW ? p << 7 : Delta == DELTA_SW ? p >> 9 : p;
   }
 
+  // king_danger_squares() returns the squares attacked by the enemy pieces
+  // other than the king, with our king removed from the occupancy so that it
+  // can not hide from a slider by stepping along its line. Enemy king
+  // attacks are left out because in atomic kings may touch each other.
+  Bitboard king_danger_squares(const Position& pos, Color us) {
+
+    Color them = opposite_color(us);
+    Bitboard occ = pos.occupied_squares() & ~pos.pieces(KING, us);
+    Bitboard b = EmptyBoardBB;
+    const Square* s;
+
+    for (s = pos.piece_list_begin(them, PAWN); *s != SQ_NONE; s++)
+        b |= pos.attacks_from<PAWN>(*s, them);
+
+    for (s = pos.piece_list_begin(them, KNIGHT); *s != SQ_NONE; s++)
+        b |= pos.attacks_from<KNIGHT>(*s);
+
+    for (s = pos.piece_list_begin(them, BISHOP); *s != SQ_NONE; s++)
+        b |= bishop_attacks_bb(*s, occ);
+
+    for (s = pos.piece_list_begin(them, ROOK); *s != SQ_NONE; s++)
+        b |= rook_attacks_bb(*s, occ);
+
+    for (s = pos.piece_list_begin(them, QUEEN); *s != SQ_NONE; s++)
+        b |= queen_attacks_bb(*s, occ);
+
+    return b;
+  }
+
   template<MoveType Type, Square Delta>
   inline MoveStack* generate_pawn_captures(MoveStack* mlist, Bitboard pawns, Bitboard target) {
 	  	
@@ -10,6 +10,14 @@
 #include <fstream>
 #include <iostream>
 
+#if defined(USE_SIMD)
+// gcc 12 gives false 'used uninitialized' warnings inside the AVX-512 headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+
 namespace {
   nnue::Network g_network;
   bool g_loaded = false;
@@ -33,25 +41,181 @@ namespace {
     return rel_color(perspective, piece) * 384 + pt * 64 + sq;
   }
 
-  inline void add_feature(nnue::Accumulator& acc, int idx) {
-    const int16_t* src = g_network.feature_weights[idx].vals;
+  // The kernels below come in a portable version and, when USE_SIMD is
+  // defined, in AVX2 and AVX-512 versions compiled with target attributes.
+  // init_kernels() picks one set according to the CPU. All of them give
+  // exactly the same results.
+
+  // The update kernels write src plus or minus weights to dst, which may
+  // be src itself.
+
+  typedef void (*UpdateKernel)(int16_t* dst, const int16_t* src, const int16_t* weights);
+  typedef int32_t (*OutputKernel)(const int16_t* us, const int16_t* them, const int16_t* weights);
+
+  void add_generic(int16_t* dst, const int16_t* src, const int16_t* weights) {
     for (int i = 0; i < nnue::kHiddenSize; ++i)
-      acc.vals[i] = int16_t(acc.vals[i] + src[i]);
+      dst[i] = int16_t(src[i] + weights[i]);
   }
 
-  inline void remove_feature(nnue::Accumulator& acc, int idx) {
-    const int16_t* src = g_network.feature_weights[idx].vals;
+  void sub_generic(int16_t* dst, const int16_t* src, const int16_t* weights) {
     for (int i = 0; i < nnue::kHiddenSize; ++i)
-      acc.vals[i] = int16_t(acc.vals[i] - src[i]);
+      dst[i] = int16_t(src[i] - weights[i]);
   }
 
   inline int screlu(int16_t x) {
     const int y = x < 0 ? 0 : (x > nnue::kQa ? nnue::kQa : x);
     return y * y;
   }
+
+  int32_t output_generic(const int16_t* us, const int16_t* them, const int16_t* weights) {
+    int32_t sum = 0;
+
+    for (int i = 0; i < nnue::kHiddenSize; ++i) {
+      sum += screlu(us[i]) * int32_t(weights[i]);
+      sum += screlu(them[i]) * int32_t(weights[i + nnue::kHiddenSize]);
+    }
+    return sum;
+  }
+
+#if defined(USE_SIMD)
+
+  static_assert(nnue::kHiddenSize % 32 == 0, "SIMD kernels need kHiddenSize multiple of 32");
+
+  __attribute__((target("avx2")))
+  void add_avx2(int16_t* dst, const int16_t* src, const int16_t* weights) {
+    for (int i = 0; i < nnue::kHiddenSize; i += 16) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+      __m256i w = _mm256_loadu_si256((const __m256i*)(weights + i));
+      _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi16(a, w));
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void sub_avx2(int16_t* dst, const int16_t* src, const int16_t* weights) {
+    for (int i = 0; i < nnue::kHiddenSize; i += 16) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+      __m256i w = _mm256_loadu_si256((const __m256i*)(weights + i));
+      _mm256_storeu_si256((__m256i*)(dst + i), _mm256_sub_epi16(a, w));
+    }
+  }
+
+  // Squares and products are done on 32 bits, as in output_generic()
+  __attribute__((target("avx2")))
+  inline __m256i screlu_dot_avx2(const int16_t* v, const int16_t* w) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi32(nnue::kQa);
+
+    __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)v));
+    x = _mm256_min_epi32(_mm256_max_epi32(x, zero), qa);
+    __m256i y = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)w));
+    return _mm256_mullo_epi32(_mm256_mullo_epi32(x, x), y);
+  }
+
+  __attribute__((target("avx2")))
+  int32_t output_avx2(const int16_t* us, const int16_t* them, const int16_t* weights) {
+    __m256i sum = _mm256_setzero_si256();
+
+    for (int i = 0; i < nnue::kHiddenSize; i += 8) {
+      sum = _mm256_add_epi32(sum, screlu_dot_avx2(us + i, weights + i));
+      sum = _mm256_add_epi32(sum, screlu_dot_avx2(them + i, weights + i + nnue::kHiddenSize));
+    }
+
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  void add_avx512(int16_t* dst, const int16_t* src, const int16_t* weights) {
+    for (int i = 0; i < nnue::kHiddenSize; i += 32) {
+      __m512i a = _mm512_loadu_si512((const void*)(src + i));
+      __m512i w = _mm512_loadu_si512((const void*)(weights + i));
+      _mm512_storeu_si512((void*)(dst + i), _mm512_add_epi16(a, w));
+    }
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  void sub_avx512(int16_t* dst, const int16_t* src, const int16_t* weights) {
+    for (int i = 0; i < nnue::kHiddenSize; i += 32) {
+      __m512i a = _mm512_loadu_si512((const void*)(src + i));
+      __m512i w = _mm512_loadu_si512((const void*)(weights + i));
+      _mm512_storeu_si512((void*)(dst + i), _mm512_sub_epi16(a, w));
+    }
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  inline __m512i screlu_dot_avx512(const int16_t* v, const int16_t* w) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i qa = _mm512_set1_epi32(nnue::kQa);
+
+    __m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)v));
+    x = _mm512_min_epi32(_mm512_max_epi32(x, zero), qa);
+    __m512i y = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)w));
+    return _mm512_mullo_epi32(_mm512_mullo_epi32(x, x), y);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  int32_t output_avx512(const int16_t* us, const int16_t* them, const int16_t* weights) {
+    __m512i sum = _mm512_setzero_si512();
+
+    for (int i = 0; i < nnue::kHiddenSize; i += 16) {
+      sum = _mm512_add_epi32(sum, screlu_dot_avx512(us + i, weights + i));
+      sum = _mm512_add_epi32(sum, screlu_dot_avx512(them + i, weights + i + nnue::kHiddenSize));
+    }
+    return _mm512_reduce_add_epi32(sum);
+  }
+
+#endif // defined(USE_SIMD)
+
+  UpdateKernel add_kernel = add_generic;
+  UpdateKernel sub_kernel = sub_generic;
+  OutputKernel output_kernel = output_generic;
+  const char* kernelName = "generic";
+
+  inline void add_feature(nnue::Accumulator& acc, int idx) {
+    add_kernel(acc.vals, acc.vals, g_network.feature_weights[idx].vals);
+  }
+
+  inline void remove_feature(nnue::Accumulator& acc, int idx) {
+    sub_kernel(acc.vals, acc.vals, g_network.feature_weights[idx].vals);
+  }
 } // namespace
 
 namespace nnue {
+
+  /// init_kernels() selects the accumulator and output kernels for the CPU,
+  /// it must be called after init_cpu().
+  void init_kernels() {
+
+#if defined(USE_SIMD)
+    if (Cpu.avx512) {
+      add_kernel = add_avx512;
+      sub_kernel = sub_avx512;
+      output_kernel = output_avx512;
+      kernelName = "avx512";
+      return;
+    }
+
+    if (Cpu.avx2) {
+      add_kernel = add_avx2;
+      sub_kernel = sub_avx2;
+      output_kernel = output_avx2;
+      kernelName = "avx2";
+      return;
+    }
+#endif
+
+    add_kernel = add_generic;
+    sub_kernel = sub_generic;
+    output_kernel = output_generic;
+    kernelName = "generic";
+  }
+
+  const char* kernel_name() {
+    return kernelName;
+  }
+
   bool is_loaded() {
     return g_loaded;
   }
@@ -133,6 +297,33 @@ namespace nnue {
     remove_feature(accs.acc[BLACK], idx_black);
   }
 
+  /// update_accumulators() computes the accumulators after a move from the
+  /// ones before it. The first change reads from and the others update to,
+  /// so that the accumulators are gone through once per change.
+  void update_accumulators(const Accumulators& from, Accumulators& to, const DirtyPieces& dp) {
+    for (int c = 0; c < 2; ++c) {
+      const int16_t* src = from.acc[c].vals;
+      int16_t* dst = to.acc[c].vals;
+
+      for (int i = 0; i < dp.removed; ++i) {
+        const Piece piece = Piece(dp.removedPiece[i]);
+        const int idx = feature_index(Color(c), piece, Square(dp.removedSquare[i]));
+        sub_kernel(dst, src, g_network.feature_weights[idx].vals);
+        src = dst;
+      }
+
+      for (int i = 0; i < dp.added; ++i) {
+        const Piece piece = Piece(dp.addedPiece[i]);
+        const int idx = feature_index(Color(c), piece, Square(dp.addedSquare[i]));
+        add_kernel(dst, src, g_network.feature_weights[idx].vals);
+        src = dst;
+      }
+
+      if (src != dst)
+        std::memcpy(dst, src, sizeof(Accumulator));
+    }
+  }
+
   int evaluate(const Accumulators& accs, Color stm) {
     if (!g_loaded)
       return 0;
@@ -140,12 +331,7 @@ namespace nnue {
     const Accumulator& us = accs.acc[stm];
     const Accumulator& them = accs.acc[opposite_color(stm)];
 
-    int32_t sum = 0;
-
-    for (int i = 0; i < kHiddenSize; ++i) {
-      sum += screlu(us.vals[i]) * int32_t(g_network.output_weights[i]);
-      sum += screlu(them.vals[i]) * int32_t(g_network.output_weights[i + kHiddenSize]);
-    }
+    int32_t sum = output_kernel(us.vals, them.vals, g_network.output_weights);
 
     sum /= kQa;
     sum += g_network.output_bias;
@@ -47,6 +47,14 @@ namespace nnue {
     Accumulator acc[2];
   };
 
+  // The pieces a move takes off and puts on the board: at most the moving
+  // piece, the nine ones of an explosion and a pawn taken en passant.
+  struct DirtyPieces {
+    uint8_t removed, added;
+    uint8_t removedPiece[11], removedSquare[11];
+    uint8_t addedPiece[2], addedSquare[2];
+  };
+
   struct Network {
     Accumulator feature_weights[kInputSize];
     Accumulator feature_bias;
@@ -54,6 +62,9 @@ namespace nnue {
     int16_t output_bias;
   };
 
+  void init_kernels();
+  const char* kernel_name();
+
   bool is_loaded();
   const std::string& last_error();
   bool load(const std::string& path);
@@ -61,6 +72,7 @@ namespace nnue {
   void reset_accumulators(const Position& pos, Accumulators& accs);
   void apply_add(Accumulators& accs, Piece piece, Square square);
   void apply_remove(Accumulators& accs, Piece piece, Square square);
+  void update_accumulators(const Accumulators& from, Accumulators& to, const DirtyPieces& dp);
   int evaluate(const Accumulators& accs, Color stm);
 } // namespace nnue
 
@@ -7,18 +7,20 @@
 
 
 #include "pgn.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <time.h>
+#include "misc.h"
 #include "position.h"
 #include "string.h"
 
 void appendPGN(
-	char* filename, 
-	char* name_white, 
-	char* name_black, 
+	const char* filename, 
+	const char* name_white, 
+	const char* name_black, 
 	ResultPGN result,
 	int init_time, int inc,
-	char* fen, Move* moves, int move_count) {
+	const char* fen, Move* moves, int move_count) {
 	
 	FILE* file;
 	file = fopen(filename, "a");
@@ -107,10 +109,203 @@ void appendPGN(
 
 
 
+namespace {
 
+	// is_delimiter() is true for the characters that end a token of movetext
+	inline bool is_delimiter(char c) {
+		return isspace((unsigned char)c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';';
+	}
+
+	// skip_comment() returns the end of the comment or the variation that
+	// starts at cur. Variations may be nested and contain comments.
+	const char* skip_comment(const char* cur, const char* end) {
+
+		if (*cur == '{' || *cur == ';') {
+			const char* c = (const char*)memchr(cur, *cur == '{' ? '}' : '\n', end - cur);
+			return c ? c + 1 : end;
+		}
+
+		for (int depth = 0; cur < end; ) {
+			if (*cur == '{' || *cur == ';') {
+				cur = skip_comment(cur, end);
+				continue;
+			}
+
+			if (*cur == '(') {
+				++depth;
+			} else if (*cur == ')' && --depth == 0) {
+				return cur + 1;
+			}
+			++cur;
+		}
+		return end;
+	}
+
+	inline bool token_is(const char* tok, int len, const char* s) {
+		return int(strlen(s)) == len && !strncmp(tok, s, len);
+	}
+}
+
+
+/// PgnReader::open() maps a PGN file, returns false if it can not be read
+
+bool PgnReader::open(const std::string& fileName) {
+	close();
+	data = map_file(fileName, &bytes);
+	cur = data;
+	return data != NULL;
+}
+
+void PgnReader::close() {
+	unmap_file(data, bytes);
+	data = cur = NULL;
+	bytes = 0;
+}
+
+
+/// PgnReader::next_game() finds the next game of the file, returns false at
+/// the end of the file. A game ends where a line starts with the tag pairs
+/// of the next one, outside of a comment.
+
+bool PgnReader::next_game(PgnGame& game) {
+
+	const char* end = data + bytes;
+
+	while (cur < end && isspace((unsigned char)*cur)) ++cur;
+
+	if (cur >= end) {
+		return false;
+	}
+
+	// tag pairs, one per line
+	game.tagsBegin = cur;
+
+	while (cur < end && *cur == '[') {
+		const char* nl = (const char*)memchr(cur, '\n', end - cur);
+		cur = nl ? nl + 1 : end;
+		while (cur < end && isspace((unsigned char)*cur)) ++cur;
+	}
+
+	// movetext
+	game.movesBegin = cur;
+
+	while (cur < end) {
+		if (*cur == '{' || *cur == ';') {
+			cur = skip_comment(cur, end);
+		} else if (*cur == '[' && cur[-1] == '\n') {
+			break;
+		} else {
+			++cur;
+		}
+	}
+
+	game.end = cur;
+	return true;
+}
+
+
+/// PgnGame::tag() finds the value of a tag pair, without the quotes
+
+bool PgnGame::tag(const char* name, PgnToken& value) const {
 
+	int n = int(strlen(name));
 
+	for (const char* cur = tagsBegin; cur < movesBegin; ) {
+		const char* nl = (const char*)memchr(cur, '\n', movesBegin - cur);
+		const char* lineEnd = nl ? nl : movesBegin;
 
+		if (   *cur == '[' && lineEnd - cur > n + 1
+			&& !strncmp(cur + 1, name, n) && isspace((unsigned char)cur[n + 1])) {
 
+			const char* q1 = (const char*)memchr(cur, '"', lineEnd - cur);
+			const char* q2 = lineEnd;
 
+			while (q2 > cur && *--q2 != '"') {}
 
+			if (!q1 || q2 <= q1) {
+				return false;
+			}
+
+			value.str = q1 + 1;
+			value.len = int(q2 - q1 - 1);
+			return true;
+		}
+
+		cur = lineEnd + 1;
+		while (cur < movesBegin && isspace((unsigned char)*cur)) ++cur;
+	}
+
+	return false;
+}
+
+
+/// PgnGame::result() reads the result from the tag pairs
+
+ResultPGN PgnGame::result() const {
+
+	PgnToken r;
+
+	if (!tag("Result", r)) {
+		return NO_RESULT;
+	}
+
+	return token_is(r.str, r.len, "1-0")     ? WHITE_WINS
+		 : token_is(r.str, r.len, "0-1")     ? BLACK_WINS
+		 : token_is(r.str, r.len, "1/2-1/2") ? DRAW : NO_RESULT;
+}
+
+
+/// PgnMoveIterator::next() finds the next move of the main line, returns
+/// false at the end of the game.
+
+bool PgnMoveIterator::next(PgnToken& san) {
+
+	while (cur < end) {
+
+		if (*cur == '{' || *cur == ';' || *cur == '(') {
+			cur = skip_comment(cur, end);
+			continue;
+		}
+
+		if (is_delimiter(*cur) || *cur == '.') {
+			++cur;	// also stray closing braces and parentheses
+			continue;
+		}
+
+		const char* tok = cur;
+
+		while (cur < end && !is_delimiter(*cur)) ++cur;
+
+		int len = int(cur - tok);
+
+		if (   token_is(tok, len, "*")   || token_is(tok, len, "1-0")
+			|| token_is(tok, len, "0-1") || token_is(tok, len, "1/2-1/2")) {
+			cur = end;
+			return false;
+		}
+
+		// NAGs
+		if (*tok == '$') {
+			continue;
+		}
+
+		// move numbers, possibly stuck to the move as in "12.e4" or "12...Nf6",
+		// but "0-0" is castling
+		if (isdigit((unsigned char)*tok) && *tok != '0') {
+			while (tok < cur && isdigit((unsigned char)*tok)) ++tok;
+			if (tok == cur || *tok != '.') {
+				continue;
+			}
+			while (tok < cur && *tok == '.') ++tok;
+			if (tok == cur) {
+				continue;
+			}
+		}
+
+		san.str = tok;
+		san.len = int(cur - tok);
+		return true;
+	}
+
+	return false;
+}
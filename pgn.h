@@ -8,6 +8,8 @@
 #ifndef PGN_H_
 #define PGN_H_
 
+#include <string>
+
 #include "types.h"
 #include "move.h"
 
@@ -16,11 +18,75 @@ enum ResultPGN {
 };
 
 void appendPGN(
-	char* filename, 
-	char* name_white, 
-	char* name_black, 
+	const char* filename, 
+	const char* name_white, 
+	const char* name_black, 
 	ResultPGN result,
 	int time, int inc,
-	char* fen, Move* moves, int move_count);
+	const char* fen, Move* moves, int move_count);
+
+
+/// PgnToken is a piece of text inside a PGN file, as a pointer and a length:
+/// nothing is copied out of the mapped file.
+
+struct PgnToken {
+	const char* str;
+	int len;
+
+	std::string to_string() const { return std::string(str, len); }
+};
+
+
+/// PgnGame is a game inside a PGN file, the tag pairs go from tagsBegin to
+/// movesBegin and the movetext from movesBegin to end.
+
+struct PgnGame {
+	const char* tagsBegin;
+	const char* movesBegin;
+	const char* end;
+
+	bool tag(const char* name, PgnToken& value) const;
+	ResultPGN result() const;
+};
+
+
+/// PgnReader maps a PGN file read-only in memory and iterates over its
+/// games. The games point inside the mapping, so they are valid until the
+/// reader is closed. Files of several GB are fine: pages are only read by
+/// the OS when the games are scanned.
+
+class PgnReader {
+public:
+	PgnReader() : data(NULL), bytes(0), cur(NULL) {}
+	~PgnReader() { close(); }
+
+	bool open(const std::string& fileName);
+	void close();
+	bool next_game(PgnGame& game);
+
+private:
+	PgnReader(const PgnReader&);
+	PgnReader& operator=(const PgnReader&);
+
+	const char* data;
+	size_t bytes;
+	const char* cur;
+};
+
+
+/// PgnMoveIterator walks the moves of the main line of a game, skipping move
+/// numbers, comments, variations, NAGs and the result. The moves come out as
+/// written, to be decoded by move_from_san().
+
+class PgnMoveIterator {
+public:
+	explicit PgnMoveIterator(const PgnGame& game) : cur(game.movesBegin), end(game.end) {}
+
+	bool next(PgnToken& san);
+
+private:
+	const char* cur;
+	const char* end;
+};
 
 #endif /* PGN_H_ */
@@ -17,12 +17,14 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <fstream>
 #include <map>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include "bitcount.h"
 #include "movegen.h"
@@ -40,8 +42,6 @@ using std::string;
 using std::cout;
 using std::endl;
 
-ExplosionData Position::captureList[MaxGameLength];
-
 Key Position::zobrist[2][8][64];
 Key Position::zobEp[64];
 Key Position::zobCastle[16];
@@ -109,6 +109,37 @@ namespace {
   };
 
   PieceLetters pieceLetters;
+
+  // Cuckoo tables with the Zobrist key deltas of all the reversible moves of
+  // non-pawn pieces on an empty board, see Position::has_game_cycle(). Every
+  // key has two possible slots given by the two hash functions below.
+  Key Cuckoo[8192];
+  Move CuckooMove[8192];
+
+  inline int cuckoo_h1(Key h) { return int(h & 0x1FFF); }
+  inline int cuckoo_h2(Key h) { return int((h >> 16) & 0x1FFF); }
+
+  // blast_count() counts the pieces of a blast area, at most 9 of them
+  inline int blast_count(Bitboard b) {
+
+    return count_1s_max15(b);
+  }
+
+  // add_dirty() and remove_dirty() record a piece put on or taken off the
+  // board by a move, for the NNUE update.
+  inline void add_dirty(nnue::DirtyPieces& dp, Piece p, Square s) {
+
+    assert(dp.added < 2);
+    dp.addedPiece[dp.added] = uint8_t(p);
+    dp.addedSquare[dp.added++] = uint8_t(s);
+  }
+
+  inline void remove_dirty(nnue::DirtyPieces& dp, Piece p, Square s) {
+
+    assert(dp.removed < 11);
+    dp.removedPiece[dp.removed] = uint8_t(p);
+    dp.removedSquare[dp.removed++] = uint8_t(s);
+  }
 }
 
 
@@ -152,35 +183,87 @@ CheckInfo::CheckInfo(const Position& pos) {
 
 
 /// Position c'tors. Here we always create a copy of the original position
-/// or the FEN string, we want the new born Position object do not depend
-/// on any external data so we detach state pointer from the source one.
+/// or the FEN string. The copy has its own current state, the previous ones,
+/// which the repetition detection reads, are still the ones of the source:
+/// they must outlive the copy, as the states of the master of a split point
+/// do for its slaves, otherwise see detach().
 
 Position::Position(const Position& pos, int th) {
 
   memcpy(this, &pos, sizeof(Position));
-  detach(); // Always detach() in copy c'tor to avoid surprises
+
   threadID = th;
   nodes = 0;
+  setupStates = NULL;
+  startState = *pos.st;
+  st = &startState;
+
+  // The NNUE stack is the one of our thread. We start with the accumulators
+  // of the source when they are already computed: copied when the stack is
+  // not the same, else shared with the source state, which must not change
+  // while we live.
+  const NnueEntry& src = pos.nnueStack[pos.st->nnueIndex];
+
+  nnueStack = Threads[threadID].nnueStack;
+  startSource = NULL;
+
+  if (nnueStack == pos.nnueStack)
+  {
+      if (src.state == pos.st)
+          startSource = pos.st;
+      else
+          nnueStack[st->nnueIndex].state = NULL;
+  }
+  else if (src.state == pos.st)
+  {
+      nnueStack[st->nnueIndex].accs = src.accs;
+      nnueStack[st->nnueIndex].state = st;
+  }
+  else
+      nnueStack[st->nnueIndex].state = NULL;
 }
 
 Position::Position(const string& fen, bool isChess960, int th) {
 
-  from_fen(fen, isChess960);
   threadID = th;
-  
-  memset(captureList, 0, sizeof(captureList));
+  nnueStack = Threads[threadID].nnueStack;
+  setupStates = NULL;
+  from_fen(fen, isChess960);
 }
 
+Position::~Position() {
+
+  delete setupStates;
+}
 
-/// Position::detach() copies the content of the current state and castling
-/// masks inside the position itself. This is needed when the st pointee could
-/// become stale, as example because the caller is about to going out of scope.
+
+/// Position::detach() copies the previous states the repetition detection
+/// may read, back to the last irreversible move or null move, so that a
+/// copy no longer depends on the states of its source. To be called on a
+/// copy which outlives its source, or whose source changes.
 
 void Position::detach() {
 
-  startState = *st;
-  st = &startState;
-  st->previous = NULL; // as a safe guard
+  assert(st == &startState);
+
+  int n = Min(Min(st->gamePly, st->rule50), st->pliesFromNull);
+  std::vector<const StateInfo*> chain(n);
+  const StateInfo* s = st;
+  StateInfo* prev = NULL;
+
+  for (int i = 0; i < n; i++)
+      chain[i] = s = s->previous;
+
+  for (int i = n - 1; i >= 0; i--)
+  {
+      StateInfo* c = new_setup_state();
+      *c = *chain[i];
+      c->previous = prev;
+      prev = c;
+  }
+
+  startState.previous = prev;
+  startState.gamePly = n;
 }
 
 
@@ -299,8 +382,6 @@ void Position::from_fen(const string& fen, bool isChess960) {
 //  assert(neigh_is_ok());
   ENDNEW
 
-  reset_nnue();
-
   return;
 
 incorrect_fen:
@@ -308,8 +389,57 @@ incorrect_fen:
 }
 
 
-void Position::reset_nnue() {
-  nnue::reset_accumulators(*this, st->nnue);
+/// Position::reset_nnue() computes the NNUE accumulators of the current state
+/// from scratch.
+
+void Position::reset_nnue() const {
+
+  STAT_INC(threadID, STAT_NNUE_REFRESH);
+
+  NnueEntry* e = nnueStack + st->nnueIndex;
+  nnue::reset_accumulators(*this, e->accs);
+  e->state = st;
+}
+
+
+/// Position::update_nnue() computes the NNUE accumulators of the current
+/// state, which are not on the stack yet. They are updated, move after move,
+/// from the closest previous state which has its accumulators still there.
+/// If there is none, because the states are too many or a null move is in
+/// the way, they are computed from scratch.
+
+void Position::update_nnue() const {
+
+  const StateInfo* path[NnueStackSize];
+  const StateInfo* s = st;
+  int n = 0;
+
+  while (   nnueStack[s->nnueIndex].state != s
+         && (s != &startState || !startSource || nnueStack[s->nnueIndex].state != startSource))
+  {
+      // The states before startState, if any, are the ones of the source of
+      // a copy, their entries are not ours.
+      if (   n == NnueStackSize - 1
+          || s == &startState
+          || !s->previous
+          || s->previous->nnueIndex < 0)
+      {
+          reset_nnue();
+          return;
+      }
+      path[n++] = s;
+      s = s->previous;
+  }
+
+  while (n--)
+  {
+      STAT_INC(threadID, STAT_NNUE_UPDATE);
+
+      s = path[n];
+      NnueEntry* e = nnueStack + s->nnueIndex;
+      nnue::update_accumulators(nnueStack[s->previous->nnueIndex].accs, e->accs, s->dirty);
+      e->state = s;
+  }
 }
 
 
@@ -472,7 +602,7 @@ const string Position::to_fen() const {
   Square sq;
   char emptyCnt = '0';
 
-  for (Rank rank = RANK_8; rank >= RANK_1; rank--, fen += '/')
+  for (Rank rank = RANK_8; rank >= RANK_1; rank--)
   {
       for (File file = FILE_A; file <= FILE_H; file++)
       {
@@ -495,6 +625,9 @@ const string Position::to_fen() const {
           fen += emptyCnt;
           emptyCnt = '0';
       }
+
+      if (rank > RANK_1)
+          fen += '/';
   }
 
   fen += (sideToMove == WHITE ? " w " : " b ");
@@ -659,6 +792,53 @@ Bitboard Position::attackers_to(Square s) const {
         | (attacks_from<KING>(s)        & pieces(KING));
 }
 
+STARTNEW
+/// Position::explosion_threats() returns the pieces next to the enemy king
+/// that the given side can capture with a non-king piece, blowing up the king
+/// together with them. Instead of calling attackers_to() for each of those
+/// pieces, the attacks of the whole side are computed in one pass: pawns with
+/// shifts, the other pieces only if their pseudo attacks reach the king zone.
+
+Bitboard Position::explosion_threats(Color attacker) const {
+
+  Color victim = opposite_color(attacker);
+
+  if (!piece_count(attacker, KING) || !piece_count(victim, KING))
+      return EmptyBoardBB;
+
+  Bitboard zone = attacks_from<KING>(king_square(victim)) & pieces_of_color(victim);
+
+  if (!zone)
+      return EmptyBoardBB;
+
+  Bitboard b = pieces(PAWN, attacker);
+  Bitboard threats = (attacker == WHITE ? ((b << 9) & ~FileABB) | ((b << 7) & ~FileHBB)
+                                        : ((b >> 7) & ~FileABB) | ((b >> 9) & ~FileHBB)) & zone;
+  Square s;
+
+  b = pieces(KNIGHT, attacker);
+  while (b && threats != zone)
+      threats |= attacks_from<KNIGHT>(pop_1st_bit(&b)) & zone;
+
+  b = pieces(BISHOP, QUEEN, attacker);
+  while (b && threats != zone)
+  {
+      s = pop_1st_bit(&b);
+      if (BishopPseudoAttacks[s] & zone & ~threats)
+          threats |= attacks_from<BISHOP>(s) & zone;
+  }
+
+  b = pieces(ROOK, QUEEN, attacker);
+  while (b && threats != zone)
+  {
+      s = pop_1st_bit(&b);
+      if (RookPseudoAttacks[s] & zone & ~threats)
+          threats |= attacks_from<ROOK>(s) & zone;
+  }
+  return threats;
+}
+ENDNEW
+
 /// Position::attacks_from() computes a bitboard of all attacks
 /// of a given piece put in a given square.
 
@@ -1280,24 +1460,28 @@ bool Position::move_gives_check(Move m, const CheckInfo& ci) const {
 
 /// Position::do_setup_move() makes a permanent move on the board. It should
 /// be used when setting up a position on board. You can't undo the move.
+/// The new state is kept by the position, until the next from_fen(), so that
+/// repetitions of the positions before the move are detected.
 
 void Position::do_setup_move(Move m) {
 
-  StateInfo newSt;
-
-  do_move(m, newSt);
-
-  // Reset "game ply" in case we made a non-reversible move.
-  // "game ply" is used for repetition detection.
-  if (st->rule50 == 0)
-      st->gamePly = 0;
+  do_move(m, *new_setup_state());
 
   // Update the number of plies played from the starting position
   startPosPlyCounter++;
+}
+
+
+/// Position::new_setup_state() returns a new state kept by the position, see
+/// do_setup_move(). The states do not move when more are added.
+
+StateInfo* Position::new_setup_state() {
+
+  if (!setupStates)
+      setupStates = new std::deque<StateInfo>;
 
-  // Our StateInfo newSt is about going out of scope so copy
-  // its content before it disappears.
-  detach();
+  setupStates->push_back(StateInfo());
+  return &setupStates->back();
 }
 
 
@@ -1330,17 +1514,20 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
     Square epSquare;
     Score value;
     Value npMaterial[2];
-    nnue::Accumulators nnue;
   };
 
   memcpy(&newSt, st, sizeof(ReducedStateInfo));
 
+  // The accumulators are computed later, if the evaluation needs them
+  newSt.nnueIndex = (st->nnueIndex + 1) & (NnueStackSize - 1);
+  newSt.dirty.removed = newSt.dirty.added = 0;
+  nnueStack[newSt.nnueIndex].state = NULL;
+
   newSt.previous = st;
   st = &newSt;
 
-  // Save the current key to the history[] array, in order to be able to
-  // detect repetition draws.
-  history[st->gamePly++] = key;
+  // One more previous state to look at for repetition draws
+  st->gamePly++;
 
   // Update side to move
   key ^= zobSideToMove;
@@ -1352,6 +1539,7 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
 
   if (move_is_castle(m))
   {
+      STAT_INC(threadID, STAT_DO_MOVE_CASTLE);
       st->key = key;
       do_castle_move(m);
       return;
@@ -1374,7 +1562,13 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
   assert(!pm || relative_rank(us, to) == RANK_8);
   
   if (capture)
+  {
       do_capture_move(key, capture, them, to, from, ep);
+      STAT_INC(threadID, ep ? STAT_DO_MOVE_EP : STAT_DO_MOVE_CAPTURE);
+      STAT_INC(threadID, STAT_EXPLOSION_SIZE_0 + st->expl.size);
+  }
+  else
+      STAT_INC(threadID, pm ? STAT_DO_MOVE_PROMOTION : STAT_DO_MOVE_QUIET);
 
   // Update hash key
   key ^= zobrist[us][pt][from] ^ zobrist[us][pt][to];
@@ -1506,30 +1700,30 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
   NEW // Set attacking piece
   NEW st->attackingType = pt;
 
-  // NNUE incremental update (atomic-aware)
+  // Pieces for the NNUE update (atomic-aware)
   {
-    nnue::Accumulators& accs = st->nnue;
+    nnue::DirtyPieces& dp = st->dirty;
 
     if (capture) {
-      nnue::apply_remove(accs, piece, from);
+      remove_dirty(dp, piece, from);
 
       for (int i = 0; i < st->expl.size; ++i) {
-        const Piece expl_piece = st->expl.piece[i];
+        const Piece expl_piece = Piece(st->expl.piece[i]);
         if (expl_piece != PIECE_NONE)
-          nnue::apply_remove(accs, expl_piece, st->expl.square[i]);
+          remove_dirty(dp, expl_piece, Square(st->expl.square[i]));
       }
 
       if (ep) {
         const Square capsq = (us == WHITE) ? Square(to - DELTA_N) : Square(to - DELTA_S);
-        nnue::apply_remove(accs, make_piece(them, PAWN), capsq);
+        remove_dirty(dp, make_piece(them, PAWN), capsq);
       }
     } else if (pm) {
-      nnue::apply_remove(accs, piece, from);
+      remove_dirty(dp, piece, from);
       const PieceType promotion = move_promotion_piece(m);
-      nnue::apply_add(accs, make_piece(us, promotion), to);
+      add_dirty(dp, make_piece(us, promotion), to);
     } else {
-      nnue::apply_remove(accs, piece, from);
-      nnue::apply_add(accs, piece, to);
+      remove_dirty(dp, piece, from);
+      add_dirty(dp, piece, to);
     }
   }
 
@@ -1674,36 +1868,47 @@ void Position::do_capture_move(Key& key, PieceType capture, Color them, Square t
    
     // gather information about the first obligatory capture
     // the actual capture is done later
-    Square explSquare = explSq[to].square[0];
-    Piece explPiece = board[explSquare];
-    Color explColor;
-    PieceType explPieceType;
-	st->expl.piece[0] = explPiece;
-	st->expl.square[0] = explSquare;
+	st->expl.piece[0] = uint8_t(board[to]);
+	st->expl.square[0] = uint8_t(to);
 	++explCount;
 	
-	// now capture the other pieces
-    for (int k = 1; k < explSq[to].size; ++k) {
-    	explSquare = explSq[to].square[k];
-    	explPiece = board[explSquare];
-    	
-    	// skip if we are about to remove the attacking piece
-    	if (explSquare == from) continue;
-    	
-    	if (explPiece != PIECE_NONE && explPiece != WP && explPiece != BP) {
-    		// gather information
-    		st->expl.piece[explCount] = explPiece;
-    		st->expl.square[explCount] = explSquare;
-    		explColor = color_of_piece(explPiece);
-    		explPieceType = type_of_piece(explPiece);
-    		++explCount;
-    		
-    		// do the capture
-    		remove_piece(key, explColor, explSquare, explPieceType);
-    		
-    	}
+	// The other pieces in the blast, pawns and the attacking piece excluded,
+	// leave the occupancy bitboards at once, the rest is done per piece.
+	Bitboard blast = explBB[to] & occupied_squares() & ~pieces(PAWN) & ~make_move_bb(from, to);
+
+	st->blastBB[WHITE] = blast & byColorBB[WHITE];
+	st->blastBB[BLACK] = blast & byColorBB[BLACK];
+	byColorBB[WHITE] &= ~blast;
+	byColorBB[BLACK] &= ~blast;
+	byTypeBB[0] &= ~blast; // HACK: byTypeBB[0] == occupied squares
+
+    while (blast) {
+    	Square explSquare = pop_1st_bit(&blast);
+    	Piece explPiece = board[explSquare];
+    	Color explColor = color_of_piece(explPiece);
+    	PieceType explPieceType = type_of_piece(explPiece);
+
+    	st->expl.piece[explCount] = uint8_t(explPiece);
+    	st->expl.square[explCount] = uint8_t(explSquare);
+    	++explCount;
+
+    	clear_bit(&(byTypeBB[explPieceType]), explSquare);
+    	board[explSquare] = PIECE_NONE;
+    	key ^= zobrist[explColor][explPieceType][explSquare];
+    	st->value -= pst(explColor, explPieceType, explSquare);
+    	st->npMaterial[explColor] -= PieceValueMidgame[explPieceType];
+    	pieceCount[explColor][explPieceType]--;
+
+    	if (explPieceType != KING)
+    		st->materialKey ^= zobrist[explColor][explPieceType][pieceCount[explColor][explPieceType]];
+
+    	// Update piece list, see the warning below
+    	Square lastPieceSquare = pieceList[explColor][explPieceType][pieceCount[explColor][explPieceType]];
+    	index[lastPieceSquare] = index[explSquare];
+    	pieceList[explColor][explPieceType][index[lastPieceSquare]] = lastPieceSquare;
+    	pieceList[explColor][explPieceType][pieceCount[explColor][explPieceType]] = SQ_NONE;
     }
-    st->expl.size = explCount;
+    st->expl.size = uint8_t(explCount);
     ENDNEW
 
     // If the captured piece was a pawn, update pawn hash key,
@@ -1885,10 +2090,10 @@ void Position::do_castle_move(Move m) {
   index[kto] = index[kfrom];
   index[rto] = tmp;
 
-  nnue::apply_remove(st->nnue, king, kfrom);
-  nnue::apply_add(st->nnue, king, kto);
-  nnue::apply_remove(st->nnue, rook, rfrom);
-  nnue::apply_add(st->nnue, rook, rto);
+  remove_dirty(st->dirty, king, kfrom);
+  remove_dirty(st->dirty, rook, rfrom);
+  add_dirty(st->dirty, king, kto);
+  add_dirty(st->dirty, rook, rto);
 
   // Update incremental scores
   st->value += pst_delta(king, kfrom, kto);
@@ -2050,16 +2255,22 @@ void Position::undo_move(Move m) {
       pieceList[them][st->capturedType][index[capsq]] = capsq;
       
       STARTNEW
-      // the first obligatory piece was restored above, TODO: merge this
-      Color color;
-      Square square;
-      PieceType type;
-      
+      // the first obligatory piece was restored above, the blast goes back
+      // into the occupancy bitboards at once
+      byColorBB[WHITE] |= st->blastBB[WHITE];
+      byColorBB[BLACK] |= st->blastBB[BLACK];
+      byTypeBB[0] |= st->blastBB[WHITE] | st->blastBB[BLACK];
+
       for (int k = 1; k < st->expl.size; ++k) {
-    	  color = color_of_piece(st->expl.piece[k]);
-    	  type = type_of_piece(st->expl.piece[k]);
-    	  square = st->expl.square[k];
-    	  restore_piece(color, square, type);
+    	  Piece piece = Piece(st->expl.piece[k]);
+    	  Color color = color_of_piece(piece);
+    	  PieceType type = type_of_piece(piece);
+    	  Square square = Square(st->expl.square[k]);
+
+    	  set_bit(&(byTypeBB[type]), square);
+    	  board[square] = piece;
+    	  index[square] = pieceCount[color][type]++;
+    	  pieceList[color][type][index[square]] = square;
       }
       ENDNEW
   }
@@ -2156,11 +2367,11 @@ void Position::do_null_move(StateInfo& backupSt) {
   backupSt.value    = st->value;
   backupSt.previous = st->previous;
   backupSt.pliesFromNull = st->pliesFromNull;
+  backupSt.nnueIndex = -1; // Not a state to update the accumulators from
   st->previous = &backupSt;
 
-  // Save the current key to the history[] array, in order to be able to
-  // detect repetition draws.
-  history[st->gamePly++] = st->key;
+  // The backup state holds the key before the null move, see is_draw()
+  st->gamePly++;
 
   // Update the necessary information
   if (st->epSquare != SQ_NONE)
@@ -2242,34 +2453,34 @@ int Position::see(Square from, Square to) const {
   // there are no capture sequences in atomic chess
   // we just sum up the total material gain/loss
   
-  // TODO: en passant? (type_of_piece_on(to) == PIECE_TYPE_NONE)
-  
-  if (!type_of_piece_on(from) || !type_of_piece_on(to)) {
-	  return 0;
-  }
-  
-  int score = midgame_value_of_piece_on(to) - midgame_value_of_piece_on(from);
+  if (!type_of_piece_on(from))
+      return 0;
+
   Color us = side_to_move();
   Color them = opposite_color(us);
-  
-  for (int k = 1; k < explSq[to].size; ++k) {
-	  if (type_of_piece_on(explSq[to].square[k]) != PAWN) {
-		  if (color_of_piece_on(explSq[to].square[k]) == us) {
-			  score -= midgame_value_of_piece_on(explSq[to].square[k]);
-		  } else if (color_of_piece_on(explSq[to].square[k]) == them) {
-			  score += midgame_value_of_piece_on(explSq[to].square[k]);
-		  }
-		  
-		  // bonus if we can explode king
-		  if (type_of_piece_on(explSq[to].square[k]) == KING) {
-			  if (color_of_piece_on(explSq[to].square[k]) == us) {
-				  return -25000;	// immediate return if we would capture own king
-			  } else if (color_of_piece_on(explSq[to].square[k]) == them) {
-				  score += 25000;
-			  }
-		  }
-  	  }
-  }
+  int score;
+
+  if (type_of_piece_on(to))
+      score = midgame_value_of_piece_on(to) - midgame_value_of_piece_on(from);
+
+  // En passant: pawn takes pawn, only the blast around 'to' counts
+  else if (to == st->epSquare && type_of_piece_on(from) == PAWN)
+      score = 0;
+  else
+      return 0;
+
+  // Pieces blown away beside the two already counted, pawns survive
+  Bitboard blast = explBB[to] & ~pieces(PAWN) & ~make_move_bb(from, to);
+
+  if (blast & pieces(KING, us))
+      return -25000;	// immediate return if we would capture own king
+
+  if (blast & pieces(KING, them))
+      score += 25000;	// bonus if we can explode king
+
+  for (PieceType pt = KNIGHT; pt <= QUEEN; pt++)
+      score += PieceValueMidgame[pt] * (  blast_count(blast & pieces(pt, them))
+                                        - blast_count(blast & pieces(pt, us)));
   
   // add MinorPiecePawnValueDiff so minorpiece-pawn captures have see 0?
   return score;
@@ -2380,6 +2591,14 @@ void Position::clear() {
 
   st = &startState;
   memset(st, 0, sizeof(StateInfo));
+
+  // The accumulators of the new position are computed when asked for
+  startSource = NULL;
+  nnueStack[st->nnueIndex].state = NULL;
+
+  if (setupStates)
+      setupStates->clear();
+
   st->epSquare = SQ_NONE;
   startPosPlyCounter = 0;
   nodes = 0;
@@ -2544,38 +2763,28 @@ bool Position::is_draw() const {
   if (st->rule50 > 99 && !is_mate())
       return true;
 
-  // Draw by repetition?
-
-#if 0
-  if (false && !SkipRepetition) // not working in Atomic :(
+  // Draw by repetition? Keys are read back from the StateInfo chain. In
+  // atomic every capture explodes and resets rule50, as pawn moves do, so
+  // only positions after the last irreversible move are compared.
+  if (!SkipRepetition)
   {
-      int i = 4, e = Min(st->rule50, st->pliesFromNull);
+      int i = 4, e = Min(Min(st->gamePly, st->rule50), st->pliesFromNull);
 
-      if (st && st->previous && i <= e)
+      if (i <= e)
       {
           StateInfo* stp = st->previous->previous;
-	  if (stp && stp->previous)
-	    {
-	      do {
-		stp = stp->previous->previous;
 
-		if (stp && stp->key == st->key)
+          do {
+              stp = stp->previous->previous;
+
+              if (stp->key == st->key)
                   return true;
 
-		i +=2;
-		
-	      } while (i <= e);
-	    }
+              i += 2;
+
+          } while (i <= e);
       }
   }
-#else // here is the SF 2.1.1 code, not sure what ATOMKRAFT was doing ?
-      // seems to have mixed-matched from later code, with state->previous
-      // rather than history to detect draws
-  for (int i = 4, e = Min(Min(st->gamePly, st->rule50), st->pliesFromNull);
-       i <= e; i += 2)
-    if (history[st->gamePly - i] == st->key)
-      return true;
-#endif
   return false;
 }
 
@@ -2583,6 +2792,63 @@ bool Position::is_draw() const {
 template bool Position::is_draw<false>() const;
 template bool Position::is_draw<true>() const;
 
+
+/// Position::has_game_cycle() tests whether the side to move can reach, with
+/// a single reversible move, a position which already occurred after the last
+/// irreversible move. The key delta between the current position and each
+/// previous one with the same side to move is looked up in the cuckoo table of
+/// reversible moves, so there is no need to generate moves. Below the root one
+/// occurrence is enough to score a draw, before it a real repetition is needed.
+
+bool Position::has_game_cycle(int ply) const {
+
+  int j;
+  int end = Min(Min(st->gamePly, st->rule50), st->pliesFromNull);
+
+  if (end < 3)
+      return false;
+
+  Key originalKey = st->key;
+  StateInfo* stp = st->previous;
+
+  for (int i = 3; i <= end; i += 2)
+  {
+      stp = stp->previous->previous;
+
+      Key moveKey = originalKey ^ stp->key;
+
+      if (   (j = cuckoo_h1(moveKey), Cuckoo[j] == moveKey)
+          || (j = cuckoo_h2(moveKey), Cuckoo[j] == moveKey))
+      {
+          Move move = CuckooMove[j];
+          Square s1 = move_from(move);
+          Square s2 = move_to(move);
+
+          if (squares_between(s1, s2) & occupied_squares())
+              continue;
+
+          if (ply > i)
+              return true;
+
+          // The table stores Rc1c5 and Rc5c1 in the same entry, the piece
+          // must be ours for the move to repeat a position before the root.
+          if (color_of_piece_on(square_is_empty(s1) ? s2 : s1) != side_to_move())
+              continue;
+
+          // Before or at the root the position must already be repeated
+          StateInfo* next = stp;
+
+          for (int k = i + 2; k <= end; k += 2)
+          {
+              next = next->previous->previous;
+              if (next->key == stp->key)
+                  return true;
+          }
+      }
+  }
+  return false;
+}
+
 /// Position::is_mate() returns true or false depending on whether the
 /// side to move is checkmated.
 
@@ -2616,6 +2882,44 @@ void Position::init_zobrist() {
 
   zobSideToMove = rk.rand<Key>();
   zobExclusion  = rk.rand<Key>();
+
+  // Fill the cuckoo tables, each move is inserted once for both directions
+  memset(Cuckoo, 0, sizeof(Cuckoo));
+  memset(CuckooMove, 0, sizeof(CuckooMove));
+
+  int count = 0;
+
+  for (Color c = WHITE; c <= BLACK; c++)
+      for (PieceType pt = KNIGHT; pt <= KING; pt++)
+          for (Square s1 = SQ_A1; s1 <= SQ_H8; s1++)
+              for (Square s2 = Square(s1 + 1); s2 <= SQ_H8; s2++)
+              {
+                  Bitboard b =  pt == BISHOP ? BishopPseudoAttacks[s1]
+                              : pt == ROOK   ? RookPseudoAttacks[s1]
+                              : pt == QUEEN  ? QueenPseudoAttacks[s1]
+                                             : StepAttacksBB[make_piece(c, pt)][s1];
+                  if (!bit_is_set(b, s2))
+                      continue;
+
+                  Move move = make_move(s1, s2);
+                  Key key = zobrist[c][pt][s1] ^ zobrist[c][pt][s2] ^ zobSideToMove;
+
+                  i = cuckoo_h1(key);
+
+                  while (true)
+                  {
+                      std::swap(Cuckoo[i], key);
+                      std::swap(CuckooMove[i], move);
+
+                      if (move == MOVE_NONE) // Arrived at an empty slot?
+                          break;
+
+                      i = (i == cuckoo_h1(key)) ? cuckoo_h2(key) : cuckoo_h1(key);
+                  }
+                  count++;
+              }
+
+  assert(count == 3668);
 }
 
 
@@ -2645,7 +2949,8 @@ void Position::flip() {
   assert(is_ok());
 
   // Make a copy of current position before to start changing
-  const Position pos(*this, threadID);
+  Position pos(*this, threadID);
+  pos.detach();
 
   clear();
   threadID = pos.thread();
@@ -26,14 +26,10 @@
 #include "atomicdata.h"
 #include "nnue.h"
 #include <assert.h>
+#include <deque>
 
 struct ExplosionData;
 
-/// Maximum number of plies per game (220 should be enough, because the
-/// maximum search depth is 100, and during position setup we reset the
-/// move counter for every non-reversible move).
-const int MaxGameLength = 220;
-
 class Position;
 
 /// struct checkInfo is initialized at c'tor time and keeps
@@ -72,21 +68,44 @@ enum Phase {
 /// must be passed as a parameter.
 
 struct StateInfo {
-  Key pawnKey, materialKey;							// 
-  int castleRights, rule50, gamePly, pliesFromNull;	// 
-  Square epSquare;									// -> ReducedStateInfo
-  Score value;										// 
-  Value npMaterial[2];								// 
-  nnue::Accumulators nnue;
 
+  // Copied by do_move(), see ReducedStateInfo
+  Key pawnKey, materialKey;
+  int castleRights, rule50, gamePly, pliesFromNull;
+  Square epSquare;
+  Score value;
+  Value npMaterial[2];
+
+  // Recomputed by do_move(). Together with the above these are the fields
+  // the search reads at every node and they fit in two cache lines.
   PieceType capturedType;
   NEW PieceType attackingType;	// stores the attacking piece, which is removed after attack
   Key key;
   Bitboard checkersBB;
-  NEW ExplosionData expl; 	// stores all explodes pieces
   StateInfo* previous;
+
+  // Only read by undo_move() and the NNUE update
+  NEW Bitboard blastBB[2];	// pieces of each color removed by the blast, the capture excluded
+  NEW ExplodedPieces expl;	// stores all exploded pieces
+  nnue::DirtyPieces dirty;
+  int nnueIndex;		// entry of the NNUE stack, -1 in a null move backup
+};
+
+
+/// The NNUE accumulators are not in StateInfo, which do_move() fills at every
+/// node, but on a stack of their own, one entry for each ply. The stack is
+/// allocated once for each thread slot and shared by the positions of that
+/// thread, an entry is theirs as long as it is tagged with their state. The
+/// entry of a state is only computed when the evaluation asks for it, see
+/// Position::nnue_accumulators().
+
+struct NnueEntry {
+  nnue::Accumulators accs;
+  const StateInfo* state; // The state the accumulators are computed for
 };
 
+const int NnueStackSize = 128; // A power of 2, more than PLY_MAX
+
 
 
 /// The position data structure. A position consists of the following data:
@@ -115,6 +134,7 @@ class Position {
 
   Position(); // No default or copy c'tor allowed
   Position(const Position& pos);
+  Position& operator=(const Position&);
 
 public:
   enum GamePhase {
@@ -125,6 +145,8 @@ public:
   // Constructors
   Position(const Position& pos, int threadID);
   Position(const std::string& fen, bool isChess960, int threadID);
+  ~Position();
+  void detach();
 
   // Text input/output
   void from_fen(const std::string& fen, bool isChess960);
@@ -194,6 +216,7 @@ public:
   static Bitboard attacks_from(Piece p, Square s, Bitboard occ);
   template<PieceType> Bitboard attacks_from(Square s) const;
   template<PieceType> Bitboard attacks_from(Square s, Color c) const;
+  NEW Bitboard explosion_threats(Color attacker) const;
 
   // Properties of moves
   bool pl_move_is_legal(Move m, Bitboard pinned) const;
@@ -210,10 +233,9 @@ public:
   // Piece captured with previous moves
   PieceType captured_piece_type() const;
 
-  // NNUE accumulator access (current state only)
-  const nnue::Accumulators& nnue_accumulators() const { return st->nnue; }
-  nnue::Accumulators& nnue_accumulators() { return st->nnue; }
-  void reset_nnue();
+  // NNUE accumulators of the current state
+  const nnue::Accumulators& nnue_accumulators() const;
+  void reset_nnue() const;
 
   // Information about pawns
   bool pawn_is_passed(Color c, Square s) const;
@@ -239,15 +261,18 @@ public:
   Key get_exclusion_key() const;
   Key get_pawn_key() const;
   Key get_material_key() const;
+  static Key material_zobrist(Color c, PieceType pt, int count);
 
   // Incremental evaluation
   Score value() const;
   Value non_pawn_material(Color c) const;
+  static Score pst(Color c, PieceType pt, Square s);
   static Score pst_delta(Piece piece, Square from, Square to);
 
   // Game termination checks
   bool is_mate() const;
   template<bool SkipRepetition> bool is_draw() const;
+  bool has_game_cycle(int ply) const;
 
   // Number of plies from starting position
   int startpos_ply_counter() const;
@@ -277,7 +302,7 @@ private:
 
   // Initialization helper functions (used while setting up a position)
   void clear();
-  void detach();
+  StateInfo* new_setup_state();
   void put_piece(Piece p, Square s);
   void do_allow_oo(Color c);
   void do_allow_ooo(Color c);
@@ -290,6 +315,7 @@ private:
   void do_castle_move(Move m);
   void undo_castle_move(Move m);
   void find_checkers();
+  void update_nnue() const;
 
   template<bool FindPinned>
   Bitboard hidden_checkers(Color c) const;
@@ -300,7 +326,6 @@ private:
   Key compute_material_key() const;
 
   // Computing incremental evaluation scores and material counts
-  static Score pst(Color c, PieceType pt, Square s);
   Score compute_value() const;
   Value compute_non_pawn_material(Color c) const;
 
@@ -335,7 +360,6 @@ private:
 
   // Other info
   Color sideToMove;
-  Key history[MaxGameLength];
   int castleRightsMask[64];
   StateInfo startState;
   File initialKFile, initialKRFile, initialQRFile;
@@ -344,13 +368,14 @@ private:
   int threadID;
   int64_t nodes;
   StateInfo* st;
+  NnueEntry* nnueStack;
+  const StateInfo* startSource; // Its accumulators are the ones of startState
+  std::deque<StateInfo>* setupStates;
   
 
   //ExplosionSquares miau;
   
   // Static variables
-  static ExplosionData captureList[MaxGameLength];
-  
   static Key zobrist[2][8][64];
   static Key zobEp[64];
   static Key zobCastle[16];
@@ -538,6 +563,10 @@ inline Key Position::get_material_key() const {
   return st->materialKey;
 }
 
+inline Key Position::material_zobrist(Color c, PieceType pt, int count) {
+  return zobrist[c][pt][count];
+}
+
 inline Score Position::pst(Color c, PieceType pt, Square s) {
   return PieceSquareTable[make_piece(c, pt)][s];
 }
@@ -595,6 +624,16 @@ inline PieceType Position::captured_piece_type() const {
   return st->capturedType;
 }
 
+inline const nnue::Accumulators& Position::nnue_accumulators() const {
+
+  NnueEntry* e = nnueStack + st->nnueIndex;
+
+  if (e->state != st)
+      update_nnue();
+
+  return e->accs;
+}
+
 inline int Position::thread() const {
   return threadID;
 }
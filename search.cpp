@@ -17,7 +17,7 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#undef TEST_VERSION
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstring>
@@ -33,6 +33,7 @@
 #include "move.h"
 #include "movegen.h"
 #include "movepick.h"
+#include "rkiss.h"
 #include "search.h"
 #include "timeman.h"
 #include "thread.h"
@@ -41,16 +42,11 @@
 
 #include "atomicdata.h"
 #include "debug.h"
-#include "main.h"
 #include "create_book.h"
 
 using std::cout;
 using std::endl;
 
-NEW // stdin_fake acts as stdin for the poll function to manipulate uci commands
-NEW // that way we can simulate stop, quit or ponderhit commands while thinking
-NEW std::stringstream stdin_fake;
-
 namespace {
 
   // Set to true to force running with one thread. Used for debugging
@@ -59,7 +55,6 @@ namespace {
   // Different node types, used as template parameter
   enum NodeType { NonPV, PV };
 
-  int64_t HACK_NPS;
   // RootMove struct is used for moves at the root of the tree. For each root
   // move, we store two scores, a node count, and a PV (really a refutation
   // in the case of moves which fail low). Value pv_score is normally set at
@@ -149,9 +144,8 @@ namespace {
   // Maximum depth for razoring
   const Depth RazorDepth = 4 * ONE_PLY;
 
-  // Dynamic razoring margin based on depth
+  // Dynamic razoring margin based on depth, see razor_margin() below
   //OLD inline Value razor_margin(Depth d) { return Value(0x200 + 0x10 * int(d)); }
-  NEW inline Value razor_margin(Depth d) { return Value(int(0x200 + 0x10 * int(d))); }
   //NEW 0x200 * 0.75f
 
   // Maximum depth for use of dynamic threat detection when null move fails low
@@ -163,8 +157,8 @@ namespace {
   const Depth IIDDepth[] = { 8 * ONE_PLY, 5 * ONE_PLY };
 
   // At Non-PV nodes we do an internal iterative deepening search
-  // when the static evaluation is bigger then beta - IIDMargin.
-  const Value IIDMargin = Value(0x100);
+  // when the static evaluation is bigger then beta - IIDMargin, a
+  // tunable parameter of the search context.
 
   // Step 11. Decide the new search depth
 
@@ -179,40 +173,46 @@ namespace {
 
   // Step 12. Futility pruning
 
-  // Futility margin for quiescence search
-  const Value FutilityMarginQS = Value(0x80);
+  // The futility margins, for quiescence search too, and the futility move
+  // counts are tunable, they are kept in the search context.
 
-  // Futility lookup tables (initialized at startup) and their access functions
-  Value FutilityMargins[16][64]; // [depth][moveNumber]
-  int FutilityMoveCounts[32];    // [depth]
+  // Step 14. Reduced search
 
-  inline Value futility_margin(Depth d, int mn) {
+  // Reductions are tunable too, their lookup table is in the search context
 
-    return d < 7 * ONE_PLY ? FutilityMargins[Max(d, 1)][Min(mn, 63)]
-                           : 2 * VALUE_INFINITE;
-  }
+  // Easy move margin. An easy move candidate must be at least this much
+  // better than the second best move.
+  const Value EasyMoveMargin = Value(0x200);
 
-  inline int futility_move_count(Depth d) {
 
-    return d < 16 * ONE_PLY ? FutilityMoveCounts[d] : MAX_MOVES;
-  }
+} // namespace
 
-  // Step 14. Reduced search
 
-  // Reduction lookup tables (initialized at startup) and their access function
-  int8_t Reductions[2][64][64]; // [pv][depth][moveNumber]
+/// SearchContext keeps together the state of one search: the root moves,
+/// the limits and the time manager, the history table, the stop flags and
+/// the options of the time manager and of the evaluation.
+/// The UCI search runs in the main context with the global TT, other
+/// searches, like the games of the match runner, can run in their own
+/// contexts at the same time from different threads.
 
-  template <NodeType PV> inline Depth reduction(Depth d, int mn) {
+struct SearchContext {
 
-    return (Depth) Reductions[PV][Min(d / ONE_PLY, 63)][Min(mn, 63)];
-  }
+  SearchContext(TranspositionTable* t) : tt(t), silent(false), callback(NULL), callbackData(NULL),
+                                         masterThread(0), StopRequest(false), PendingStop(false),
+                                         lastInfoTime(0), NodesBetweenPolls(30000) {}
 
-  // Easy move margin. An easy move candidate must be at least this much
-  // better than the second best move.
-  const Value EasyMoveMargin = Value(0x200);
+  // Transposition table used by the search
+  TranspositionTable* tt;
 
+  // When silent nothing is sent to the GUI
+  bool silent;
 
-  /// Namespace variables
+  // Called at the end of each iteration, if set
+  SearchCallback callback;
+  void* callbackData;
+
+  // Thread that polls for input and checks the time
+  int masterThread;
 
   // Root move list
   RootMoveList Rml;
@@ -220,10 +220,16 @@ namespace {
   // MultiPV mode
   int MultiPV, UCIMultiPV;
 
-  // Time management variables
-  bool StopOnPonderhit, FirstRootMove, StopRequest, QuitRequest, AspirationFailLow;
+  // Time management variables. StopRequest can be raised by stop_search()
+  // from another thread, PendingStop keeps it for a search not started yet.
+  bool StopOnPonderhit, FirstRootMove, QuitRequest, AspirationFailLow;
+  std::atomic<bool> StopRequest, PendingStop;
+  TimeOptions TimeOpts;
   TimeManager TimeMgr;
   SearchLimits Limits;
+  int64_t searchStartTime, cpuUsageStart;
+  int lastInfoTime;
+  int64_t HACK_NPS;
 
   // Log file
   std::ofstream LogFile;
@@ -231,16 +237,59 @@ namespace {
   // Skill level adjustment
   int SkillLevel;
   bool SkillLevelEnabled;
+  RKISS rk;
 
-  // Node counters, used only by thread[0] but try to keep in different cache
-  // lines (64 bytes each) from the heavy multi-thread read accessed variables.
+  // Node counters, used only by the master thread
   bool SendSearchedNodes;
   int NodesSincePoll;
-  int NodesBetweenPolls = 30000;
+  int NodesBetweenPolls;
 
   // History table
   History H;
 
+  // Evaluation options and the weights computed from them for the side to
+  // move at the root, by search_move()
+  EvalOptions EvalOpts;
+  EvalWeights Weights;
+
+  // Tunable parameters and the lookup tables computed from them
+  double Params[SEARCH_PARAM_NB];
+  Value RazorMargin, RazorMarginSlope, FutilityMarginQS, IIDMargin;
+  Value FutilityMargins[16][64]; // [depth][moveNumber]
+  int FutilityMoveCounts[32];    // [depth]
+  int8_t Reductions[2][64][64];  // [pv][depth][moveNumber]
+};
+
+
+namespace {
+
+  /// Namespace variables
+
+  // Context of the UCI search and context of the calling thread. Helper
+  // threads of the UCI search keep the default.
+  SearchContext MainContext(&TT);
+  THREAD_LOCAL SearchContext* Ctx = &MainContext;
+
+  // Access functions to the tunable margins and lookup tables
+
+  inline Value razor_margin(Depth d) { return Value(int(Ctx->RazorMargin + Ctx->RazorMarginSlope * int(d))); }
+
+  inline Value futility_margin(Depth d, int mn) {
+
+    return d < 7 * ONE_PLY ? Ctx->FutilityMargins[Max(d, 1)][Min(mn, 63)]
+                           : 2 * VALUE_INFINITE;
+  }
+
+  inline int futility_move_count(Depth d) {
+
+    return d < 16 * ONE_PLY ? Ctx->FutilityMoveCounts[d] : MAX_MOVES;
+  }
+
+  template <NodeType PV> inline Depth reduction(Depth d, int mn) {
+
+    return (Depth) Ctx->Reductions[PV][Min(d / ONE_PLY, 63)][Min(mn, 63)];
+  }
+
 
   /// Local functions
 
@@ -272,6 +321,7 @@ namespace {
   void update_history(const Position& pos, Move move, Depth depth, Move movesSearched[], int moveCount);
   void update_gains(const Position& pos, Move move, Value before, Value after);
   void do_skill_level(Move* best, Move* ponder);
+  void start_search(Position& pos, const SearchLimits& limits);
 
   int64_t current_search_time(int64_t set = 0);
   int64_t current_cpu_usage(int64_t set = 0);
@@ -305,30 +355,94 @@ namespace {
 } // namespace
 
 
+/// SearchParams[] lists the tunable parameters of the search with their UCI
+/// option names, defaults and bounds. The ones of the form "Xxx Divisor",
+/// "Base" or "Scale" of the move counts and reductions are in hundredths.
+
+const SearchParamInfo SearchParams[SEARCH_PARAM_NB] = {
+  { "Razor Margin",               512, 0, 2048 },
+  { "Razor Margin Slope",          16, 0,  128 },
+  { "Futility Margin",            112, 0,  512 },
+  { "Futility Margin Base",        45, 0,  512 },
+  { "Futility Margin Slope",        8, 0,   64 },
+  { "Futility Margin QS",         128, 0,  512 },
+  { "Futility Move Count Base",   300, 0, 1600 },
+  { "Futility Move Count Scale",   25, 0,  200 },
+  { "Reduction PV Divisor",       300, 50, 1000 },
+  { "Reduction NonPV Base",        33, 0,  200 },
+  { "Reduction NonPV Divisor",    225, 50, 1000 },
+  { "IID Margin",                 256, 0, 1024 }
+};
+
+
 /// init_search() is called during startup to initialize various lookup tables
 
 void init_search() {
 
+  set_search_options(&MainContext, 20, NULL);
+}
+
+
+/// set_search_options() sets the skill level and the tunable parameters,
+/// NULL for the defaults, of a search context and rebuilds its lookup tables.
+/// Parameters are clamped to the bounds of their UCI option. The ones used as
+/// integers are rounded to the nearest, so that the probes of the tuner at
+/// the same distance above and below a value stay symmetrical.
+
+void set_search_options(SearchContext* ctx, int skillLevel, const double params[]) {
+
   int d;  // depth (ONE_PLY == 2)
   int hd; // half depth (ONE_PLY == 1)
   int mc; // moveCount
+  double* p = ctx->Params;
+  int r[SEARCH_PARAM_NB];
+
+  ctx->SkillLevel = skillLevel;
+
+  for (int i = 0; i < SEARCH_PARAM_NB; i++)
+      p[i] = Max(double(SearchParams[i].minValue),
+                 Min(params ? params[i] : SearchParams[i].defaultValue, double(SearchParams[i].maxValue)));
+
+  for (int i = 0; i < SEARCH_PARAM_NB; i++)
+      r[i] = int(floor(p[i] + 0.5));
+
+  ctx->RazorMargin      = Value(r[RAZOR_MARGIN]);
+  ctx->RazorMarginSlope = Value(r[RAZOR_MARGIN_SLOPE]);
+  ctx->FutilityMarginQS = Value(r[FUTILITY_MARGIN_QS]);
+  ctx->IIDMargin        = Value(r[IID_MARGIN]);
 
   // Init reductions array
+  memset(ctx->Reductions, 0, sizeof(ctx->Reductions));
+
   for (hd = 1; hd < 64; hd++) for (mc = 1; mc < 64; mc++)
   {
-      double    pvRed = log(double(hd)) * log(double(mc)) / 3.0;
-      double nonPVRed = 0.33 + log(double(hd)) * log(double(mc)) / 2.25;
-      Reductions[PV][hd][mc]    = (int8_t) (   pvRed >= 1.0 ? floor(   pvRed * int(ONE_PLY)) : 0);
-      Reductions[NonPV][hd][mc] = (int8_t) (nonPVRed >= 1.0 ? floor(nonPVRed * int(ONE_PLY)) : 0);
+      double    pvRed = log(double(hd)) * log(double(mc)) / (p[REDUCTION_PV_DIVISOR] / 100);
+      double nonPVRed = p[REDUCTION_NONPV_BASE] / 100 + log(double(hd)) * log(double(mc)) / (p[REDUCTION_NONPV_DIVISOR] / 100);
+      ctx->Reductions[PV][hd][mc]    = (int8_t) Min(   pvRed >= 1.0 ? floor(   pvRed * int(ONE_PLY)) : 0, 127.0);
+      ctx->Reductions[NonPV][hd][mc] = (int8_t) Min(nonPVRed >= 1.0 ? floor(nonPVRed * int(ONE_PLY)) : 0, 127.0);
   }
 
   // Init futility margins array
   for (d = 1; d < 16; d++) for (mc = 0; mc < 64; mc++)
-      FutilityMargins[d][mc] = Value(112 * int(log(double(d * d) / 2) / log(2.0) + 1.001) - 8 * mc + 45);
+      ctx->FutilityMargins[d][mc] = Value(  r[FUTILITY_MARGIN] * int(log(double(d * d) / 2) / log(2.0) + 1.001)
+                                          - r[FUTILITY_MARGIN_SLOPE] * mc + r[FUTILITY_MARGIN_BASE]);
 
   // Init futility move count array
   for (d = 0; d < 32; d++)
-      FutilityMoveCounts[d] = int(3.001 + 0.25 * pow(d, 2.0));
+      ctx->FutilityMoveCounts[d] = int(p[FUTILITY_MOVE_COUNT_BASE] / 100 + 0.001 + p[FUTILITY_MOVE_COUNT_SCALE] / 100 * pow(d, 2.0));
+}
+
+
+/// set_engine_options() sets the options of the time manager and of the
+/// evaluation of a search context. The context of the UCI search reads the
+/// UCI options instead.
+
+void set_engine_options(SearchContext* ctx, const TimeOptions& time, const EvalOptions& eval) {
+
+  assert(ctx != &MainContext);
+
+  ctx->TimeOpts = time;
+  ctx->EvalOpts = eval;
 }
 
 
@@ -363,6 +477,156 @@ int64_t perft(Position& pos, Depth depth) {
 }
 
 
+namespace {
+
+  // PerftEntry is a slot of the perft hash table. Entries are written without
+  // locks, the key is stored xor'ed with the data so that a torn write by two
+  // threads at the same time is detected on probe and simply ignored.
+
+  struct PerftEntry {
+    Key key;
+    uint64_t data; // Leaf count in the upper 56 bits, depth in plies in the lower 8
+  };
+
+  PerftEntry* PerftTable = NULL;
+  size_t PerftTableMask;
+
+  // Work shared between the perft threads. Root moves are handed out one at a
+  // time, so that a thread stuck on a big subtree does not hold up the others.
+  struct PerftSplit {
+    const Position* pos;
+    Depth depth;
+    MoveStack* mlist;
+    int64_t* counts;
+    int moveCount;
+    int nextMove;
+    Lock lock;
+  };
+
+  PerftSplit PS;
+
+  // perft_hashed() is perft() with a lookup in the perft hash table at every
+  // interior node. Leaves and frontier nodes are not hashed, counting the
+  // legal moves there is cheaper than a cache miss.
+
+  int64_t perft_hashed(Position& pos, Depth depth) {
+
+    MoveStack mlist[MAX_MOVES];
+    StateInfo st;
+    Move m;
+    int64_t sum = 0;
+
+    MoveStack* last = generate<MV_LEGAL>(pos, mlist);
+
+    if (depth <= ONE_PLY)
+        return int(last - mlist);
+
+    const Key key = pos.get_key();
+    const uint64_t d = uint64_t(depth / ONE_PLY);
+    PerftEntry* tte = PerftTable ? PerftTable + (key & PerftTableMask) : NULL;
+
+    if (tte)
+    {
+        uint64_t data = tte->data;
+        if ((tte->key ^ data) == key && (data & 0xFF) == d)
+            return int64_t(data >> 8);
+    }
+
+    CheckInfo ci(pos);
+    for (MoveStack* cur = mlist; cur != last; cur++)
+    {
+        m = cur->move;
+        pos.do_move(m, st, ci, pos.move_gives_check(m, ci));
+        sum += perft_hashed(pos, depth - ONE_PLY);
+        pos.undo_move(m);
+    }
+
+    if (tte)
+    {
+        uint64_t data = (uint64_t(sum) << 8) | d;
+        tte->key = key ^ data;
+        tte->data = data;
+    }
+    return sum;
+  }
+
+  // perft_worker() is run by every perft thread. It keeps taking the next
+  // unsearched root move until the list is exhausted.
+
+  void perft_worker(int, int threadID) {
+
+    Position pos(*PS.pos, threadID);
+    pos.detach();
+    CheckInfo ci(pos);
+    StateInfo st;
+    Move m;
+    int idx;
+
+    while (true)
+    {
+        lock_grab(&PS.lock);
+        idx = PS.nextMove++;
+        lock_release(&PS.lock);
+
+        if (idx >= PS.moveCount)
+            break;
+
+        m = PS.mlist[idx].move;
+        pos.do_move(m, st, ci, pos.move_gives_check(m, ci));
+        PS.counts[idx] = PS.depth > ONE_PLY ? perft_hashed(pos, PS.depth - ONE_PLY) : 1;
+        pos.undo_move(m);
+    }
+  }
+
+} // namespace
+
+/// perft_divide() is the multi-threaded version of perft(). Root moves are
+/// shared among 'threads' threads and the subtrees below them are looked up
+/// in a perft hash table of 'hashMB' megabytes (zero disables hashing). On
+/// return mlist[] holds the legal root moves and counts[] their leaf counts,
+/// the number of root moves is returned.
+
+int perft_divide(const Position& pos, Depth depth, int threads, int hashMB,
+                 MoveStack* mlist, int64_t* counts) {
+
+  assert(depth >= ONE_PLY);
+
+  PS.pos = &pos;
+  PS.depth = depth;
+  PS.mlist = mlist;
+  PS.counts = counts;
+  PS.moveCount = int(generate<MV_LEGAL>(pos, mlist) - mlist);
+  PS.nextMove = 0;
+  lock_init(&PS.lock);
+
+  if (hashMB > 0)
+  {
+      size_t n = 1;
+      while (2 * n * sizeof(PerftEntry) <= (size_t(hashMB) << 20))
+          n *= 2;
+
+      PerftTable = new (std::nothrow) PerftEntry[n];
+      if (PerftTable)
+      {
+          memset(PerftTable, 0, n * sizeof(PerftEntry));
+          PerftTableMask = n - 1;
+      }
+      else
+          cout << "Failed to allocate " << hashMB << "MB for perft hash table." << endl;
+  }
+
+  threads = Max(1, Min(threads, Min(MAX_THREADS - 1, PS.moveCount)));
+
+  Threads.run_workers(perft_worker, threads);
+
+  delete [] PerftTable;
+  PerftTable = NULL;
+  lock_destroy(&PS.lock);
+
+  return PS.moveCount;
+}
+
+
 /// think() is the external interface to Stockfish's search, and is called when
 /// the program receives the UCI 'go' command. It initializes various global
 /// variables, and calls id_loop(). It returns false when a "quit" command is
@@ -374,30 +638,8 @@ bool think(Position& pos, const SearchLimits& limits, Move searchMoves[], Move&
   static Book book;
 
   // Initialize global search-related variables
-  StopOnPonderhit = StopRequest = QuitRequest = AspirationFailLow = SendSearchedNodes = false;
-  NodesSincePoll = 0;
-  current_search_time(get_system_time());
-  current_cpu_usage(get_cpu_usage());
-  Limits = limits;
-  TimeMgr.init(Limits, pos.startpos_ply_counter());
-  
-  NEW pos.set_nodes_searched(0);
-  HACK_NPS = 0;
-
-  NEW // when debugging we want more polls
-#ifdef NDEBUG
-  // Set best NodesBetweenPolls interval to avoid lagging under time pressure
-  if (Limits.maxNodes)
-      NodesBetweenPolls = Min(Limits.maxNodes, 30000);
-  else if (Limits.time && Limits.time < 1000)
-      NodesBetweenPolls = 1000;
-  else if (Limits.time && Limits.time < 5000)
-      NodesBetweenPolls = 5000;
-  else
-      NodesBetweenPolls = 30000;
-#else
-  NodesBetweenPolls = 1000;
-#endif
+  Ctx->TimeOpts.read_uci_options();
+  start_search(pos, limits);
 
   // Look for a book move
   if (Options["OwnBook"].value<bool>())
@@ -408,38 +650,45 @@ bool think(Position& pos, const SearchLimits& limits, Move searchMoves[], Move&
       Move bookMove = book.get_move(pos, Options["Best Book Move"].value<bool>());
       if (bookMove != MOVE_NONE)
       {
-          if (Limits.ponder)
+          if (Ctx->Limits.ponder)
               wait_for_stop_or_ponderhit();
           
           NEW NEW_bestMove = bookMove;
-#if !defined TEST_VERSION
           cout << "bestmove " << move_to_uci(pos, bookMove, pos.is_chess960()) << endl;
-#endif
-          return !QuitRequest;
+          return !Ctx->QuitRequest;
       }
   }
 
   // Read UCI options
-  UCIMultiPV = Options["MultiPV"].value<int>();
-  SkillLevel = Options["Skill Level"].value<int>();
+  Ctx->UCIMultiPV = Options["MultiPV"].value<int>();
+  Ctx->SkillLevel = Options["Skill Level"].value<int>();
+
+  // Rebuild the lookup tables only if a search parameter has been changed
+  double params[SEARCH_PARAM_NB];
+
+  for (int i = 0; i < SEARCH_PARAM_NB; i++)
+      params[i] = Options[SearchParams[i].name].value<int>();
+
+  if (memcmp(params, Ctx->Params, sizeof(params)))
+      set_search_options(Ctx, Ctx->SkillLevel, params);
 
   read_evaluation_uci_options(pos.side_to_move());
   Threads.read_uci_options();
 
   // If needed allocate pawn and material hash tables and adjust TT size
   Threads.init_hash_tables();
-  TT.set_size(Options["Hash"].value<int>());
+  Ctx->tt->set_size(Options["Hash"].value<int>());
 
   if (Options["Clear Hash"].value<bool>())
   {
       Options["Clear Hash"].set_value("false");
-      TT.clear();
+      Ctx->tt->clear();
   }
   
   // Do we have to play with skill handicap? In this case enable MultiPV that
   // we will use behind the scenes to retrieve a set of possible moves.
-  SkillLevelEnabled = (SkillLevel < 20);
-  MultiPV = (SkillLevelEnabled ? Max(UCIMultiPV, 4) : UCIMultiPV);
+  Ctx->SkillLevelEnabled = (Ctx->SkillLevel < 20);
+  Ctx->MultiPV = (Ctx->SkillLevelEnabled ? Max(Ctx->UCIMultiPV, 4) : Ctx->UCIMultiPV);
 
   // Wake up needed threads and reset maxPly counter
   for (int i = 0; i < Threads.size(); i++)
@@ -452,16 +701,16 @@ bool think(Position& pos, const SearchLimits& limits, Move searchMoves[], Move&
   if (Options["Use Search Log"].value<bool>())
   {
       std::string name = Options["Search Log Filename"].value<std::string>();
-      LogFile.open(name.c_str(), std::ios::out | std::ios::app);
-
-      if (LogFile.is_open())
-          LogFile << "\nSearching: "  << pos.to_fen()
-                  << "\ninfinite: "   << Limits.infinite
-                  << " ponder: "      << Limits.ponder
-                  << " time: "        << Limits.time
-                  << " increment: "   << Limits.increment
-                  << " moves to go: " << Limits.movesToGo
-                  << endl;
+      Ctx->LogFile.open(name.c_str(), std::ios::out | std::ios::app);
+
+      if (Ctx->LogFile.is_open())
+          Ctx->LogFile << "\nSearching: "  << pos.to_fen()
+                       << "\ninfinite: "   << Ctx->Limits.infinite
+                       << " ponder: "      << Ctx->Limits.ponder
+                       << " time: "        << Ctx->Limits.time
+                       << " increment: "   << Ctx->Limits.increment
+                       << " moves to go: " << Ctx->Limits.movesToGo
+                       << endl;
   }
 
   // We're ready to start thinking. Call the iterative deepening loop function
@@ -470,26 +719,24 @@ bool think(Position& pos, const SearchLimits& limits, Move searchMoves[], Move&
   NEW NEW_bestMove = bestMove; 
   NEW NEW_ponderMove = ponderMove;
 
-#if !defined BOOK_VERSION && !defined TEST_VERSION
   cout << "info" << speed_to_uci(pos.nodes_searched()) << endl;
-#endif
   
   //NEW cout << "test0" << endl;
   
   // Write final search statistics and close log file
-  if (LogFile.is_open())
+  if (Ctx->LogFile.is_open())
   {
       int64_t t = current_search_time();
 
-      LogFile << "Nodes: "          << pos.nodes_searched()
-              << "\nNodes/second: " << (t > 0 ? pos.nodes_searched() * 1000 / t : 0)
-              << "\nBest move: "    << move_to_san(pos, bestMove);
+      Ctx->LogFile << "Nodes: "          << pos.nodes_searched()
+                   << "\nNodes/second: " << (t > 0 ? pos.nodes_searched() * 1000 / t : 0)
+                   << "\nBest move: "    << move_to_san(pos, bestMove);
 
       StateInfo st;
       pos.do_move(bestMove, st);
-      LogFile << "\nPonder move: " << move_to_san(pos, ponderMove) << endl;
+      Ctx->LogFile << "\nPonder move: " << move_to_san(pos, ponderMove) << endl;
       pos.undo_move(bestMove); // Return from think() with unchanged position
-      LogFile.close();
+      Ctx->LogFile.close();
   }
   //NEW cout << "test1" << endl;
   // This makes all the threads to go to sleep
@@ -497,7 +744,7 @@ bool think(Position& pos, const SearchLimits& limits, Move searchMoves[], Move&
   //NEW cout << "test2" << endl;
   // If we are pondering or in infinite search, we shouldn't print the
   // best move before we are told to do so.
-  if (!StopRequest && (Limits.ponder || Limits.infinite))
+  if (!Ctx->StopRequest && (Ctx->Limits.ponder || Ctx->Limits.infinite))
       wait_for_stop_or_ponderhit();
   //NEW cout << "test3" << endl;
 
@@ -517,7 +764,112 @@ bool think(Position& pos, const SearchLimits& limits, Move searchMoves[], Move&
   cout << endl;
 
   //NEW cout << "test4" << endl;
-  return !QuitRequest;
+  return !Ctx->QuitRequest;
+}
+
+
+/// create_search_context() allocates a context for searches that do not go
+/// through think(), with its own history and time manager, searching in the
+/// given transposition table. Skill level, parameters and the options of the
+/// time manager and the evaluation are the default ones until changed with
+/// set_search_options() and set_engine_options().
+
+SearchContext* create_search_context(TranspositionTable* tt) {
+
+  SearchContext* ctx = new SearchContext(tt);
+
+  ctx->silent = true;
+  set_search_options(ctx, 20, NULL);
+  set_engine_options(ctx, TimeOptions(), EvalOptions());
+  return ctx;
+}
+
+void delete_search_context(SearchContext* ctx) {
+
+  assert(ctx != &MainContext);
+
+  delete ctx;
+}
+
+
+/// set_search_context() makes the following searches of the calling thread
+/// run in the given context, NULL restores the context of the UCI search.
+/// Returns the previous context of the thread.
+
+SearchContext* set_search_context(SearchContext* ctx) {
+
+  SearchContext* previous = Ctx;
+
+  Ctx = ctx ? ctx : &MainContext;
+  use_evaluation_weights(ctx ? &ctx->Weights : NULL);
+  return previous;
+}
+
+
+/// set_search_callback() sets the function called with the result of each
+/// iteration of the searches in a context, NULL for none.
+
+void set_search_callback(SearchContext* ctx, SearchCallback callback, void* data) {
+
+  ctx->callback = callback;
+  ctx->callbackData = data;
+}
+
+
+/// stop_search() asks the search running in a context, from any thread, to
+/// return as soon as possible with the best move found so far. When called
+/// just before the search starts, the search returns at once.
+
+void stop_search(SearchContext* ctx) {
+
+  ctx->PendingStop = true;
+  ctx->StopRequest = true;
+}
+
+
+/// search_move() searches the position in the context of the calling thread
+/// and returns the best move, and its score in *score. Unlike think() it does
+/// not look into the book, does not read the UCI options, nor it prints
+/// anything, so that many searches can run at the same time, each in its own
+/// thread and context. The thread of the position must be a slot taken with
+/// acquire_slot(), not one of the threads of the UCI search, and the search
+/// is not split.
+
+Move search_move(Position& pos, const SearchLimits& limits, Value* score) {
+
+  Move searchMoves[] = { MOVE_NONE };
+  Move ponderMove;
+  int threadID = pos.thread();
+
+  assert(Ctx != &MainContext);
+  assert(threadID >= MAX_THREADS);
+
+  start_search(pos, limits);
+  Ctx->Limits.ignoreInput = true;
+  Ctx->Limits.ponder = false;
+  Ctx->masterThread = threadID;
+  Ctx->UCIMultiPV = 1;
+  Ctx->SkillLevelEnabled = (Ctx->SkillLevel < 20);
+  Ctx->MultiPV = (Ctx->SkillLevelEnabled ? 4 : 1);
+
+  // King safety is asymmetrical, the weights are the ones of the side to move
+  set_evaluation_weights(Ctx->Weights, Ctx->EvalOpts, pos.side_to_move());
+
+  // The thread could have been a slave of an old UCI search, forget its
+  // split point so that cutoff_occurred() does not look at it.
+  Threads[threadID].splitPoint = NULL;
+  Threads[threadID].maxPly = 0;
+
+  Move bestMove = id_loop(pos, searchMoves, &ponderMove);
+
+  // A stop from now on is for the next search
+  Ctx->PendingStop = false;
+
+  if (score)
+      *score = bestMove != MOVE_NONE ? Ctx->Rml[0].pv_score
+             : pos.in_check() ? -VALUE_MATE : VALUE_DRAW;
+
+  return bestMove;
 }
 
 
@@ -538,40 +890,40 @@ namespace {
     Move bestMove, easyMove, skillBest, skillPonder;
 
     // Initialize stuff before a new search
-    memset(ss, 0, 4 * sizeof(SearchStack));
-    TT.new_search();
-    H.clear();
+    memset(ss, 0, PLY_MAX_PLUS_2 * sizeof(SearchStack));
+    Ctx->tt->new_search();
+    Ctx->H.clear();
     *ponderMove = bestMove = easyMove = skillBest = skillPonder = MOVE_NONE;
     depth = aspirationDelta = 0;
     alpha = -VALUE_INFINITE, beta = VALUE_INFINITE;
-    OLD // ERROR: ss->currentMove = MOVE_NULL; // Hack to skip update_gains()
-    NEW ss[0].currentMove = MOVE_NULL; // Hack to skip update_gains()
+    ss->currentMove = MOVE_NULL; // Hack to skip update_gains()
 
     // Moves to search are verified and copied
-    Rml.init(pos, searchMoves);
+    Ctx->Rml.init(pos, searchMoves);
 
-#if !defined FICS_VERSION && !defined BOOK_VERSION && !defined TEST_VERSION
     // Handle special case of searching on a mate/stalemate position
-    if (Rml.size() == 0)
+    if (Ctx->Rml.size() == 0)
     {
-        cout << "info depth 0 score "
-             << value_to_uci(pos.in_check() ? -VALUE_MATE : VALUE_DRAW)
-             << endl;
+        if (!Ctx->silent)
+            cout << "info depth 0 score "
+                 << value_to_uci(pos.in_check() ? -VALUE_MATE : VALUE_DRAW)
+                 << endl;
 
         return MOVE_NONE;
     }
-#endif
+
+    // A search stopped before the first iteration still returns a legal move
+    bestMove = Ctx->Rml[0].pv[0];
 
     // Iterative deepening loop until requested to stop or target depth reached
-    while (!StopRequest && ++depth <= PLY_MAX && (!Limits.maxDepth || depth <= Limits.maxDepth))
+    while (!Ctx->StopRequest && ++depth <= PLY_MAX && (!Ctx->Limits.maxDepth || depth <= Ctx->Limits.maxDepth))
     {
-        Rml.bestMoveChanges = 0;
-#ifdef UCI_VERSION
-        cout << set960(pos.is_chess960()) << "info depth " << depth << endl;
-#endif
+        Ctx->Rml.bestMoveChanges = 0;
+        if (!Ctx->silent)
+            cout << set960(pos.is_chess960()) << "info depth " << depth << endl;
 
         // Calculate dynamic aspiration window based on previous iterations
-        if (MultiPV == 1 && depth >= 5 && abs(bestValues[depth - 1]) < VALUE_KNOWN_WIN)
+        if (Ctx->MultiPV == 1 && depth >= 5 && abs(bestValues[depth - 1]) < VALUE_KNOWN_WIN)
         {
             int prevDelta1 = bestValues[depth - 1] - bestValues[depth - 2];
             int prevDelta2 = bestValues[depth - 2] - bestValues[depth - 3];
@@ -588,20 +940,22 @@ namespace {
         // research with bigger window until not failing high/low anymore.
         do {
         	
-#ifdef BOOK_VERSION
-        	NEW book_moves = std::vector<MoveStack>(book_moves_aux);
-        	NEW book_moves_aux.clear();
-#endif
+        	// The root moves of the last search are kept for createBookEAO()
+        	if (Ctx->Limits.collectRootMoves)
+        	{
+        	    book_moves = book_moves_aux;
+        	    book_moves_aux.clear();
+        	}
             // Search starting from ss+1 to allow calling update_gains()
             value = search<PV, false, true>(pos, ss+1, alpha, beta, depth * ONE_PLY);
 
             // Write PV back to transposition table in case the relevant entries
             // have been overwritten during the search.
-            for (int i = 0; i < Min(MultiPV, (int)Rml.size()); i++)
-                Rml[i].insert_pv_in_tt(pos);
+            for (int i = 0; i < Min(Ctx->MultiPV, (int)Ctx->Rml.size()); i++)
+                Ctx->Rml[i].insert_pv_in_tt(pos);
 
             // Value cannot be trusted. Break out immediately!
-            if (StopRequest)
+            if (Ctx->StopRequest)
                 break;
 
             assert(value >= alpha);
@@ -615,8 +969,8 @@ namespace {
             }
             else if (value <= alpha)
             {
-                AspirationFailLow = true;
-                StopOnPonderhit = false;
+                Ctx->AspirationFailLow = true;
+                Ctx->StopOnPonderhit = false;
 
                 alpha = Max(alpha - aspirationDelta, -VALUE_INFINITE);
                 aspirationDelta += aspirationDelta / 2;
@@ -627,92 +981,100 @@ namespace {
         } while (abs(value) < VALUE_KNOWN_WIN);
 
         // Collect info about search result
-        bestMove = Rml[0].pv[0];
-        *ponderMove = Rml[0].pv[1];
+        bestMove = Ctx->Rml[0].pv[0];
+        *ponderMove = Ctx->Rml[0].pv[1];
         bestValues[depth] = value;
-        bestMoveChanges[depth] = Rml.bestMoveChanges;
+        bestMoveChanges[depth] = Ctx->Rml.bestMoveChanges;
 
         // Do we need to pick now the best and the ponder moves ?
-        if (SkillLevelEnabled && depth == 1 + SkillLevel)
+        if (Ctx->SkillLevelEnabled && depth == 1 + Ctx->SkillLevel)
             do_skill_level(&skillBest, &skillPonder);
 
-        // Retrieve max searched depth among threads
-        selDepth = 0;
-        for (int i = 0; i < Threads.size(); i++)
+        // Retrieve max searched depth among the threads of the search, a
+        // search in its own context has only its master thread.
+        selDepth = Threads[Ctx->masterThread].maxPly;
+        for (int i = 0; Ctx == &MainContext && i < Threads.size(); i++)
             if (Threads[i].maxPly > selDepth)
                 selDepth = Threads[i].maxPly;
 
         // Send PV line to GUI and to log file
 
-        for (int i = 0; i < Min(UCIMultiPV, (int)Rml.size()); i++) {
-            cout << Rml[i].pv_info_to_uci(pos, depth, selDepth, alpha, beta, i) << endl;
+        for (int i = 0; !Ctx->silent && i < Min(Ctx->UCIMultiPV, (int)Ctx->Rml.size()); i++) {
+            cout << Ctx->Rml[i].pv_info_to_uci(pos, depth, selDepth, alpha, beta, i) << endl;
         }   
 
-        
-        STARTNEW
-#ifdef ANALYZE_VERSION
-        if (UCIMultiPV > 1) {
-        	cout << "-----------------------------" << endl;
+        // And to the callback of the context
+        if (Ctx->callback)
+        {
+            SearchInfo info;
+
+            info.depth = depth;
+            info.selDepth = selDepth;
+            info.score = Ctx->Rml[0].pv_score;
+            info.nodes = pos.nodes_searched();
+            info.time = int(current_search_time());
+
+            int i = 0;
+            for ( ; i < PLY_MAX && Ctx->Rml[0].pv[i] != MOVE_NONE; i++)
+                info.pv[i] = Ctx->Rml[0].pv[i];
+
+            info.pv[i] = MOVE_NONE;
+            Ctx->callback(info, Ctx->callbackData);
         }
-#endif
-        ENDNEW
 
-        if (LogFile.is_open())
-            LogFile << pretty_pv(pos, depth, value, current_search_time(), Rml[0].pv) << endl;
+        
+        if (Ctx->LogFile.is_open())
+            Ctx->LogFile << pretty_pv(pos, depth, value, current_search_time(), Ctx->Rml[0].pv) << endl;
 
         // Init easyMove after first iteration or drop if differs from the best move
-        if (depth == 1 && (Rml.size() == 1 || Rml[0].pv_score > Rml[1].pv_score + EasyMoveMargin))
+        if (depth == 1 && (Ctx->Rml.size() == 1 || Ctx->Rml[0].pv_score > Ctx->Rml[1].pv_score + EasyMoveMargin))
             easyMove = bestMove;
         else if (bestMove != easyMove)
             easyMove = MOVE_NONE;
 
         // Check for some early stop condition
-        if (!StopRequest && Limits.useTimeManagement())
+        if (!Ctx->StopRequest && Ctx->Limits.useTimeManagement())
         {
             // Stop search early when the last two iterations returned a mate score
             if (   depth >= 5
                 && abs(bestValues[depth])     >= VALUE_MATE_IN_PLY_MAX
                 && abs(bestValues[depth - 1]) >= VALUE_MATE_IN_PLY_MAX)
-                StopRequest = true;
+                Ctx->StopRequest = true;
 
             // Stop search early if one move seems to be much better than the
             // others or if there is only a single legal move. Also in the latter
             // case we search up to some depth anyway to get a proper score.
             if (   depth >= 7
                 && easyMove == bestMove
-                && (   Rml.size() == 1
-                    ||(   Rml[0].nodes > (pos.nodes_searched() * 85) / 100
-                       && current_search_time() > TimeMgr.available_time() / 16)
-                    ||(   Rml[0].nodes > (pos.nodes_searched() * 98) / 100
-                       && current_search_time() > TimeMgr.available_time() / 32)))
-                StopRequest = true;
+                && (   Ctx->Rml.size() == 1
+                    ||(   Ctx->Rml[0].nodes > (pos.nodes_searched() * 85) / 100
+                       && current_search_time() > Ctx->TimeMgr.available_time() / 16)
+                    ||(   Ctx->Rml[0].nodes > (pos.nodes_searched() * 98) / 100
+                       && current_search_time() > Ctx->TimeMgr.available_time() / 32)))
+                Ctx->StopRequest = true;
 
             // Take in account some extra time if the best move has changed
             if (depth > 4 && depth < 50)
-                TimeMgr.pv_instability(bestMoveChanges[depth], bestMoveChanges[depth - 1]);
+                Ctx->TimeMgr.pv_instability(bestMoveChanges[depth], bestMoveChanges[depth - 1]);
 
             // Stop search if most of available time is already consumed. We probably don't
             // have enough time to search the first move at the next iteration anyway.
-            if (current_search_time() > (TimeMgr.available_time() * 62) / 100)
-                StopRequest = true;
+            if (current_search_time() > (Ctx->TimeMgr.available_time() * 62) / 100)
+                Ctx->StopRequest = true;
 
             // If we are allowed to ponder do not stop the search now but keep pondering
-            if (StopRequest && Limits.ponder)
+            if (Ctx->StopRequest && Ctx->Limits.ponder)
             {
-                StopRequest = false;
-                StopOnPonderhit = true;
+                Ctx->StopRequest = false;
+                Ctx->StopOnPonderhit = true;
             }
         }
         
 
     }
-#ifdef FICS_VERSION
-     cout << endl;
-     cout << "depth: " << depth << " score: " << value << endl;
-#endif
 
     // When using skills overwrite best and ponder moves with the sub-optimal ones
-    if (SkillLevelEnabled)
+    if (Ctx->SkillLevelEnabled)
     {
         if (skillBest == MOVE_NONE) // Still unassigned ?
             do_skill_level(&skillBest, &skillPonder);
@@ -738,7 +1100,7 @@ namespace {
     assert(alpha >= -VALUE_INFINITE && alpha <= VALUE_INFINITE);
     assert(beta > alpha && beta <= VALUE_INFINITE);
     assert(PvNode || alpha == beta - 1);
-    assert(pos.thread() >= 0 && pos.thread() < Threads.size());
+    assert(pos.thread() >= 0 && pos.thread() < MAX_SLOTS);
 
     Move movesSearched[MAX_MOVES];
     int64_t nodes;
@@ -789,23 +1151,35 @@ namespace {
         bestValue = alpha;
 
     // Step 1. Initialize node and poll. Polling can abort search
+    STAT_INC(threadID, STAT_SEARCH_NODES);
     ss->currentMove = ss->bestMove = threatMove = (ss+1)->excludedMove = MOVE_NONE;
     (ss+1)->skipNullMove = false; (ss+1)->reduction = DEPTH_ZERO;
     (ss+2)->killers[0] = (ss+2)->killers[1] = (ss+2)->mateKiller = MOVE_NONE;
 
-    if (threadID == 0 && ++NodesSincePoll > NodesBetweenPolls)
+    if (threadID == Ctx->masterThread && ++Ctx->NodesSincePoll > Ctx->NodesBetweenPolls)
     {
-        NodesSincePoll = 0;
+        Ctx->NodesSincePoll = 0;
         poll(pos);
     }
 
     // Step 2. Check for aborted search and immediate draw
-    if ((   StopRequest
+    if ((   Ctx->StopRequest
          //|| Threads[threadID].cutoff_occurred()
          || pos.is_draw<false>()
          || ss->ply > PLY_MAX) && !Root)
         return VALUE_DRAW;
 
+    // If a reversible move draws by repetition, or the opponent could have
+    // drawn by one earlier, the node is worth at least a draw.
+    if (   !Root
+        && alpha < VALUE_DRAW
+        && pos.has_game_cycle(ss->ply))
+    {
+        alpha = VALUE_DRAW;
+        if (alpha >= beta)
+            return alpha;
+    }
+
     // Step 3. Mate distance pruning
     alpha = Max(value_mated_in(ss->ply), alpha);
     beta = Min(value_mate_in(ss->ply+1), beta);
@@ -818,9 +1192,15 @@ namespace {
     excludedMove = ss->excludedMove;
     posKey = excludedMove ? pos.get_exclusion_key() : pos.get_key();
 
-    tte = TT.probe(posKey);
+    tte = Ctx->tt->probe(posKey);
     ttMove = tte ? tte->move() : MOVE_NONE;
 
+    STAT_INC(threadID, tte ? STAT_TT_HIT : STAT_TT_MISS);
+#if defined(USE_STATS)
+    if (ttMove != MOVE_NONE && !pos.move_is_legal(ttMove))
+        STAT_INC(threadID, STAT_TT_COLLISION);
+#endif
+
     // At PV nodes we check for exact scores, while at non-PV nodes we check for
     // a fail high/low. Biggest advantage at probing at PV nodes is to have a
     // smooth experience in analysis mode.
@@ -829,7 +1209,7 @@ namespace {
         && (PvNode ? tte->depth() >= depth && tte->type() == VALUE_TYPE_EXACT
                    : ok_to_use_TT(tte, depth, beta, ss->ply)))
     {
-        TT.refresh(tte);
+        Ctx->tt->refresh(tte);
         ss->bestMove = ttMove; // Can be MOVE_NONE
         return value_from_tt(tte->value(), ss->ply);
     }
@@ -848,7 +1228,7 @@ namespace {
     else
     {
     	refinedValue = ss->eval = evaluate(pos, ss->evalMargin, &expl_threat);
-        TT.store(posKey, VALUE_NONE, VALUE_TYPE_NONE, DEPTH_NONE, MOVE_NONE, ss->eval, ss->evalMargin);
+        Ctx->tt->store(posKey, VALUE_NONE, VALUE_TYPE_NONE, DEPTH_NONE, MOVE_NONE, ss->eval, ss->evalMargin);
     }
 
     // Save gain for the parent non-capture move
@@ -904,6 +1284,7 @@ namespace {
         if (refinedValue - PawnValueMidgame > beta)
             R++;
 
+        STAT_INC(threadID, STAT_NULL_TRIED);
         pos.do_null_move(st);
         (ss+1)->skipNullMove = true;
         nullValue = -search<NonPV>(pos, ss+1, -beta, -alpha, depth-R*ONE_PLY);
@@ -917,7 +1298,10 @@ namespace {
                 nullValue = beta;
 
             if (depth < 6 * ONE_PLY)
+            {
+                STAT_INC(threadID, STAT_NULL_CUTOFF);
                 return nullValue;
+            }
 
             // Do verification search at high depths
             ss->skipNullMove = true;
@@ -925,7 +1309,12 @@ namespace {
             ss->skipNullMove = false;
 
             if (v >= beta)
+            {
+                STAT_INC(threadID, STAT_NULL_CUTOFF);
                 return nullValue;
+            }
+
+            STAT_INC(threadID, STAT_NULL_VERIFY_FAIL);
         }
         else
         {
@@ -948,7 +1337,7 @@ namespace {
     // Step 9. Internal iterative deepening
     if (   depth >= IIDDepth[PvNode]
         && ttMove == MOVE_NONE
-        && (PvNode || (!inCheck && ss->eval + IIDMargin >= beta)))
+        && (PvNode || (!inCheck && ss->eval + Ctx->IIDMargin >= beta)))
     {
         Depth d = (PvNode ? depth - 2 * ONE_PLY : depth / 2);
 
@@ -957,7 +1346,7 @@ namespace {
         ss->skipNullMove = false;
 
         ttMove = ss->bestMove;
-        tte = TT.probe(posKey);
+        tte = Ctx->tt->probe(posKey);
     }
 
 split_point_start: // At split points actual search starts from here
@@ -965,7 +1354,7 @@ split_point_start: // At split points actual search starts from here
 
 
     // Initialize a MovePicker object for the current position
-    MovePickerExt<SpNode, Root> mp(pos, ttMove, depth, H, ss, (PvNode ? -VALUE_INFINITE : beta));
+    MovePickerExt<SpNode, Root> mp(pos, ttMove, depth, Ctx->H, ss, (PvNode ? -VALUE_INFINITE : beta));
     CheckInfo ci(pos);
     ss->bestMove = MOVE_NONE;
     futilityBase = ss->eval + ss->evalMargin;
@@ -1004,28 +1393,26 @@ split_point_start: // At split points actual search starts from here
       if (Root)
       {
           // This is used by time management
-          FirstRootMove = (moveCount == 1);
+          Ctx->FirstRootMove = (moveCount == 1);
 
           // Save the current node count before the move is searched
           nodes = pos.nodes_searched();
-#ifdef UCI_VERSION
           // If it's time to send nodes info, do it here where we have the
           // correct accumulated node counts searched by each thread.
-          if (SendSearchedNodes)
+          if (Ctx->SendSearchedNodes)
           {
-              SendSearchedNodes = false;
+              Ctx->SendSearchedNodes = false;
               cout << "info" << speed_to_uci(pos.nodes_searched()) << endl;
           }
 
-          if (current_search_time() > 2000)
+          if (current_search_time() > 2000 && !Ctx->silent)
               cout << "info currmove " << move
                    << " currmovenumber " << moveCount << endl;
-#endif
           
       }
 
       // At Root and at first iteration do a PV search on all the moves to score root moves
-      isPvMove = (PvNode && moveCount <= (Root ? depth <= ONE_PLY ? 1000 : MultiPV : 1));
+      isPvMove = (PvNode && moveCount <= (Root ? depth <= ONE_PLY ? 1000 : Ctx->MultiPV : 1));
       givesCheck = pos.move_gives_check(move, ci);
       captureOrPromotion = pos.move_is_capture_or_promotion(move);
 
@@ -1094,7 +1481,7 @@ split_point_start: // At split points actual search starts from here
           // but fixing this made program slightly weaker.
           Depth predictedDepth = newDepth - reduction<NonPV>(depth, moveCount);
           futilityValueScaled =  futilityBase + futility_margin(predictedDepth, moveCount)
-                               + H.gain(pos.piece_on(move_from(move)), move_to(move));
+                               + Ctx->H.gain(pos.piece_on(move_from(move)), move_to(move));
 
           if (futilityValueScaled < beta)
           {
@@ -1143,7 +1530,7 @@ split_point_start: // At split points actual search starts from here
       if (isPvMove)
       {
           // Aspiration window is disabled in multi-pv case
-          if (Root && MultiPV > 1)
+          if (Root && Ctx->MultiPV > 1)
               alpha = -VALUE_INFINITE;
 
           value = -search<PV>(pos, ss+1, -beta, -alpha, newDepth);
@@ -1169,6 +1556,10 @@ split_point_start: // At split points actual search starts from here
                   value = -search<NonPV>(pos, ss+1, -(alpha+1), -alpha, d);
 
                   doFullDepthSearch = (value > alpha);
+                  STAT_INC(threadID, STAT_LMR_TRIED);
+
+                  if (doFullDepthSearch)
+                      STAT_INC(threadID, STAT_LMR_RESEARCH);
               }
               ss->reduction = DEPTH_ZERO; // Restore original reduction
           }
@@ -1205,15 +1596,13 @@ split_point_start: // At split points actual search starts from here
       
       STARTNEW
       
-      if (Root) {
+      if (Root && Ctx->Limits.collectRootMoves) {
     	  
-#ifdef BOOK_VERSION
     	  MoveStack ms;
     	  ms.move = move;
     	  ms.score = value;
     	  book_moves_aux.push_back(ms);
     	  //cout << "    " << move_to_string(ms.move) << " " << ms.score << " " << book_moves_aux.size() << endl;
-#endif
     	  
       }
       ENDNEW
@@ -1265,7 +1654,7 @@ split_point_start: // At split points actual search starts from here
           // ran out of time. In this case, the return value of the search cannot
           // be trusted, and we break out of the loop without updating the best
           // move and/or PV.
-          if (StopRequest)
+          if (Ctx->StopRequest)
               break;
 
           // Remember searched nodes counts for this move
@@ -1282,15 +1671,15 @@ split_point_start: // At split points actual search starts from here
               // We record how often the best move has been changed in each
               // iteration. This information is used for time management: When
               // the best move changes frequently, we allocate some more time.
-              if (!isPvMove && MultiPV == 1)
-                  Rml.bestMoveChanges++;
+              if (!isPvMove && Ctx->MultiPV == 1)
+                  Ctx->Rml.bestMoveChanges++;
 
-              Rml.sort_multipv(moveCount);
+              Ctx->Rml.sort_multipv(moveCount);
 
               // Update alpha. In multi-pv we don't use aspiration window, so
               // set alpha equal to minimum score among the PV lines.
-              if (MultiPV > 1)
-                  alpha = Rml[Min(moveCount, MultiPV) - 1].pv_score; // FIXME why moveCount?
+              if (Ctx->MultiPV > 1)
+                  alpha = Ctx->Rml[Min(moveCount, Ctx->MultiPV) - 1].pv_score; // FIXME why moveCount?
               else if (value > alpha)
                   alpha = value;
           }
@@ -1304,8 +1693,9 @@ split_point_start: // At split points actual search starts from here
           && !SpNode
           && depth >= Threads.min_split_depth()
           && bestValue < beta
+          && threadID < Threads.size()
           && Threads.available_slave_exists(threadID)
-          && !StopRequest
+          && !Ctx->StopRequest
           && !Threads[threadID].cutoff_occurred())
           Threads.split<FakeSplit>(pos, ss, &alpha, beta, &bestValue, depth,
                                    threatMove, moveCount, &mp, PvNode);
@@ -1348,13 +1738,21 @@ split_point_start: // At split points actual search starts from here
     // Step 20. Update tables
     // If the search is not aborted, update the transposition table,
     // history counters, and killer moves.
-    if (!SpNode && !StopRequest && !Threads[threadID].cutoff_occurred())
+    if (!SpNode && !Ctx->StopRequest && !Threads[threadID].cutoff_occurred())
     {
         move = bestValue <= oldAlpha ? MOVE_NONE : ss->bestMove;
         vt   = bestValue <= oldAlpha ? VALUE_TYPE_UPPER
              : bestValue >= beta ? VALUE_TYPE_LOWER : VALUE_TYPE_EXACT;
 
-        TT.store(posKey, value_to_tt(bestValue, ss->ply), vt, depth, move, ss->eval, ss->evalMargin);
+        Ctx->tt->store(posKey, value_to_tt(bestValue, ss->ply), vt, depth, move, ss->eval, ss->evalMargin);
+
+        if (bestValue >= beta)
+        {
+            STAT_INC(threadID, STAT_BETA_CUTOFF);
+
+            if (moveCount == 1)
+                STAT_INC(threadID, STAT_BETA_CUTOFF_FIRST);
+        }
 
         // Update killers and history only for non capture moves that fails high
         if (    bestValue >= beta
@@ -1393,7 +1791,7 @@ split_point_start: // At split points actual search starts from here
     assert(beta >= -VALUE_INFINITE && beta <= VALUE_INFINITE);
     assert(PvNode || alpha == beta - 1);
     assert(depth <= 0);
-    assert(pos.thread() >= 0 && pos.thread() < Threads.size());
+    assert(pos.thread() >= 0 && pos.thread() < MAX_SLOTS);
     
     //NEW assert(pos.piece_count(pos.side_to_move(), KING));
 
@@ -1408,6 +1806,8 @@ split_point_start: // At split points actual search starts from here
 
     ss->bestMove = ss->currentMove = MOVE_NONE;
     ss->ply = (ss-1)->ply + 1;
+
+    STAT_INC(pos.thread(), STAT_QSEARCH_NODES);
     
     STARTNEW
     // no king => mate
@@ -1430,9 +1830,15 @@ split_point_start: // At split points actual search starts from here
 
     // Transposition table lookup. At PV nodes, we don't use the TT for
     // pruning, but only for move ordering.
-    tte = TT.probe(pos.get_key());
+    tte = Ctx->tt->probe(pos.get_key());
     ttMove = (tte ? tte->move() : MOVE_NONE);
 
+    STAT_INC(pos.thread(), tte ? STAT_TT_HIT : STAT_TT_MISS);
+#if defined(USE_STATS)
+    if (ttMove != MOVE_NONE && !pos.move_is_legal(ttMove))
+        STAT_INC(pos.thread(), STAT_TT_COLLISION);
+#endif
+
     if (!PvNode && tte && ok_to_use_TT(tte, ttDepth, beta, ss->ply))
     {
         ss->bestMove = ttMove; // Can be MOVE_NONE
@@ -1457,7 +1863,16 @@ split_point_start: // At split points actual search starts from here
             ss->eval = bestValue = tte->static_value();
         }
         else {
-        	ss->eval = bestValue = evaluate(pos, evalMargin, &expl_threat);
+            bool lazy;
+            ss->eval = bestValue = evaluate(pos, evalMargin, &expl_threat, beta, &lazy);
+
+            // A lazy value is only good for the stand pat, it is neither
+            // stored nor used for the gains and the futility pruning.
+            if (lazy)
+            {
+                ss->eval = VALUE_NONE;
+                return bestValue;
+            }
         }
 
         update_gains(pos, (ss-1)->currentMove, (ss-1)->eval, ss->eval);
@@ -1466,7 +1881,7 @@ split_point_start: // At split points actual search starts from here
         if (bestValue >= beta)
         {
             if (!tte)
-                TT.store(pos.get_key(), value_to_tt(bestValue, ss->ply), VALUE_TYPE_LOWER, DEPTH_NONE, MOVE_NONE, ss->eval, evalMargin);
+                Ctx->tt->store(pos.get_key(), value_to_tt(bestValue, ss->ply), VALUE_TYPE_LOWER, DEPTH_NONE, MOVE_NONE, ss->eval, evalMargin);
 
             return bestValue;
         }
@@ -1475,7 +1890,7 @@ split_point_start: // At split points actual search starts from here
             alpha = bestValue;
 
         // Futility pruning parameters, not needed when in check
-        futilityBase = ss->eval + evalMargin + FutilityMarginQS;
+        futilityBase = ss->eval + evalMargin + Ctx->FutilityMarginQS;
         enoughMaterial = pos.non_pawn_material(pos.side_to_move()) > RookValueMidgame;
     }
 
@@ -1483,7 +1898,7 @@ split_point_start: // At split points actual search starts from here
     // to search the moves. Because the depth is <= 0 here, only captures,
     // queen promotions and checks (only if depth >= DEPTH_QS_CHECKS) will
     // be generated.
-    MovePicker mp(pos, ttMove, depth, H);
+    MovePicker mp(pos, ttMove, depth, Ctx->H);
     CheckInfo ci(pos);
 
     // Loop through the moves until no moves remain or a beta cutoff occurs
@@ -1586,7 +2001,7 @@ split_point_start: // At split points actual search starts from here
 
     // Update transposition table
     ValueType vt = (bestValue <= oldAlpha ? VALUE_TYPE_UPPER : bestValue >= beta ? VALUE_TYPE_LOWER : VALUE_TYPE_EXACT);
-    TT.store(pos.get_key(), value_to_tt(bestValue, ss->ply), vt, ttDepth, ss->bestMove, ss->eval, evalMargin);
+    Ctx->tt->store(pos.get_key(), value_to_tt(bestValue, ss->ply), vt, ttDepth, ss->bestMove, ss->eval, evalMargin);
 
     //    assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1694,6 +2109,12 @@ split_point_start: // At split points actual search starts from here
 
     // Case 4: The destination square for m2 is defended by the moving piece in m1
     p = pos.piece_on(t1);
+
+    NEW // If m1 was a capture the moving piece has exploded together with
+    NEW // the captured one, so there is nothing left to be connected with.
+    NEW if (p == PIECE_NONE)
+    NEW     return false;
+
     if (bit_is_set(pos.attacks_from(p, t1), t2))
         return true;
 
@@ -1877,7 +2298,7 @@ split_point_start: // At split points actual search starts from here
     Move m;
     Value bonus = Value(int(depth) * int(depth));
 
-    H.update(pos.piece_on(move_from(move)), move_to(move), bonus);
+    Ctx->H.update(pos.piece_on(move_from(move)), move_to(move), bonus);
 
     for (int i = 0; i < moveCount - 1; i++)
     {
@@ -1885,7 +2306,7 @@ split_point_start: // At split points actual search starts from here
 
         assert(m != move);
 
-        H.update(pos.piece_on(move_from(m)), move_to(m), -bonus);
+        Ctx->H.update(pos.piece_on(move_from(m)), move_to(m), -bonus);
     }
   }
 
@@ -1900,7 +2321,46 @@ split_point_start: // At split points actual search starts from here
         && after != VALUE_NONE
         && pos.captured_piece_type() == PIECE_TYPE_NONE
         && !move_is_special(m))
-        H.update_gain(pos.piece_on(move_to(m)), move_to(m), -(before + after));
+        Ctx->H.update_gain(pos.piece_on(move_to(m)), move_to(m), -(before + after));
+  }
+
+
+  // start_search() resets the context of the calling thread before a new
+  // search: stop flags, timers, node counters and poll interval.
+
+  void start_search(Position& pos, const SearchLimits& limits) {
+
+    Ctx->StopOnPonderhit = Ctx->QuitRequest = Ctx->AspirationFailLow = Ctx->SendSearchedNodes = false;
+
+    // A stop asked before the search has started is not lost, stop_search()
+    // raises PendingStop before StopRequest.
+    Ctx->StopRequest = false;
+    if (Ctx->PendingStop)
+        Ctx->StopRequest = true;
+
+    Ctx->NodesSincePoll = 0;
+    current_search_time(get_system_time());
+    current_cpu_usage(get_cpu_usage());
+    Ctx->Limits = limits;
+    Ctx->TimeMgr.init(Ctx->TimeOpts, Ctx->Limits, pos.startpos_ply_counter());
+
+    NEW pos.set_nodes_searched(0);
+    Ctx->HACK_NPS = 0;
+
+    NEW // when debugging we want more polls
+#ifdef NDEBUG
+    // Set best NodesBetweenPolls interval to avoid lagging under time pressure
+    if (Ctx->Limits.maxNodes)
+        Ctx->NodesBetweenPolls = Min(Ctx->Limits.maxNodes, 30000);
+    else if (Ctx->Limits.time && Ctx->Limits.time < 1000)
+        Ctx->NodesBetweenPolls = 1000;
+    else if (Ctx->Limits.time && Ctx->Limits.time < 5000)
+        Ctx->NodesBetweenPolls = 5000;
+    else
+        Ctx->NodesBetweenPolls = 30000;
+#else
+    Ctx->NodesBetweenPolls = 1000;
+#endif
   }
 
 
@@ -1909,19 +2369,16 @@ split_point_start: // At split points actual search starts from here
 
   int64_t current_search_time(int64_t set) {
 
-    static int64_t searchStartTime;
-
     if (set)
-        searchStartTime = set;
+        Ctx->searchStartTime = set;
 
-    return get_system_time() - searchStartTime;
+    return get_system_time() - Ctx->searchStartTime;
   }
 
   int64_t current_cpu_usage(int64_t set) {
 
-    static int64_t save;
-    if (set) save=set;
-    return get_cpu_usage()-save;
+    if (set) Ctx->cpuUsageStart=set;
+    return get_cpu_usage()-Ctx->cpuUsageStart;
   }
 
 
@@ -1953,59 +2410,38 @@ split_point_start: // At split points actual search starts from here
     std::stringstream s;
     int64_t t = current_search_time();
     int64_t us = int64_t(current_cpu_usage()); // mult by 1000
-    HACK_NPS = t>0 ? (nodes*1000)/t : 0;
-    s << " nodes " << nodes << " nps " << HACK_NPS << " time " << t;
+    Ctx->HACK_NPS = t>0 ? (nodes*1000)/t : 0;
+    s << " nodes " << nodes << " nps " << Ctx->HACK_NPS << " time " << t;
     if (t>1000) s << " cpuload " << (t>0 ? (1000*us)/t : 0)
-		  << " hashfull " << TT.full (nodes);
+		  << " hashfull " << Ctx->tt->full (nodes);
     return s.str();
   }
 
-  
-  STARTNEW
-  // in the original version of stockfish uci_stream is replaced 
-  // with std:cin everywhere in the following until #undef uci_stream
-  // (only 2 occurences)
-#ifdef UCI_VERSION
-  #define uci_stream std::cin
-#else
-  #define uci_stream stdin_fake
-#endif
-  ENDNEW
-  
+
   // poll() performs two different functions: It polls for user input, and it
   // looks at the time consumed so far and decides if it's time to abort the
   // search.
 
   void poll(const Position& pos) {
 
-    static int lastInfoTime;
     int64_t t = current_search_time();
     // this was *user* time so needed parallel accounting!
     
     //NEW cout << "POLL" << endl;
     
-#ifdef UCI_VERSION
-    //  Poll for input
-    if (input_available())
-#endif
+    //  Poll for input, but not when running a benchmark
+    if (!Ctx->Limits.ignoreInput && input_available())
     {
         // We are line oriented, don't read single chars
         std::string command;
         //NEW cout << "INPUT" << endl;
         
-#ifdef UCI_VERSION
-        if (!std::getline(uci_stream, command) || command == "quit")	// original
-#else
-        NEW std::getline(uci_stream, command);
-        NEW uci_stream.clear();
-        
-        NEW if (command == "quit")
-#endif
+        if (!std::getline(std::cin, command) || command == "quit")
         {
         	NEW cout << "poll: quit" << endl;
             // Quit the program as soon as possible
-            Limits.ponder = false;
-            QuitRequest = StopRequest = true;
+            Ctx->Limits.ponder = false;
+            Ctx->QuitRequest = Ctx->StopRequest = true;
             return;
         }
         else if (command == "stop")
@@ -2013,8 +2449,8 @@ split_point_start: // At split points actual search starts from here
         	NEW cout << "poll: stop" << endl;
             // Stop calculating as soon as possible, but still send the "bestmove"
             // and possibly the "ponder" token when finishing the search.
-            Limits.ponder = false;
-            StopRequest = true;
+            Ctx->Limits.ponder = false;
+            Ctx->StopRequest = true;
             
         }
         else if (command == "ponderhit")
@@ -2023,57 +2459,54 @@ split_point_start: // At split points actual search starts from here
             // The opponent has played the expected move. GUI sends "ponderhit" if
             // we were told to ponder on the same move the opponent has played. We
             // should continue searching but switching from pondering to normal search.
-            Limits.ponder = false;
+            Ctx->Limits.ponder = false;
 
-            if (StopOnPonderhit)
-                StopRequest = true;
+            if (Ctx->StopOnPonderhit)
+                Ctx->StopRequest = true;
         }
         
     }
 
     // Print search information
     if (t < 1000)
-        lastInfoTime = 0;
+        Ctx->lastInfoTime = 0;
 
-    else if (lastInfoTime > t)
+    else if (Ctx->lastInfoTime > t)
         // HACK: Must be a new search where we searched less than
         // NodesBetweenPolls nodes during the first second of search.
-        lastInfoTime = 0;
+        Ctx->lastInfoTime = 0;
 
-    else if (t - lastInfoTime >= 1000)
+    else if (t - Ctx->lastInfoTime >= 1000 && !Ctx->silent)
     {
-        lastInfoTime = t;
+        Ctx->lastInfoTime = t;
 	// seems that every thread has its own poll and lastInfoTime ?
 
-        dbg_print_mean();
-        dbg_print_hit_rate();
-
 	cout << "info time " << t << endl; // redundant, useful for debug loc
 	if (Options["Threads"].value<int>()==1)
 	  cout << "info" << speed_to_uci(pos.nodes_searched()) << endl;
 	else // in parallel, lie about it with HACK_NPS...
-	  cout << "info" << speed_to_uci(HACK_NPS * t/1000) << endl;	  
+	  cout << "info" << speed_to_uci(Ctx->HACK_NPS * t/1000) << endl;	  
 	// immediate node count does not work with parallel (fixed in later SF)
 	// seems parallel crash was only repetition detection thankfully
-        SendSearchedNodes = true;
+        Ctx->SendSearchedNodes = true;
         // Send info on searched nodes as soon as we return to root
     }
 
     // Should we stop the search?
-    if (Limits.ponder)
+    if (Ctx->Limits.ponder)
         return;
 
-    bool stillAtFirstMove =    FirstRootMove
-                           && !AspirationFailLow
-                           &&  t > TimeMgr.available_time();
+    bool stillAtFirstMove =    Ctx->FirstRootMove
+                           && !Ctx->AspirationFailLow
+                           &&  t > Ctx->TimeMgr.available_time();
 
-    bool noMoreTime =   t > TimeMgr.maximum_time()
+    bool noMoreTime =   t > Ctx->TimeMgr.maximum_time()
                      || stillAtFirstMove;
 
-    if (   (Limits.useTimeManagement() && noMoreTime)
-        || (Limits.maxTime && t >= Limits.maxTime)
-        || (Limits.maxNodes && pos.nodes_searched() >= Limits.maxNodes)) // FIXME
-        StopRequest = true;
+    if (   (Ctx->Limits.useTimeManagement() && noMoreTime)
+        || (Ctx->Limits.maxTime && t >= Ctx->Limits.maxTime)
+        || (Ctx->Limits.maxNodes && pos.nodes_searched() >= Ctx->Limits.maxNodes)) // FIXME
+        Ctx->StopRequest = true;
   }
 
 
@@ -2087,77 +2520,53 @@ split_point_start: // At split points actual search starts from here
   void wait_for_stop_or_ponderhit() {
 
     std::string command;
-#ifdef UCI_VERSION
     // Wait for a command from stdin
-    while (   std::getline(uci_stream, command)
+    while (   std::getline(std::cin, command)
            && command != "ponderhit" && command != "stop" && command != "quit") {};
 
     if (command != "ponderhit" && command != "stop")
-        QuitRequest = true; // Must be "quit" or getline() returned false
-#else
-    STARTNEW
-    for (;;) {
-        std::getline(uci_stream, command);
-        if (command != "") cout << "wait_for_stop_or_ponderhit: " << command << endl;
-        uci_stream.clear();
-        
-        if (command == "ponderhit" || command == "stop" || command == "quit") {
-        	break;
-        }
-        
-        Sleep(20);
-    }
-    
-    if (command != "quit") QuitRequest = true;
-    
-    cout << "leaving wait_for_stop_or_ponderhit" << endl;
-    ENDNEW
-#endif
+        Ctx->QuitRequest = true; // Must be "quit" or getline() returned false
   }
 
   
-#undef uci_stream
-  
 
   // When playing with strength handicap choose best move among the MultiPV set
   // using a statistical rule dependent on SkillLevel. Idea by Heinz van Saanen.
   void do_skill_level(Move* best, Move* ponder) {
 
-    assert(MultiPV > 1);
-
-    static RKISS rk;
+    assert(Ctx->MultiPV > 1);
 
     // Rml list is already sorted by pv_score in descending order
     int s;
     int max_s = -VALUE_INFINITE;
-    int size = Min(MultiPV, (int)Rml.size());
-    int max = Rml[0].pv_score;
-    int var = Min(max - Rml[size - 1].pv_score, PawnValueMidgame);
-    int wk = 120 - 2 * SkillLevel;
+    int size = Min(Ctx->MultiPV, (int)Ctx->Rml.size());
+    int max = Ctx->Rml[0].pv_score;
+    int var = Min(max - Ctx->Rml[size - 1].pv_score, PawnValueMidgame);
+    int wk = 120 - 2 * Ctx->SkillLevel;
 
     // PRNG sequence should be non deterministic
     for (int i = abs(get_system_time() % 50); i > 0; i--)
-        rk.rand<unsigned>();
+        Ctx->rk.rand<unsigned>();
 
     // Choose best move. For each move's score we add two terms both dependent
     // on wk, one deterministic and bigger for weaker moves, and one random,
     // then we choose the move with the resulting highest score.
     for (int i = 0; i < size; i++)
     {
-        s = Rml[i].pv_score;
+        s = Ctx->Rml[i].pv_score;
 
         // Don't allow crazy blunders even at very low skills
-        if (i > 0 && Rml[i-1].pv_score > s + EasyMoveMargin)
+        if (i > 0 && Ctx->Rml[i-1].pv_score > s + EasyMoveMargin)
             break;
 
         // This is our magical formula
-        s += ((max - s) * wk + var * (rk.rand<unsigned>() % wk)) / 128;
+        s += ((max - s) * wk + var * (Ctx->rk.rand<unsigned>() % wk)) / 128;
 
         if (s > max_s)
         {
             max_s = s;
-            *best = Rml[i].pv[0];
-            *ponder = Rml[i].pv[1];
+            *best = Ctx->Rml[i].pv[0];
+            *ponder = Ctx->Rml[i].pv[1];
         }
     }
   }
@@ -2230,7 +2639,7 @@ split_point_start: // At split points actual search starts from here
 
     pos.do_move(pv[0], *st++);
 
-    while (   (tte = TT.probe(pos.get_key())) != NULL
+    while (   (tte = Ctx->tt->probe(pos.get_key())) != NULL
            && tte->move() != MOVE_NONE
            && pos.move_is_legal(tte->move())
            && ply < PLY_MAX
@@ -2264,7 +2673,7 @@ split_point_start: // At split points actual search starts from here
 
     do {
         k = pos.get_key();
-        tte = TT.probe(k);
+        tte = Ctx->tt->probe(k);
 
         // Don't overwrite existing correct entries
         if (!tte || tte->move() != pv[ply])
@@ -2272,7 +2681,7 @@ split_point_start: // At split points actual search starts from here
         	NEW assert(pos.piece_count(pos.side_to_move(), KING));
         	NEW assert(pos.is_ok());
             v = (pos.in_check() ? VALUE_NONE : evaluate(pos, m, &expl_threat));
-            TT.store(k, VALUE_NONE, VALUE_TYPE_NONE, DEPTH_NONE, pv[ply], v, m);
+            Ctx->tt->store(k, VALUE_NONE, VALUE_TYPE_NONE, DEPTH_NONE, pv[ply], v, m);
         }
         pos.do_move(pv[ply], *st++);
 
@@ -2291,15 +2700,11 @@ split_point_start: // At split points actual search starts from here
 
     
     s << "info depth " << depth
-#ifdef UCI_VERSION
       << " seldepth " << selDepth
       << " multipv " << pvIdx + 1
-#endif   
       << " score " << value_to_uci(pv_score)
       << (pv_score >= beta ? " lowerbound" : pv_score <= alpha ? " upperbound" : "")
-#ifdef UCI_VERSION
       << speed_to_uci(pos.nodes_searched())
-#endif
       << " pv ";
 
 #if 0 // curtail repetitious PVs
@@ -2333,15 +2738,15 @@ split_point_start: // At split points actual search starts from here
     // This is the second order score that is used to compare the moves when
     // the first orders pv_score of both moves are equal.
     while ((move = MovePicker::get_next_move()) != MOVE_NONE)
-        for (rm = Rml.begin(); rm != Rml.end(); ++rm)
+        for (rm = Ctx->Rml.begin(); rm != Ctx->Rml.end(); ++rm)
             if (rm->pv[0] == move)
             {
                 rm->non_pv_score = score--;
                 break;
             }
 
-    Rml.sort();
-    rm = Rml.begin();
+    Ctx->Rml.sort();
+    rm = Ctx->Rml.begin();
   }
 
   Move MovePickerExt<false, true>::get_next_move() {
@@ -2351,7 +2756,7 @@ split_point_start: // At split points actual search starts from here
     else
         firstCall = false;
 
-    return rm != Rml.end() ? rm->pv[0] : MOVE_NONE;
+    return rm != Ctx->Rml.end() ? rm->pv[0] : MOVE_NONE;
   }
 
 } // namespace
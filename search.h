@@ -27,6 +27,10 @@
 #include "types.h"
 
 class Position;
+class TranspositionTable;
+struct EvalOptions;
+struct SearchContext;
+struct TimeOptions;
 struct SplitPoint;
 
 /// The SearchStack struct keeps track of the information we need to remember
@@ -59,19 +63,60 @@ struct SearchLimits {
 
   SearchLimits(int t, int i, int mtg, int mt, int md, int mn, bool inf, bool pon)
               : time(t), increment(i), movesToGo(mtg), maxTime(mt), maxDepth(md),
-                maxNodes(mn), infinite(inf), ponder(pon) {}
+                maxNodes(mn), infinite(inf), ponder(pon), ignoreInput(false),
+                collectRootMoves(false) {}
 
   bool useTimeManagement() const { return !(maxTime | maxDepth | maxNodes | int(infinite)); }
 
   int time, increment, movesToGo, maxTime, maxDepth, maxNodes;
-  bool infinite, ponder;
+  bool infinite, ponder, ignoreInput;
+  bool collectRootMoves; // Root moves and scores go to book_moves, see create_book.h
 };
 
 
-extern std::stringstream stdin_fake;
+/// Search parameters that can be tuned. Each one is an UCI option, with an
+/// integer value, and a double in the search context so that the tuner can
+/// move it by small steps. The lookup tables are rebuilt from them.
+
+enum SearchParam {
+  RAZOR_MARGIN, RAZOR_MARGIN_SLOPE, FUTILITY_MARGIN, FUTILITY_MARGIN_BASE,
+  FUTILITY_MARGIN_SLOPE, FUTILITY_MARGIN_QS, FUTILITY_MOVE_COUNT_BASE,
+  FUTILITY_MOVE_COUNT_SCALE, REDUCTION_PV_DIVISOR, REDUCTION_NONPV_BASE,
+  REDUCTION_NONPV_DIVISOR, IID_MARGIN, SEARCH_PARAM_NB
+};
+
+struct SearchParamInfo {
+  const char* name;
+  int defaultValue, minValue, maxValue;
+};
+
+extern const SearchParamInfo SearchParams[SEARCH_PARAM_NB];
+
+
+/// SearchInfo is the result of an iteration of the search, passed to the
+/// callback of the search context. The PV ends with MOVE_NONE.
+
+struct SearchInfo {
+  int depth, selDepth;
+  Value score;
+  int64_t nodes;
+  int time; // Milliseconds
+  Move pv[PLY_MAX_PLUS_2];
+};
+
+typedef void (*SearchCallback)(const SearchInfo& info, void* data);
 
 extern void init_search();
 extern int64_t perft(Position& pos, Depth depth);
+extern int perft_divide(const Position& pos, Depth depth, int threads, int hashMB, MoveStack* mlist, int64_t* counts);
 extern bool think(Position& pos, const SearchLimits& limits, Move searchMoves[], Move& NEW_bestMove, Move& NEW_ponderMove);
+extern SearchContext* create_search_context(TranspositionTable* tt);
+extern void delete_search_context(SearchContext* ctx);
+extern SearchContext* set_search_context(SearchContext* ctx);
+extern void set_search_callback(SearchContext* ctx, SearchCallback callback, void* data);
+extern void stop_search(SearchContext* ctx);
+extern void set_search_options(SearchContext* ctx, int skillLevel, const double params[]);
+extern void set_engine_options(SearchContext* ctx, const TimeOptions& time, const EvalOptions& eval);
+extern Move search_move(Position& pos, const SearchLimits& limits, Value* score);
 
 #endif // !defined(SEARCH_H_INCLUDED)
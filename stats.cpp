@@ -0,0 +1,101 @@
+/*
+  Hot path counters for Atomkraft
+*/
+
+#include <iomanip>
+#include <sstream>
+
+#include "stats.h"
+#include "thread.h"
+
+using namespace std;
+
+#if defined(USE_STATS)
+
+namespace {
+
+  // percent() formats a/b as a percentage, or "-" when b is zero
+  string percent(uint64_t a, uint64_t b) {
+
+    if (!b)
+        return "-";
+
+    ostringstream ss;
+    ss << fixed << setprecision(1) << 100.0 * a / b << "%";
+    return ss.str();
+  }
+}
+
+#endif
+
+
+/// clear_stats() resets the counters of all the threads
+
+void clear_stats() {
+
+  for (int i = 0; i < Threads.slot_count(); i++)
+      Threads[i].stats.clear();
+}
+
+
+/// stats_to_string() sums up the counters of all the threads and returns them
+/// as a human readable table, together with the derived rates. Counters are
+/// read while other threads could still write to them, which is fine as they
+/// are only statistics.
+
+string stats_to_string() {
+
+#if !defined(USE_STATS)
+
+  return "Statistics not available, rebuild with -DUSE_STATS\n";
+
+#else
+
+  uint64_t c[STAT_NB];
+  ostringstream ss;
+
+  memset(c, 0, sizeof(c));
+
+  for (int i = 0; i < Threads.slot_count(); i++)
+      for (int j = 0; j < STAT_NB; j++)
+          c[j] += Threads[i].stats.counters[j];
+
+  uint64_t moves =  c[STAT_DO_MOVE_QUIET] + c[STAT_DO_MOVE_CAPTURE] + c[STAT_DO_MOVE_CASTLE]
+                  + c[STAT_DO_MOVE_PROMOTION] + c[STAT_DO_MOVE_EP];
+  uint64_t probes = c[STAT_TT_HIT] + c[STAT_TT_MISS];
+
+  ss << "do_move total        " << moves
+     << "\n  quiet              " << c[STAT_DO_MOVE_QUIET]     << " (" << percent(c[STAT_DO_MOVE_QUIET], moves) << ")"
+     << "\n  capture            " << c[STAT_DO_MOVE_CAPTURE]   << " (" << percent(c[STAT_DO_MOVE_CAPTURE], moves) << ")"
+     << "\n  en passant         " << c[STAT_DO_MOVE_EP]        << " (" << percent(c[STAT_DO_MOVE_EP], moves) << ")"
+     << "\n  promotion          " << c[STAT_DO_MOVE_PROMOTION] << " (" << percent(c[STAT_DO_MOVE_PROMOTION], moves) << ")"
+     << "\n  castle             " << c[STAT_DO_MOVE_CASTLE]    << " (" << percent(c[STAT_DO_MOVE_CASTLE], moves) << ")"
+     << "\nexplosion size       ";
+
+  for (int i = 0; i <= 9; i++)
+      ss << i << ":" << c[STAT_EXPLOSION_SIZE_0 + i] << " ";
+
+  ss << "\nnnue refresh         " << c[STAT_NNUE_REFRESH]
+     << "\nnnue incremental     " << c[STAT_NNUE_UPDATE]
+     << "\ntt probes            " << probes
+     << "\n  hit                " << c[STAT_TT_HIT]       << " (" << percent(c[STAT_TT_HIT], probes) << ")"
+     << "\n  miss               " << c[STAT_TT_MISS]      << " (" << percent(c[STAT_TT_MISS], probes) << ")"
+     << "\n  collision          " << c[STAT_TT_COLLISION] << " (" << percent(c[STAT_TT_COLLISION], c[STAT_TT_HIT]) << " of hits)"
+     << "\nsearch nodes         " << c[STAT_SEARCH_NODES]
+     << "\nqsearch nodes        " << c[STAT_QSEARCH_NODES]
+     << " (" << percent(c[STAT_QSEARCH_NODES], c[STAT_SEARCH_NODES] + c[STAT_QSEARCH_NODES]) << ")"
+     << "\nnull move tried      " << c[STAT_NULL_TRIED]
+     << "\n  cutoff             " << c[STAT_NULL_CUTOFF]      << " (" << percent(c[STAT_NULL_CUTOFF], c[STAT_NULL_TRIED]) << ")"
+     << "\n  verify failed      " << c[STAT_NULL_VERIFY_FAIL] << " (" << percent(c[STAT_NULL_VERIFY_FAIL], c[STAT_NULL_TRIED]) << ")"
+     << "\nlmr tried            " << c[STAT_LMR_TRIED]
+     << "\n  re-searched        " << c[STAT_LMR_RESEARCH] << " (" << percent(c[STAT_LMR_RESEARCH], c[STAT_LMR_TRIED]) << ")"
+     << "\nbeta cutoffs         " << c[STAT_BETA_CUTOFF]
+     << "\n  on first move      " << c[STAT_BETA_CUTOFF_FIRST] << " (" << percent(c[STAT_BETA_CUTOFF_FIRST], c[STAT_BETA_CUTOFF]) << ")"
+     << "\nsplits               " << c[STAT_SPLIT]
+     << "\n  slaves per split   " << (c[STAT_SPLIT] ? double(c[STAT_SPLIT_SLAVES]) / c[STAT_SPLIT] : 0.0)
+     << "\n";
+
+  return ss.str();
+
+#endif
+}
@@ -0,0 +1,61 @@
+/*
+  Hot path counters for Atomkraft
+*/
+
+#if !defined(STATS_H_INCLUDED)
+#define STATS_H_INCLUDED
+
+#include <cstring>
+#include <string>
+
+#include "types.h"
+
+/// Counters of what happens on the hot paths of the search. They are compiled
+/// in only when USE_STATS is defined (see OPTIONS in the Makefile), otherwise
+/// STAT_INC() and STAT_ADD() expand to nothing. Every thread has its own
+/// ThreadStats object, see Thread::stats, so counting needs no locks.
+
+enum StatCounter {
+  STAT_DO_MOVE_QUIET,
+  STAT_DO_MOVE_CAPTURE,
+  STAT_DO_MOVE_CASTLE,
+  STAT_DO_MOVE_PROMOTION,
+  STAT_DO_MOVE_EP,
+  STAT_EXPLOSION_SIZE_0, // Pieces removed by the blast, not counting
+  STAT_EXPLOSION_SIZE_9 = STAT_EXPLOSION_SIZE_0 + 9, // the capturing one
+  STAT_NNUE_REFRESH,
+  STAT_NNUE_UPDATE,
+  STAT_TT_HIT,
+  STAT_TT_MISS,
+  STAT_TT_COLLISION,
+  STAT_SEARCH_NODES,
+  STAT_QSEARCH_NODES,
+  STAT_NULL_TRIED,
+  STAT_NULL_CUTOFF,
+  STAT_NULL_VERIFY_FAIL,
+  STAT_LMR_TRIED,
+  STAT_LMR_RESEARCH,
+  STAT_BETA_CUTOFF,
+  STAT_BETA_CUTOFF_FIRST,
+  STAT_SPLIT,
+  STAT_SPLIT_SLAVES,
+  STAT_NB
+};
+
+struct ThreadStats {
+  void clear() { memset(counters, 0, sizeof(counters)); }
+  uint64_t counters[STAT_NB];
+};
+
+#if defined(USE_STATS)
+#  define STAT_INC(th, c)    (Threads[th].stats.counters[c]++)
+#  define STAT_ADD(th, c, v) (Threads[th].stats.counters[c] += (v))
+#else
+#  define STAT_INC(th, c)    ((void)0)
+#  define STAT_ADD(th, c, v) ((void)0)
+#endif
+
+extern void clear_stats();
+extern std::string stats_to_string();
+
+#endif // !defined(STATS_H_INCLUDED)
@@ -0,0 +1,684 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2010 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "evaluate.h"
+#include "misc.h"
+#include "move.h"
+#include "pgn.h"
+#include "position.h"
+#include "texel.h"
+#include "thread.h"
+#include "ucioption.h"
+
+using namespace std;
+
+namespace {
+
+  enum { MG, EG };
+
+  // The tuned parameters are the UCI evaluation weights in percent, followed
+  // by the middle game and the endgame piece square tables of the white
+  // pieces, indexed by (piece type - 1) * 64 + square.
+  enum TexelParam {
+    MOBILITY_MG, MOBILITY_EG, PASSED_PAWNS_MG, PASSED_PAWNS_EG, SPACE_MG, KING_DANGER_MG,
+    PSQT_MG, PSQT_EG = PSQT_MG + 6 * 64, TEXEL_PARAM_NB = PSQT_EG + 6 * 64
+  };
+
+  const int TexelWeightNb = PSQT_MG;
+
+  // The evaluation weight, the half of the score and the UCI option of each
+  // of the weight parameters. The king danger weight is tuned the same for
+  // both kings and set to both "Cowardice" and "Aggressiveness".
+  const EvalWeight ParamWeight[] = {
+    MOBILITY_WEIGHT, MOBILITY_WEIGHT, PASSED_PAWNS_WEIGHT, PASSED_PAWNS_WEIGHT, SPACE_WEIGHT, KING_DANGER_WEIGHT
+  };
+  const int ParamPhase[] = { MG, EG, MG, EG, MG, MG };
+  const char* ParamOption[] = {
+    "Mobility (Middle Game)", "Mobility (Endgame)", "Passed Pawns (Middle Game)",
+    "Passed Pawns (Endgame)", "Space", "Cowardice"
+  };
+
+  const string StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+  // Positions, or games, are read in chunks of this size and converted by
+  // all the threads at once.
+  const size_t ChunkSize = 1 << 16;
+
+  // A TexelEntry is a labeled position reduced to its evaluation, which is a
+  // linear function of the parameters. The pieces are kept in a shared array
+  // as indices into the piece square tables plus one, negative for black.
+  struct TexelEntry {
+    float rest[2];                 // Middle game and endgame score not depending on the parameters
+    float phase[2];                // Weights of the middle game and endgame scores
+    float weights[TexelWeightNb];  // Change of the score for each 1% of the weights
+    float result;                  // 1, 0.5 or 0, from white point of view
+    uint32_t firstPiece;
+    uint8_t pieceCount;
+  };
+
+  // TexelState is shared by the tuner threads. Each of them works on its own
+  // slice of the chunk being read or of the entries, and keeps its results
+  // apart from the other threads.
+  struct TexelState {
+    vector<string> lines;
+    vector<PgnGame> games;
+    int skipPlies;
+    vector<TexelEntry> newEntries[MAX_THREADS];
+    vector<int16_t> newPieces[MAX_THREADS];
+
+    vector<TexelEntry> entries;
+    vector<int16_t> pieces;
+
+    int threads;
+    bool loading, gradient;
+    double K;
+    double params[TEXEL_PARAM_NB];
+    double error[MAX_THREADS];
+    double grad[MAX_THREADS][TEXEL_PARAM_NB]; // grad[0] is the sum of the others
+  };
+
+  TexelState TS;
+
+
+  // slice() returns the part [begin, end) of 'size' items of a worker
+
+  void slice(size_t size, int idx, size_t& begin, size_t& end) {
+
+    begin = size * (idx - 1) / TS.threads;
+    end = size * idx / TS.threads;
+  }
+
+
+  // add_position() evaluates a position and, unless the evaluation does not
+  // depend on the parameters, stores it as a new entry of the worker.
+
+  void add_position(const Position& pos, float result, int idx) {
+
+    EvalTerms terms;
+
+    if (!evaluate_terms(pos, terms))
+        return;
+
+    vector<int16_t>& pieces = TS.newPieces[idx];
+    double rest[2] = { double(mg_value(terms.score)), double(eg_value(terms.score)) };
+    TexelEntry e;
+
+    e.firstPiece = uint32_t(pieces.size());
+    e.pieceCount = 0;
+    e.result = result;
+    e.phase[MG] = float(terms.phase / 128.0);
+    e.phase[EG] = float(terms.scaleFactor * (128 - terms.phase) / (128.0 * SCALE_FACTOR_NORMAL));
+
+    // Remove the piece square scores, black ones are the mirrored white ones
+    for (Color c = WHITE; c <= BLACK; c++)
+        for (PieceType pt = PAWN; pt <= KING; pt++)
+        {
+            Bitboard b = pos.pieces(pt, c);
+
+            while (b)
+            {
+                Square s = pop_1st_bit(&b);
+                Square ws = (c == WHITE ? s : flip_square(s));
+                Score v = Position::pst(WHITE, pt, ws);
+                int sign = (c == WHITE ? 1 : -1);
+
+                pieces.push_back(int16_t(sign * ((pt - 1) * 64 + ws + 1)));
+                e.pieceCount++;
+                rest[MG] -= sign * int(mg_value(v));
+                rest[EG] -= sign * int(eg_value(v));
+            }
+        }
+
+    // And the weighted terms at the starting weights
+    for (int k = 0; k < TexelWeightNb; k++)
+    {
+        double coef = ParamPhase[k] == MG ? terms.mg[ParamWeight[k]] : terms.eg[ParamWeight[k]];
+
+        e.weights[k] = float(coef);
+        rest[ParamPhase[k]] -= coef * TS.params[k];
+    }
+
+    e.rest[MG] = float(rest[MG]);
+    e.rest[EG] = float(rest[EG]);
+    TS.newEntries[idx].push_back(e);
+  }
+
+
+  // parse_line() reads a position and its result from a line as "<fen> [1.0]",
+  // "<fen> 1-0" or an EPD line with the result in an operation as c9 "1-0".
+
+  bool parse_line(const string& line, string& fen, float& result) {
+
+    size_t i = line.find('[');
+
+    if (i != string::npos)
+        result = float(atof(line.c_str() + i + 1));
+    else if (line.find("1/2-1/2") != string::npos)
+        result = 0.5f;
+    else if (line.find("1-0") != string::npos)
+        result = 1.0f;
+    else if (line.find("0-1") != string::npos)
+        result = 0.0f;
+    else
+        return false;
+
+    // EPD lines have only four fields, followed by the operations
+    istringstream ss(line.substr(0, line.find_first_of(";[|\"")));
+    string token;
+
+    fen.clear();
+
+    for (int j = 0; j < 6 && ss >> token; j++)
+    {
+        if (j >= 4 && token.find_first_not_of("0123456789") != string::npos)
+            break;
+
+        fen += (j ? " " : "") + token;
+    }
+
+    return count(fen.begin(), fen.end(), ' ') >= 3 && result >= 0 && result <= 1;
+  }
+
+
+  // load_slice() turns the lines, or the games, of its slice of the chunk
+  // into entries. All the positions of a game, after the first skipPlies
+  // plies, are labeled with the game result.
+
+  void load_slice(int idx, int threadID) {
+
+    size_t begin, end;
+    string fen;
+    float result;
+
+    slice(TS.lines.size(), idx, begin, end);
+
+    for (size_t i = begin; i < end; i++)
+        if (parse_line(TS.lines[i], fen, result))
+        {
+            Position pos(fen, false, threadID);
+            add_position(pos, result, idx);
+        }
+
+    slice(TS.games.size(), idx, begin, end);
+
+    for (size_t i = begin; i < end; i++)
+    {
+        const PgnGame& game = TS.games[i];
+        PgnToken tag, san;
+
+        if (!game.tag("Result", tag))
+            continue;
+
+        string r = tag.to_string();
+
+        if (r == "1-0")
+            result = 1.0f;
+        else if (r == "0-1")
+            result = 0.0f;
+        else if (r == "1/2-1/2")
+            result = 0.5f;
+        else
+            continue;
+
+        Position pos(game.tag("FEN", tag) ? tag.to_string() : StartFEN, false, threadID);
+        PgnMoveIterator it(game);
+
+        for (int ply = 0; pos.piece_count(WHITE, KING) && pos.piece_count(BLACK, KING); ply++)
+        {
+            if (ply >= TS.skipPlies)
+                add_position(pos, result, idx);
+
+            if (!it.next(san))
+                break;
+
+            Move m = move_from_san(pos, san.str, san.len);
+            if (m == MOVE_NONE)
+                break;
+
+            pos.do_setup_move(m);
+        }
+    }
+  }
+
+
+  // evaluate_entry() is the evaluation of an entry with the given parameters
+
+  double evaluate_entry(const TexelEntry& e, const double* p) {
+
+    double score[2] = { e.rest[MG], e.rest[EG] };
+    const int16_t* pc = &TS.pieces[e.firstPiece];
+
+    for (int k = 0; k < TexelWeightNb; k++)
+        score[ParamPhase[k]] += e.weights[k] * p[k];
+
+    for (int i = 0; i < e.pieceCount; i++)
+    {
+        int idx = abs(pc[i]) - 1;
+        int sign = (pc[i] > 0 ? 1 : -1);
+
+        score[MG] += sign * p[PSQT_MG + idx];
+        score[EG] += sign * p[PSQT_EG + idx];
+    }
+    return score[MG] * e.phase[MG] + score[EG] * e.phase[EG];
+  }
+
+
+  // error_slice() computes the squared error, and its gradient, of the
+  // predicted results of the entries in its slice. The prediction of an
+  // evaluation v is 1 / (1 + 10^(-K * v / 400)).
+
+  void error_slice(int idx) {
+
+    const double Ln10 = log(10.0);
+    double* g = TS.grad[idx];
+    double err = 0;
+    size_t begin, end;
+
+    slice(TS.entries.size(), idx, begin, end);
+
+    if (TS.gradient)
+        memset(g, 0, sizeof(TS.grad[0]));
+
+    for (size_t i = begin; i < end; i++)
+    {
+        const TexelEntry& e = TS.entries[i];
+        double s = 1.0 / (1.0 + exp(-TS.K * evaluate_entry(e, TS.params) * Ln10 / 400.0));
+        double d = e.result - s;
+
+        err += d * d;
+
+        if (!TS.gradient)
+            continue;
+
+        // Derivative of the squared error by the evaluation
+        double f = -2.0 * d * s * (1.0 - s) * TS.K * Ln10 / 400.0;
+        const int16_t* pc = &TS.pieces[e.firstPiece];
+
+        for (int k = 0; k < TexelWeightNb; k++)
+            g[k] += f * e.weights[k] * e.phase[ParamPhase[k]];
+
+        for (int j = 0; j < e.pieceCount; j++)
+        {
+            int idx = abs(pc[j]) - 1;
+            double fs = (pc[j] > 0 ? f : -f);
+
+            g[PSQT_MG + idx] += fs * e.phase[MG];
+            g[PSQT_EG + idx] += fs * e.phase[EG];
+        }
+    }
+    TS.error[idx] = err;
+  }
+
+
+  void texel_worker(int idx, int threadID) {
+
+    if (TS.loading)
+        load_slice(idx, threadID);
+    else
+        error_slice(idx);
+  }
+
+
+  // run_threads() runs texel_worker() on workers 1 to TS.threads and waits
+  // for them to finish.
+
+  void run_threads() {
+
+    Threads.run_workers(texel_worker, TS.threads);
+  }
+
+
+  // load_chunk() converts the lines or games read so far and appends the
+  // new entries, in the order they were read.
+
+  void load_chunk() {
+
+    TS.loading = true;
+    run_threads();
+
+    for (int i = 1; i <= TS.threads; i++)
+    {
+        uint32_t offset = uint32_t(TS.pieces.size());
+
+        for (size_t j = 0; j < TS.newEntries[i].size(); j++)
+        {
+            TS.newEntries[i][j].firstPiece += offset;
+            TS.entries.push_back(TS.newEntries[i][j]);
+        }
+
+        TS.pieces.insert(TS.pieces.end(), TS.newPieces[i].begin(), TS.newPieces[i].end());
+        TS.newEntries[i].clear();
+        TS.newPieces[i].clear();
+    }
+
+    TS.lines.clear();
+    TS.games.clear();
+  }
+
+
+  // mean_error() returns the mean squared error of the entries and, if asked,
+  // leaves its gradient in TS.grad[0].
+
+  double mean_error(bool gradient) {
+
+    double err = 0;
+
+    TS.loading = false;
+    TS.gradient = gradient;
+    run_threads();
+
+    if (gradient)
+        memset(TS.grad[0], 0, sizeof(TS.grad[0]));
+
+    for (int i = 1; i <= TS.threads; i++)
+    {
+        err += TS.error[i];
+
+        if (gradient)
+            for (int k = 0; k < TEXEL_PARAM_NB; k++)
+                TS.grad[0][k] += TS.grad[i][k];
+    }
+
+    if (gradient)
+        for (int k = 0; k < TEXEL_PARAM_NB; k++)
+            TS.grad[0][k] /= TS.entries.size();
+
+    return err / TS.entries.size();
+  }
+
+
+  // fit_k() finds, by golden section search, the scaling constant K of the
+  // prediction which best fits the results with the starting parameters.
+
+  double fit_k() {
+
+    const double R = (sqrt(5.0) - 1) / 2;
+    double a = 0.01, b = 4.0;
+
+    for (int i = 0; i < 40; i++)
+    {
+        double k1 = b - R * (b - a), k2 = a + R * (b - a);
+
+        TS.K = k1;
+        double e1 = mean_error(false);
+        TS.K = k2;
+        double e2 = mean_error(false);
+
+        if (e1 < e2)
+            b = k2;
+        else
+            a = k1;
+    }
+    return (a + b) / 2;
+  }
+
+
+  // write_psqt() writes the piece square tables in the format of psqtab.h
+
+  void write_psqt(const string& fileName) {
+
+    const char* Names[] = { "", "Pawn", "Knight", "Bishop", "Rook", "Queen", "King" };
+    const char* Symbols[2][6] = { { "", "MP", "MK", "MB", "MR", "MQ" },
+                                  { "", "EP", "EK", "EB", "ER", "EQ" } };
+    const Value PieceValues[2][6] = {
+      { VALUE_ZERO, PawnValueMidgame, KnightValueMidgame, BishopValueMidgame, RookValueMidgame, QueenValueMidgame },
+      { VALUE_ZERO, PawnValueEndgame, KnightValueEndgame, BishopValueEndgame, RookValueEndgame, QueenValueEndgame }
+    };
+
+    ofstream file(fileName.c_str());
+
+    for (int h = MG; h <= EG; h++)
+    {
+        file << "const int " << (h == MG ? "MgPST" : "EgPST") << "[][64] = {\n  { },\n";
+
+        for (int pt = PAWN; pt <= KING; pt++)
+        {
+            file << "  {// " << Names[pt] << "\n";
+
+            for (Square s = SQ_A1; s <= SQ_H8; s++)
+            {
+                int v = int(floor(TS.params[(h == MG ? PSQT_MG : PSQT_EG) + (pt - 1) * 64 + s] + 0.5));
+
+                file << (square_file(s) == FILE_A ? "    " : " ");
+
+                if (pt == PAWN && (square_rank(s) == RANK_1 || square_rank(s) == RANK_8))
+                    file << setw(6) << 0;
+                else if (pt == KING)
+                    file << setw(6) << v;
+                else
+                {
+                    int d = v - int(PieceValues[h][pt]);
+                    file << Symbols[h][pt] << (d < 0 ? "-" : "+") << setw(3) << abs(d);
+                }
+
+                file << (s == SQ_H8 ? "\n" : square_file(s) == FILE_H ? ",\n" : ",");
+            }
+            file << (pt == KING ? "  }\n" : "  },\n");
+        }
+        file << "};\n\n";
+    }
+  }
+
+} // namespace
+
+
+/// texel_tune() tunes the handcrafted evaluation on a set of positions
+/// labeled with the result of their game, as example:
+///
+///   texel positions data.epd threads 8 epochs 500
+///
+/// The tuned parameters are the weights of the UCI options "Mobility",
+/// "Passed Pawns", "Space", "Cowardice" and "Aggressiveness", and the piece
+/// square tables of psqtab.h. Each position is evaluated once, tracing the
+/// terms which depend on the parameters, and kept in memory as the linear
+/// function of the parameters its evaluation is. The mean squared error of
+/// the results predicted from the evaluations is then minimized with Adam,
+/// spreading the positions on the threads.
+///
+/// Arguments are: "positions" file with a FEN or EPD position and its result
+/// on each line, or PGN games whose positions are labeled with the game
+/// result, "skip" plies at the start of each game (8), "concurrency" (1),
+/// "epochs" (300), "rate" of learning (1.0), "k" the scaling constant of the
+/// predictions, fitted if not given, and "psqt" file where the tuned tables
+/// are written (psqt.txt). The tuned weights are set as UCI options.
+
+void texel_tune(istream& is) {
+
+  string token, fileName, psqtFile = "psqt.txt";
+  int epochs = 300;
+  double rate = 1.0, k = 0;
+
+  TS.threads = 1;
+  TS.skipPlies = 8;
+
+  while (is >> token)
+  {
+      if (token == "positions")
+          is >> fileName;
+      else if (token == "skip")
+          is >> TS.skipPlies;
+      else if (token == "concurrency")
+          is >> TS.threads;
+      else if (token == "epochs")
+          is >> epochs;
+      else if (token == "rate")
+          is >> rate;
+      else if (token == "k")
+          is >> k;
+      else if (token == "psqt")
+          is >> psqtFile;
+      else
+      {
+          cout << "Unknown texel argument: " << token << endl;
+          return;
+      }
+  }
+
+  TS.threads = Max(1, Min(TS.threads, MAX_THREADS - 1));
+
+  // Start from the current weights, with symmetrical king safety
+  read_evaluation_uci_options(WHITE);
+
+  for (int i = 0; i < TexelWeightNb; i++)
+      TS.params[i] = Options[ParamOption[i]].value<int>();
+
+  TS.params[KING_DANGER_MG] = (  Options["Cowardice"].value<int>()
+                               + Options["Aggressiveness"].value<int>()) / 2.0;
+
+  for (PieceType pt = PAWN; pt <= KING; pt++)
+      for (Square s = SQ_A1; s <= SQ_H8; s++)
+      {
+          TS.params[PSQT_MG + (pt - 1) * 64 + s] = mg_value(Position::pst(WHITE, pt, s));
+          TS.params[PSQT_EG + (pt - 1) * 64 + s] = eg_value(Position::pst(WHITE, pt, s));
+      }
+
+  TS.entries.clear();
+  TS.pieces.clear();
+
+  bool isPgn = fileName.size() > 4 && fileName.substr(fileName.size() - 4) == ".pgn";
+  int64_t time = get_system_time();
+  size_t read = 0;
+
+  if (isPgn)
+  {
+      PgnReader pgn;
+      PgnGame game;
+
+      if (!pgn.open(fileName))
+      {
+          cout << "Unable to open " << fileName << endl;
+          return;
+      }
+
+      // The games point inside the reader mapping, so they are converted
+      // before it is closed.
+      while (pgn.next_game(game))
+      {
+          TS.games.push_back(game);
+          read++;
+
+          if (TS.games.size() == ChunkSize)
+              load_chunk();
+      }
+      load_chunk();
+  }
+  else
+  {
+      ifstream file(fileName.c_str());
+      string line;
+
+      if (!file)
+      {
+          cout << "Unable to open " << fileName << endl;
+          return;
+      }
+
+      while (getline(file, line))
+      {
+          TS.lines.push_back(line);
+          read++;
+
+          if (TS.lines.size() == ChunkSize)
+              load_chunk();
+      }
+      load_chunk();
+  }
+
+  int64_t elapsed = Max(int64_t(1), get_system_time() - time);
+
+  cout << "Loaded " << TS.entries.size() << " positions from " << read
+       << (isPgn ? " games" : " lines")
+       << " in " << elapsed / 1000.0 << " s, " << TS.entries.size() * 1000 / elapsed
+       << " positions/s, " << (TS.entries.size() * sizeof(TexelEntry) + TS.pieces.size() * sizeof(int16_t)) / (1 << 20)
+       << " MB" << endl;
+
+  if (TS.entries.empty())
+      return;
+
+  TS.K = k > 0 ? k : fit_k();
+
+  cout << "K = " << TS.K << ", error " << setprecision(8) << mean_error(false) << setprecision(6) << endl;
+
+  // Adam, with the usual decay rates of the moment estimates
+  const double Beta1 = 0.9, Beta2 = 0.999, Epsilon = 1e-8;
+  vector<double> m(TEXEL_PARAM_NB, 0.0), v(TEXEL_PARAM_NB, 0.0);
+  double b1 = 1, b2 = 1;
+
+  time = get_system_time();
+
+  for (int epoch = 1; epoch <= epochs; epoch++)
+  {
+      double err = mean_error(true);
+
+      b1 *= Beta1;
+      b2 *= Beta2;
+
+      for (int i = 0; i < TEXEL_PARAM_NB; i++)
+      {
+          double g = TS.grad[0][i];
+
+          m[i] = Beta1 * m[i] + (1 - Beta1) * g;
+          v[i] = Beta2 * v[i] + (1 - Beta2) * g * g;
+          TS.params[i] -= rate * (m[i] / (1 - b1)) / (sqrt(v[i] / (1 - b2)) + Epsilon);
+      }
+
+      // The weights must stay in the range of their UCI options
+      for (int i = 0; i < TexelWeightNb; i++)
+          TS.params[i] = Max(0.0, Min(TS.params[i], 200.0));
+
+      if (epoch % 10 == 0 || epoch == epochs)
+          cout << "Epoch " << epoch << ", error " << setprecision(8) << err << setprecision(6)
+               << ", " << (get_system_time() - time) / 1000.0 << " s" << endl;
+  }
+
+  cout << "Final error " << setprecision(8) << mean_error(false) << setprecision(6) << endl;
+
+  for (int i = 0; i < TexelWeightNb; i++)
+  {
+      ostringstream ss;
+      ss << int(floor(TS.params[i] + 0.5));
+
+      Options[ParamOption[i]].set_value(ss.str());
+      cout << "setoption name " << ParamOption[i] << " value " << ss.str() << endl;
+
+      if (i == KING_DANGER_MG)
+      {
+          Options["Aggressiveness"].set_value(ss.str());
+          cout << "setoption name Aggressiveness value " << ss.str() << endl;
+      }
+  }
+
+  write_psqt(psqtFile);
+  cout << "Piece square tables written to " << psqtFile << endl;
+
+  // Release the memory of the entries
+  vector<TexelEntry>().swap(TS.entries);
+  vector<int16_t>().swap(TS.pieces);
+}
@@ -19,12 +19,24 @@
 
 #include <iostream>
 
+#if !defined(_MSC_VER)
+#  include <sched.h>
+#endif
+
 #include "thread.h"
 #include "ucioption.h"
 
 ThreadsManager Threads; // Global object definition
 
-namespace { extern "C" {
+namespace {
+
+  // A worker started by ThreadsManager::run_workers()
+  struct Worker {
+    void (*func)(int idx, int threadID);
+    int idx, threadID;
+  };
+
+extern "C" {
 
  // start_routine() is the C function which is called when a new thread
  // is launched. It simply calls idle_loop() with the supplied threadID.
@@ -47,6 +59,26 @@ namespace { extern "C" {
     return NULL;
   }
 
+#endif
+
+  // worker_start_routine() is the same for the threads of run_workers()
+
+#if defined(_MSC_VER)
+
+  DWORD WINAPI worker_start_routine(LPVOID worker) {
+
+    ((Worker*)worker)->func(((Worker*)worker)->idx, ((Worker*)worker)->threadID);
+    return 0;
+  }
+
+#else
+
+  void* worker_start_routine(void* worker) {
+
+    ((Worker*)worker)->func(((Worker*)worker)->idx, ((Worker*)worker)->threadID);
+    return NULL;
+  }
+
 #endif
 
 } }
@@ -132,6 +164,7 @@ void ThreadsManager::init() {
   init_hash_tables();
 
   lock_init(&mpLock);
+  lock_init(&slotLock);
 
   // Initialize thread and split point locks
   for (int i = 0; i < MAX_THREADS; i++)
@@ -161,10 +194,20 @@ void ThreadsManager::init() {
           std::cout << "Failed to create thread number " << i << std::endl;
           ::exit(EXIT_FAILURE);
       }
-
-      // Wait until the thread has finished launching and is gone to sleep
-      while (threads[i].state == Thread::INITIALIZING) {}
   }
+
+  // Wait until all the threads have finished launching and are gone to sleep.
+  // They start at the same time, and yielding lets them run at once even
+  // when there are less cores than threads.
+  for (int i = 1; i < MAX_THREADS; i++)
+      while (threads[i].state == Thread::INITIALIZING)
+      {
+#if defined(_MSC_VER)
+          Sleep(0);
+#else
+          sched_yield();
+#endif
+      }
 }
 
 
@@ -193,21 +236,154 @@ void ThreadsManager::exit() {
   }
 
   lock_destroy(&mpLock);
+  lock_destroy(&slotLock);
 }
 
 
-// init_hash_tables() dynamically allocates pawn and material hash tables
-// according to the number of active threads. This avoids preallocating
-// memory for all possible threads if only few are used as, for instance,
-// on mobile devices where memory is scarce and allocating for MAX_THREADS
-// threads could even result in a crash.
+// init_hash_tables() dynamically allocates pawn and material hash tables, and
+// the NNUE accumulator stacks, according to the number of active threads.
+// This avoids preallocating memory for all possible threads if only few are
+// used as, for instance, on mobile devices where memory is scarce and
+// allocating for MAX_THREADS threads could even result in a crash.
 
 void ThreadsManager::init_hash_tables() {
 
   for (int i = 0; i < activeThreads; i++)
+      threads[i].init_tables();
+}
+
+
+// Thread::init_tables() allocates the pawn and material hash tables and the
+// NNUE accumulator stack of the thread, if not done yet.
+
+void Thread::init_tables() {
+
+  pawnTable.init();
+  materialTable.init();
+
+  if (nnueStack)
+      return;
+
+  nnueStack = new (std::nothrow) NnueEntry[NnueStackSize];
+  if (!nnueStack)
+  {
+      std::cerr << "Failed to allocate " << NnueStackSize * sizeof(NnueEntry)
+                << " bytes for the NNUE accumulators." << std::endl;
+      ::exit(EXIT_FAILURE);
+  }
+
+  for (int i = 0; i < NnueStackSize; i++)
+      nnueStack[i].state = NULL;
+}
+
+
+// acquire_slot() takes a free thread slot, out of the threads of the UCI
+// search, and allocates its tables, see Thread::init_tables(). When all the
+// slots are taken a new chunk of them is allocated. The slot is given back
+// with release_slot(). Returns -1 if no slot can be had.
+
+int ThreadsManager::acquire_slot() {
+
+  int slot;
+
+  lock_grab(&slotLock);
+
+  for (slot = MAX_THREADS; slot < slot_count() && slotUsed[slot]; slot++) {}
+
+  if (slot == slot_count() && slotChunkCount < MAX_SLOT_CHUNKS)
   {
-      threads[i].pawnTable.init();
-      threads[i].materialTable.init();
+      // Value initialized, the hash tables are allocated by their init()
+      Thread* chunk = new (std::nothrow) Thread[SLOT_CHUNK_SIZE]();
+
+      if (chunk)
+      {
+          slotChunks[slotChunkCount] = chunk;
+          slotChunkCount++;
+      }
+  }
+
+  if (slot < slot_count())
+      slotUsed[slot] = true;
+  else
+      slot = -1;
+
+  lock_release(&slotLock);
+
+  if (slot == -1)
+      return -1;
+
+  Thread& t = (*this)[slot];
+
+  t.init_tables();
+  t.splitPoint = NULL;
+  t.maxPly = 0;
+  return slot;
+}
+
+void ThreadsManager::release_slot(int threadID) {
+
+  assert(threadID >= MAX_THREADS && threadID < MAX_SLOTS);
+
+  lock_grab(&slotLock);
+  slotUsed[threadID] = false;
+  lock_release(&slotLock);
+}
+
+
+// run_workers() runs worker(idx, threadID) on 'count' new threads, idx from 1
+// to 'count', and returns when all of them have returned. Each thread takes
+// a slot of its own, threadID, with its pawn and material hash tables. If
+// given, master() is run by the caller meanwhile.
+
+void ThreadsManager::run_workers(void (*worker)(int idx, int threadID), int count, void (*master)()) {
+
+  Worker workers[MAX_THREADS];
+
+#if defined(_MSC_VER)
+  HANDLE handles[MAX_THREADS];
+#else
+  pthread_t handles[MAX_THREADS];
+#endif
+
+  assert(count >= 0 && count < MAX_THREADS);
+
+  for (int i = 1; i <= count; i++)
+  {
+      workers[i].func = worker;
+      workers[i].idx = i;
+      workers[i].threadID = acquire_slot();
+
+      if (workers[i].threadID == -1)
+      {
+          std::cout << "No thread slot left for worker thread number " << i << std::endl;
+          ::exit(EXIT_FAILURE);
+      }
+
+#if defined(_MSC_VER)
+      handles[i] = CreateThread(NULL, 0, worker_start_routine, (LPVOID)&workers[i], 0, NULL);
+      bool ok = (handles[i] != NULL);
+#else
+      bool ok = (pthread_create(&handles[i], NULL, worker_start_routine, (void*)&workers[i]) == 0);
+#endif
+      if (!ok)
+      {
+          std::cout << "Failed to create worker thread number " << i << std::endl;
+          ::exit(EXIT_FAILURE);
+      }
+  }
+
+  if (master)
+      master();
+
+  for (int i = 1; i <= count; i++)
+  {
+#if defined(_MSC_VER)
+      WaitForSingleObject(handles[i], INFINITE);
+      CloseHandle(handles[i]);
+#else
+      pthread_join(handles[i], NULL);
+#endif
+      release_slot(workers[i].threadID);
   }
 }
 
@@ -263,6 +439,10 @@ void ThreadsManager::split(Position& pos, SearchStack* ss, Value* alpha, const V
       return;
   }
 
+  // The slaves copy the accumulators of the position, they are computed now
+  // so that nobody writes them during the split.
+  pos.nnue_accumulators();
+
   // Pick the next available split point object from the split point stack
   SplitPoint& splitPoint = masterThread.splitPoints[masterThread.activeSplitPoints++];
 
@@ -303,6 +483,9 @@ void ThreadsManager::split(Position& pos, SearchStack* ss, Value* alpha, const V
 
   assert(Fake || workersCnt > 1);
 
+  STAT_INC(master, STAT_SPLIT);
+  STAT_ADD(master, STAT_SPLIT_SLAVES, workersCnt - 1);
+
   // We can release the lock because slave threads are already booked and master is not available
   lock_release(&mpLock);
 
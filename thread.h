@@ -27,8 +27,16 @@
 #include "movepick.h"
 #include "pawns.h"
 #include "position.h"
+#include "stats.h"
 
+// Threads 0 to MAX_THREADS - 1 are the ones of the UCI search, the others
+// are slots for the searches running in a context of their own, like the
+// engines and the workers of run_workers(), see acquire_slot(). The slots
+// are allocated on demand, SLOT_CHUNK_SIZE at a time.
 const int MAX_THREADS = 32;
+const int SLOT_CHUNK_SIZE = 32;
+const int MAX_SLOT_CHUNKS = 1024;
+const int MAX_SLOTS = MAX_THREADS + MAX_SLOT_CHUNKS * SLOT_CHUNK_SIZE;
 const int MAX_ACTIVE_SPLIT_POINTS = 8;
 
 struct SplitPoint {
@@ -61,7 +69,8 @@ struct SplitPoint {
 /// Thread struct is used to keep together all the thread related stuff like locks,
 /// state and especially split points. We also use per-thread pawn and material hash
 /// tables so that once we get a pointer to an entry its life time is unlimited and
-/// we don't have to care about someone changing the entry under our feet.
+/// we don't have to care about someone changing the entry under our feet. The
+/// stack of NNUE accumulators is shared by the positions of the thread.
 
 struct Thread {
 
@@ -75,12 +84,15 @@ struct Thread {
     TERMINATED     // We are quitting and thread is terminated
   };
 
+  void init_tables();
   void wake_up();
   bool cutoff_occurred() const;
   bool is_available_to(int master) const;
 
   MaterialInfoTable materialTable;
   PawnInfoTable pawnTable;
+  NnueEntry* nnueStack;
+  ThreadStats stats;
   int maxPly;
   Lock sleepLock;
   WaitCondition sleepCond;
@@ -101,10 +113,14 @@ class ThreadsManager {
      static storage duration are automatically set to zero before enter main()
   */
 public:
-  Thread& operator[](int threadID) { return threads[threadID]; }
+  Thread& operator[](int threadID);
   void init();
   void exit();
   void init_hash_tables();
+  void run_workers(void (*worker)(int idx, int threadID), int count, void (*master)() = NULL);
+  int acquire_slot();
+  void release_slot(int threadID);
+  int slot_count() const { return MAX_THREADS + slotChunkCount * SLOT_CHUNK_SIZE; }
 
   int min_split_depth() const { return minimumSplitDepth; }
   int size() const { return activeThreads; }
@@ -118,15 +134,32 @@ public:
   void split(Position& pos, SearchStack* ss, Value* alpha, const Value beta, Value* bestValue,
              Depth depth, Move threatMove, int moveCount, MovePicker* mp, bool pvNode);
 private:
-  Lock mpLock;
+  Lock mpLock, slotLock;
   Depth minimumSplitDepth;
   int maxThreadsPerSplitPoint;
   bool useSleepingThreads;
   int activeThreads;
   volatile bool allThreadsShouldExit;
+  bool slotUsed[MAX_SLOTS];
   Thread threads[MAX_THREADS];
+  Thread* slotChunks[MAX_SLOT_CHUNKS];
+  volatile int slotChunkCount;
 };
 
 extern ThreadsManager Threads;
 
+
+/// ThreadsManager::operator[] returns a thread of the UCI search or a slot.
+/// The chunk of a slot is allocated before the slot is given, and is never
+/// freed, so that the returned reference is always valid.
+
+inline Thread& ThreadsManager::operator[](int threadID) {
+
+  if (threadID < MAX_THREADS)
+      return threads[threadID];
+
+  threadID -= MAX_THREADS;
+  return slotChunks[threadID / SLOT_CHUNK_SIZE][threadID % SLOT_CHUNK_SIZE];
+}
+
 #endif // !defined(THREAD_H_INCLUDED)
@@ -18,6 +18,7 @@
 */
 
 #include <cmath>
+#include <cstdlib>
 
 #include "misc.h"
 #include "search.h"
@@ -86,7 +87,47 @@ void TimeManager::pv_instability(int curChanges, int prevChanges) {
 }
 
 
-void TimeManager::init(const SearchLimits& limits, int currentPly)
+/// TimeOptions::TimeOptions() sets the defaults of the UCI options
+
+TimeOptions::TimeOptions() : emergencyMoveHorizon(20), emergencyBaseTime(3000),
+                             emergencyMoveTime(70), minThinkingTime(0), ponder(false) {}
+
+
+/// TimeOptions::set_option() sets one of the options as the UCI option of
+/// the same name. Returns false if there is no such option.
+
+bool TimeOptions::set_option(const std::string& name, const std::string& value) {
+
+  if (name == "Emergency Move Horizon")
+      emergencyMoveHorizon = atoi(value.c_str());
+  else if (name == "Emergency Base Time")
+      emergencyBaseTime = atoi(value.c_str());
+  else if (name == "Emergency Move Time")
+      emergencyMoveTime = atoi(value.c_str());
+  else if (name == "Minimum Thinking Time")
+      minThinkingTime = atoi(value.c_str());
+  else if (name == "Ponder")
+      ponder = (value == "true");
+  else
+      return false;
+
+  return true;
+}
+
+
+/// TimeOptions::read_uci_options() copies the values of the UCI options
+
+void TimeOptions::read_uci_options() {
+
+  emergencyMoveHorizon = Options["Emergency Move Horizon"].value<int>();
+  emergencyBaseTime    = Options["Emergency Base Time"].value<int>();
+  emergencyMoveTime    = Options["Emergency Move Time"].value<int>();
+  minThinkingTime      = Options["Minimum Thinking Time"].value<int>();
+  ponder               = Options["Ponder"].value<bool>();
+}
+
+
+void TimeManager::init(const TimeOptions& options, const SearchLimits& limits, int currentPly)
 {
   /* We support four different kind of time controls:
 
@@ -105,11 +146,10 @@ void TimeManager::init(const SearchLimits& limits, int currentPly)
 
   int hypMTG, hypMyTime, t1, t2;
 
-  // Read uci parameters
-  int emergencyMoveHorizon = Options["Emergency Move Horizon"].value<int>();
-  int emergencyBaseTime    = Options["Emergency Base Time"].value<int>();
-  int emergencyMoveTime    = Options["Emergency Move Time"].value<int>();
-  int minThinkingTime      = Options["Minimum Thinking Time"].value<int>();
+  int emergencyMoveHorizon = options.emergencyMoveHorizon;
+  int emergencyBaseTime    = options.emergencyBaseTime;
+  int emergencyMoveTime    = options.emergencyMoveTime;
+  int minThinkingTime      = options.minThinkingTime;
 
   // Initialize to maximum values but unstablePVExtraTime that is reset
   unstablePVExtraTime = 0;
@@ -134,7 +174,7 @@ void TimeManager::init(const SearchLimits& limits, int currentPly)
       maximumSearchTime = Min(maximumSearchTime, t2);
   }
 
-  if (Options["Ponder"].value<bool>()) {
+  if (options.ponder) {
       OLD optimumSearchTime += optimumSearchTime / 4;
       NEW optimumSearchTime += optimumSearchTime;
   }
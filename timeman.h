@@ -20,12 +20,27 @@
 #if !defined(TIMEMAN_H_INCLUDED)
 #define TIMEMAN_H_INCLUDED
 
+#include <string>
+
 struct SearchLimits;
 
+/// TimeOptions are the UCI options of the time manager. Each search context
+/// has its own, the defaults are the ones of the UCI options.
+
+struct TimeOptions {
+
+  TimeOptions();
+  bool set_option(const std::string& name, const std::string& value);
+  void read_uci_options();
+
+  int emergencyMoveHorizon, emergencyBaseTime, emergencyMoveTime, minThinkingTime;
+  bool ponder;
+};
+
 class TimeManager {
 public:
 
-  void init(const SearchLimits& limits, int currentPly);
+  void init(const TimeOptions& options, const SearchLimits& limits, int currentPly);
   void pv_instability(int curChanges, int prevChanges);
   int available_time() const { return optimumSearchTime + unstablePVExtraTime; }
   int maximum_time() const { return maximumSearchTime; }
@@ -13,8 +13,17 @@
 #include "tuning.h"
 #include "rkiss.h"
 #include "types.h"
-
+#include "evaluate.h"
+#include "match.h"
+#include "misc.h"
+#include "search.h"
+#include "ucioption.h"
+
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <vector>
 #include <stdarg.h>
 #include <assert.h>
 #include <math.h>
@@ -67,21 +76,46 @@ VarTuning::VarTuning(int s, ...) {
 	va_list vl;
 	va_start(vl, s);
 	for (int k = 0; k < size; ++k) {
-		var[k].valueptr = (tune_t*)va_arg(vl, double*);
-		var[k].value = *var[k].valueptr;
-		var[k].startvalue = *var[k].valueptr;
-		var[k].deltaAxisFactor = DELTA_AXIS_FACTOR;
-		var[k].sdevSum = 0.0;
-		var[k].varSum = 0.0;
-		var[k].applyFactor = APPLY_FACTOR;
-		memset(var[k].history, 0, sizeof(tune_t) * TUNE_HISTORY_SIZE);
-		var[k].historyIndex = 0;
+		init_var(k, (tune_t*)va_arg(vl, double*));
 	}
 	va_end(vl);
 	
 }
 
 
+// tunes the s variables of an array
+VarTuning::VarTuning(int s, tune_t* values) {
+	
+	for (int k = abs(rand() % 10000); k > 0; --k) {
+		rkiss.rand<unsigned>();
+	}
+	
+	updateCount = 0;
+	size = s;
+	
+	assert(size >= 0 && size < 100);
+	
+	for (int k = 0; k < size; ++k) {
+		init_var(k, values + k);
+	}
+}
+
+
+void VarTuning::init_var(int k, tune_t* valueptr) {
+	var[k].valueptr = valueptr;
+	var[k].value = *var[k].valueptr;
+	var[k].startvalue = *var[k].valueptr;
+	var[k].minValue = -HUGE_VAL;
+	var[k].maxValue = HUGE_VAL;
+	var[k].deltaAxisFactor = DELTA_AXIS_FACTOR;
+	var[k].sdevSum = 0.0;
+	var[k].varSum = 0.0;
+	var[k].applyFactor = APPLY_FACTOR;
+	memset(var[k].history, 0, sizeof(tune_t) * TUNE_HISTORY_SIZE);
+	var[k].historyIndex = 0;
+}
+
+
 void VarTuning::prepare_deltas() {
 	double norm;
 	int64_t s = 0;
@@ -103,6 +137,31 @@ void VarTuning::prepare_deltas() {
 }
 
 
+// draws the deltas of one game pair into an array, for the parallel tuner
+// which plays a batch of pairs, each with its own deltas
+void VarTuning::prepare_deltas(tune_t* deltas) {
+	for (int k = 0; k < size; ++k) {
+		deltas[k] = var[k].delta;
+	}
+	
+	prepare_deltas();
+	
+	for (int k = 0; k < size; ++k) {
+		tune_t d = var[k].delta;
+		var[k].delta = deltas[k];
+		deltas[k] = d;
+	}
+}
+
+
+// sets the bounds of a variable, the updates are clamped to them before
+// they are recorded in the statistics
+void VarTuning::set_bounds(int k, tune_t minValue, tune_t maxValue) {
+	var[k].minValue = minValue;
+	var[k].maxValue = maxValue;
+}
+
+
 void VarTuning::prepare_vars(Color c) {
 	tune_t sign = (c == WHITE ? 1 : -1);
 	
@@ -117,33 +176,119 @@ void VarTuning::update_vars(ResultPGN winner) {
 	++updateCount;
 	
 	for (int k = 0; k < size; ++k) {
-		*var[k].valueptr = var[k].value + (sign * var[k].delta * var[k].applyFactor);
-		var[k].value = *var[k].valueptr;
-		var[k].varSum += var[k].value;
-		var[k].mean = var[k].varSum / updateCount;
-		var[k].sdevSum += ((var[k].value - var[k].mean) * (var[k].value - var[k].mean));
-		var[k].sdev = sqrt(var[k].sdevSum / updateCount);
+		var[k].value = var[k].value + (sign * var[k].delta * var[k].applyFactor);
+		var[k].value = Max(var[k].minValue, Min(var[k].value, var[k].maxValue));
+		*var[k].valueptr = var[k].value;
 		
-		var[k].history[var[k].historyIndex] = var[k].value;
-		++var[k].historyIndex;
+		tune_t mean = update_stats(k);
 		
-		if (var[k].historyIndex >= TUNE_HISTORY_SIZE) {
-			var[k].historyIndex = 0;
-		}
+		if (k == 0) cout << "mean: " << mean << endl;
+	}
+}
+
+
+// applies the steps of a batch of game pairs at once: the sum of the deltas
+// of each pair weighted by its result, wins minus losses of the plus side
+void VarTuning::update_vars(const tune_t* steps) {
+	++updateCount;
+	
+	for (int k = 0; k < size; ++k) {
+		var[k].value = var[k].value + (steps[k] * var[k].applyFactor);
+		var[k].value = Max(var[k].minValue, Min(var[k].value, var[k].maxValue));
+		*var[k].valueptr = var[k].value;
+		
+		update_stats(k);
+	}
+}
+
+
+// updates mean, sdev and history of a variable, returns the history mean
+tune_t VarTuning::update_stats(int k) {
+	var[k].varSum += var[k].value;
+	var[k].mean = var[k].varSum / updateCount;
+	var[k].sdevSum += ((var[k].value - var[k].mean) * (var[k].value - var[k].mean));
+	var[k].sdev = sqrt(var[k].sdevSum / updateCount);
+	
+	var[k].history[var[k].historyIndex] = var[k].value;
+	++var[k].historyIndex;
+	
+	if (var[k].historyIndex >= TUNE_HISTORY_SIZE) {
+		var[k].historyIndex = 0;
+	}
+	
+	tune_t mean = 0;
+	for (int i = 0; i < TUNE_HISTORY_SIZE; ++i) {
+		mean += (var[k].history[i] / TUNE_HISTORY_SIZE);
+	}
+	
+	tune_t sdev = 0;
+	for (int i = 0; i < TUNE_HISTORY_SIZE; ++i) {
+		sdev += ((var[k].history[i] - mean) * (var[k].history[i] - mean) / TUNE_HISTORY_SIZE); 
+	}
+	var[k].historySdev = sqrt(sdev);
+	
+	return mean;
+}
+
+
+// writes the tuner state, one line per variable after the number of updates
+bool VarTuning::save(const char* fileName) {
+	ofstream file(fileName);
+	
+	file << setprecision(17) << size << " " << updateCount << endl;
+	
+	for (int k = 0; k < size; ++k) {
+		file << var[k].value << " " << var[k].startvalue << " " << var[k].varSum << " "
+		     << var[k].sdevSum << " " << var[k].historyIndex;
 		
-		tune_t mean = 0;
 		for (int i = 0; i < TUNE_HISTORY_SIZE; ++i) {
-			mean += (var[k].history[i] / TUNE_HISTORY_SIZE);
+			file << " " << var[k].history[i];
 		}
+		file << endl;
+	}
+	return bool(file);
+}
+
+
+// reads the tuner state written by save(), false if the file does not
+// exist or was saved with another number of variables
+bool VarTuning::load(const char* fileName) {
+	ifstream file(fileName);
+	int s, count;
+	
+	if (!(file >> s >> count) || s != size) {
+		return false;
+	}
+	
+	// read into a copy, a truncated file leaves the state unchanged
+	vector<TunedVariable> loaded(var, var + size);
+	
+	for (int k = 0; k < size; ++k) {
+		TunedVariable& v = loaded[k];
 		
-		if (k == 0) cout << "mean: " << mean << endl;
+		file >> v.value >> v.startvalue >> v.varSum >> v.sdevSum >> v.historyIndex;
 		
-		tune_t sdev = 0;
 		for (int i = 0; i < TUNE_HISTORY_SIZE; ++i) {
-			sdev += ((var[k].history[i] - mean) * (var[k].history[i] - mean) / TUNE_HISTORY_SIZE); 
+			file >> v.history[i];
 		}
-		var[k].historySdev = sqrt(sdev);
 	}
+	
+	if (!file) {
+		return false;
+	}
+	
+	updateCount = count;
+	
+	for (int k = 0; k < size; ++k) {
+		var[k] = loaded[k];
+		*var[k].valueptr = var[k].value;
+		
+		if (updateCount) {
+			var[k].mean = var[k].varSum / updateCount;
+			var[k].sdev = sqrt(var[k].sdevSum / updateCount);
+		}
+	}
+	return true;
 }
 
 void VarTuning::print_vars() {
@@ -161,16 +306,162 @@ void VarTuning::print_deltas() {
 }
 
 
+namespace {
 
+// half points of the plus side in each pair of the current batch
+vector<int> TunePoints;
 
+bool tune_pair(int pair, const int points[2]) {
+	TunePoints[pair] = points[0] + points[1];
+	return false;
+}
 
+}
 
 
-
-
-
-
-
-
-
-
+/// tune() runs a SPSA tuning of the search parameters in SearchParams[],
+/// starting from their UCI options, as example:
+///
+///   tune iterations 500 batch 32 concurrency 8 nodes 5000 checkpoint spsa.txt
+///
+/// Each iteration plays a batch of game pairs in parallel, each pair between
+/// the parameters moved by its own random delta and moved by the opposite
+/// delta, and then updates the parameters once with the results of all the
+/// pairs. The tuner state is saved after each iteration to the checkpoint
+/// file, and a run finding it continues from there. Arguments, all optional,
+/// are: "iterations" (100), "batch" pairs (16), "concurrency" (1), the game
+/// settings read by GameSettings::read() with the limit of each move
+/// defaulting to "nodes 5000", "hash" in MB (16), "openings" file with
+/// "openplies" (8) as for the match command and "checkpoint" (tune.txt).
+/// The tuned values are set as UCI options at the end.
+
+void tune(istream& is) {
+	string token, openingsFile, checkpoint = "tune.txt";
+	int iterations = 100, batch = 16, concurrency = 1, hash = 16, openPlies = 8;
+	GameSettings gs;
+	vector<Opening> openings;
+	
+	while (is >> token) {
+		if (gs.read(token, is)) {
+			continue;
+		}
+		
+		if (token == "iterations") {
+			is >> iterations;
+		} else if (token == "batch") {
+			is >> batch;
+		} else if (token == "concurrency") {
+			is >> concurrency;
+		} else if (token == "hash") {
+			is >> hash;
+		} else if (token == "openings") {
+			is >> openingsFile;
+		} else if (token == "openplies") {
+			is >> openPlies;
+		} else if (token == "checkpoint") {
+			is >> checkpoint;
+		} else {
+			cout << "Unknown tune argument: " << token << endl;
+			return;
+		}
+	}
+	
+	if (!gs.tcBase && !gs.limits.maxNodes && !gs.limits.maxDepth && !gs.limits.maxTime) {
+		gs.limits.maxNodes = 5000;
+	}
+	
+	batch = Max(1, batch);
+	
+	if (!openingsFile.empty()) {
+		if (!read_openings(openingsFile, openPlies, openings)) {
+			cout << "No openings read from " << openingsFile << endl;
+			return;
+		}
+	} else {
+		random_openings(Min(iterations * batch, 10000), openPlies, openings);
+	}
+	
+	tune_t theta[SEARCH_PARAM_NB];
+	
+	for (int k = 0; k < SEARCH_PARAM_NB; ++k) {
+		theta[k] = Options[SearchParams[k].name].value<int>();
+	}
+	
+	VarTuning vt(SEARCH_PARAM_NB, theta);
+	
+	// keep the parameters within the bounds of their UCI options
+	for (int k = 0; k < SEARCH_PARAM_NB; ++k) {
+		vt.set_bounds(k, SearchParams[k].minValue, SearchParams[k].maxValue);
+	}
+	
+	if (vt.load(checkpoint.c_str())) {
+		cout << "Resuming from " << checkpoint << " after " << vt.updateCount << " iterations" << endl;
+	}
+	
+	vector<EngineConfig> engines(2 * batch);
+	
+	for (size_t i = 0; i < engines.size(); ++i) {
+		engines[i].time.read_uci_options();
+		engines[i].eval.read_uci_options();
+	}
+	vector<tune_t> deltas(batch * SEARCH_PARAM_NB);
+	tune_t steps[SEARCH_PARAM_NB];
+	int64_t time = get_system_time();
+	
+	TunePoints.resize(batch);
+	
+	for (int it = vt.updateCount; it < iterations; ++it) {
+		
+		for (int i = 0; i < batch; ++i) {
+			tune_t* d = &deltas[i * SEARCH_PARAM_NB];
+			
+			vt.prepare_deltas(d);
+			engines[2 * i].hash = engines[2 * i + 1].hash = hash;
+			
+			for (int k = 0; k < SEARCH_PARAM_NB; ++k) {
+				engines[2 * i].params[k] = theta[k] + d[k];
+				engines[2 * i + 1].params[k] = theta[k] - d[k];
+			}
+		}
+		
+		play_pairs(gs, openings, it * batch, &engines[0], batch, concurrency, tune_pair);
+		
+		int points = 0;
+		
+		for (int k = 0; k < SEARCH_PARAM_NB; ++k) {
+			steps[k] = 0;
+		}
+		
+		for (int i = 0; i < batch; ++i) {
+			points += TunePoints[i];
+			
+			for (int k = 0; k < SEARCH_PARAM_NB; ++k) {
+				steps[k] += (TunePoints[i] - 2) * deltas[i * SEARCH_PARAM_NB + k];
+			}
+		}
+		
+		vt.update_vars(steps);
+		
+		if (!vt.save(checkpoint.c_str())) {
+			cout << "Failed to write " << checkpoint << endl;
+		}
+		
+		cout << "Iteration " << it + 1 << ", plus side " << points / 2.0 << "/" << 2 * batch
+		     << ", " << (get_system_time() - time) / 1000 << " s:" << fixed << setprecision(1);
+		
+		for (int k = 0; k < SEARCH_PARAM_NB; ++k) {
+			cout << " " << theta[k];
+		}
+		cout.unsetf(ios::floatfield);
+		cout << setprecision(6) << endl;
+	}
+	
+	// options are integer, the fractional part is lost
+	for (int k = 0; k < SEARCH_PARAM_NB; ++k) {
+		ostringstream ss;
+		ss << int(floor(theta[k] + 0.5));
+		
+		Options[SearchParams[k].name].set_value(ss.str());
+		cout << "setoption name " << SearchParams[k].name << " value " << ss.str() << endl;
+	}
+}
@@ -10,6 +10,8 @@
 #ifndef TUNING_H_
 #define TUNING_H_
 
+#include <iostream>
+
 #include "rkiss.h"
 #include "pgn.h"
 
@@ -26,6 +28,7 @@ struct TunedVariable {
 	tune_t* valueptr;			// value to be tuned
 	tune_t value;
 	tune_t startvalue;
+	tune_t minValue, maxValue;	// value is kept within these bounds
 	tune_t delta;			// radius around value
 	tune_t deltaSdev;		// used to couple delta to sdev
 	tune_t deltaAxisFactor;	// delta = deltaAxisFactor * value
@@ -49,17 +52,31 @@ public:
 	RKISS rkiss;
 	
 	VarTuning(int s, ...);
+	VarTuning(int s, tune_t* values);
 	void prepare_deltas();
+	void prepare_deltas(tune_t* deltas);
+	void set_bounds(int k, tune_t minValue, tune_t maxValue);
 	void prepare_vars(Color c);
 	void update_vars(ResultPGN winner);
+	void update_vars(const tune_t* steps);
+	
+	bool save(const char* fileName);
+	bool load(const char* fileName);
 	
 	void print_vars();
 	void print_deltas();
 	
 	double rand_double();
 	void rand_unit_vector(tune_t* vector, int size);
+
+private:
+	void init_var(int k, tune_t* valueptr);
+	tune_t update_stats(int k);
 };
 
 
+extern void tune(std::istream& is);
+
+
 
 #endif /* TUNING_H_ */
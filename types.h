@@ -66,7 +66,8 @@ typedef unsigned __int64 uint64_t;
 ////
 //// -DUSE_POPCNT   | Add runtime support for use of popcnt asm-instruction.
 ////                | Works only in 64-bit mode. For compiling requires hardware
-////                | with popcnt support. Around 4% speed-up.
+////                | with popcnt support. Around 4% speed-up. Always on for
+////                | x86-64 gcc builds.
 ////
 //// -DOLD_LOCKS    | By default under Windows are used the fast Slim Reader/Writer (SRW)
 ////                | Locks and Condition Variables: these are not supported by Windows XP
@@ -87,6 +88,19 @@ typedef unsigned __int64 uint64_t;
 #include <nmmintrin.h>
 #endif
 
+// On x86-64 with gcc the POPCNT and SIMD code paths are all compiled in,
+// using inline assembly or target attributes, so that one binary runs
+// everywhere. init_cpu() detects at startup which ones the CPU supports.
+// The PEXT instruction too, used by the slider lookups when it is fast,
+// see slider_index().
+#if defined(__GNUC__) && defined(__x86_64__)
+#  if !defined(USE_POPCNT)
+#    define USE_POPCNT
+#  endif
+#  define HAS_PEXT
+#  define USE_SIMD
+#endif
+
 // Cache line alignment specification
 #if defined(_MSC_VER) || defined(__INTEL_COMPILER)
 #define CACHE_LINE_ALIGNMENT __declspec(align(64))
@@ -94,6 +108,13 @@ typedef unsigned __int64 uint64_t;
 #define CACHE_LINE_ALIGNMENT  __attribute__ ((aligned(64)))
 #endif
 
+// Thread local storage specification
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 // Define a __cpuid() function for gcc compilers, for Intel and MSVC
 // is already available as an intrinsic.
 #if defined(_MSC_VER)
@@ -127,23 +148,16 @@ inline void __cpuid(int CPUInfo[4], int)
 #define FORCE_INLINE  inline
 #endif
 
-/// cpu_has_popcnt() detects support for popcnt instruction at runtime
-inline bool cpu_has_popcnt() {
-
-  int CPUInfo[4] = {-1};
-  __cpuid(CPUInfo, 0x00000001);
-  return (CPUInfo[2] >> 23) & 1;
-}
-
-/// CpuHasPOPCNT is a global constant initialized at startup that
-/// is set to true if CPU on which application runs supports popcnt
-/// hardware instruction. Unless USE_POPCNT is not defined.
-#if defined(USE_POPCNT)
-const bool CpuHasPOPCNT = cpu_has_popcnt();
-#else
-const bool CpuHasPOPCNT = false;
-#endif
+/// CpuFeatures holds the capabilities of the CPU which matter for the hot
+/// kernels: popcount, PEXT slider attacks and the NNUE SIMD code. They are
+/// detected once at startup by init_cpu(), only the features with a code
+/// path compiled in are reported as available.
+struct CpuFeatures {
+  bool popcnt, bmi2, fastPext, avx2, avx512;
+};
 
+extern CpuFeatures Cpu;
+extern void init_cpu();
 
 /// CpuIs64Bit is a global constant initialized at compile time that
 /// is set to true if CPU on which application runs is a 64 bits.
@@ -23,17 +23,29 @@
 #include <sstream>
 #include <string>
 
+#include "analyze.h"
+#include "bitbase.h"
+#include "create_book.h"
+#include "datagen.h"
+#include "engine.h"
 #include "evaluate.h"
+#include "match.h"
 #include "misc.h"
 #include "move.h"
 #include "movegen.h"
 #include "position.h"
 #include "search.h"
+#include "stats.h"
+#include "texel.h"
+#include "tuning.h"
 #include "ucioption.h"
 #include "nnue.h"
 
 using namespace std;
 
+extern void benchmark(istream& is);
+extern void slider_benchmark();
+
 namespace {
 
   // FEN string for the initial position
@@ -57,8 +69,6 @@ namespace {
 
 bool execute_uci_command(const string& cmd) {
 
-  static Position pos(StartPositionFEN, false, 0); // The root position
-
   UCIParser up(cmd);
   string token;
 
@@ -67,6 +77,23 @@ bool execute_uci_command(const string& cmd) {
   if (token == "quit")
       return false;
 
+  // The handshake is answered while the startup goes on, any other command
+  // waits for it, "isready" included. The root position is set up after it
+  // so that its network accumulators are computed with the loaded weights.
+  if (token == "uci")
+  {
+      cout << "id name "     << engine_name()
+           << "\nid author " << engine_authors()
+           << "\n"           << Options.print_all()
+           << "\noption name UCI_Variant type combo default atomic var atomic"
+           << "\nuciok"      << endl;
+      return true;
+  }
+
+  wait_for_engine_init();
+
+  static Position pos(StartPositionFEN, false, 0); // The root position
+
   if (token == "go")
       return go(pos, up);
 
@@ -85,6 +112,48 @@ bool execute_uci_command(const string& cmd) {
   else if (token == "perft")
       perft(pos, up);
 
+  else if (token == "bench")
+      benchmark(up);
+
+  else if (token == "makebook")
+      make_book(up);
+
+  else if (token == "match")
+      match(up);
+
+  else if (token == "tune")
+      tune(up);
+
+  else if (token == "texel")
+      texel_tune(up);
+
+  else if (token == "analyze")
+      analyze(up);
+
+  else if (token == "datagen")
+      datagen(up);
+
+  else if (token == "sliderbench")
+      slider_benchmark();
+
+  else if (token == "bitbase")
+  {
+      // Make available the given bitbases, e.g. "bitbase KPKP KQKR",
+      // reading them from or caching them in "Bitbase Path".
+      string path = Options["Bitbase Path"].value<string>();
+
+      while (up >> token)
+          load_or_generate_bitbase(token, path.empty() ? "." : path, Options["Threads"].value<int>());
+  }
+
+  else if (token == "stats")
+  {
+      if (up >> token && token == "clear")
+          clear_stats();
+      else
+          cout << stats_to_string();
+  }
+
   else if (token == "d")
       pos.print();
 
@@ -102,12 +171,6 @@ bool execute_uci_command(const string& cmd) {
            << "\nmaterial key: " << pos.get_material_key()
            << "\npawn key: "     << pos.get_pawn_key() << endl;
 
-  else if (token == "uci")
-      cout << "id name "     << engine_name()
-           << "\nid author " << engine_authors()
-           << "\n"           << Options.print_all()
-           << "\noption name UCI_Variant type combo default atomic var atomic"
-           << "\nuciok"      << endl;
   else
       cout << "Unknown command: " << cmd << endl;
 
@@ -243,36 +306,39 @@ namespace {
   }
 
 
-  // perft() is called when engine receives the "perft" command.
-  // The function calls perft() passing the required search depth
-  // then prints counted leaf nodes and elapsed time.
+  // perft() is called when engine receives the "perft" command, with syntax
+  // "perft <depth> [threads] [hash MB]". Threads and hash default to the
+  // corresponding UCI options. Leaf nodes are counted for each legal root move
+  // (divide output), followed by the total, elapsed time and nodes per second.
 
   void perft(Position& pos, UCIParser& up) {
 
-    int depth, time;
-    int64_t n;
+    MoveStack mlist[MAX_MOVES];
+    int64_t counts[MAX_MOVES];
+    int depth, threads, hashMB, time, moveCount;
+    int64_t n = 0;
 
-    if (!(up >> depth))
+    if (!(up >> depth) || depth < 1)
         return;
 
-    if (depth == 1) {
-        MoveStack mlist[MAX_MOVES];
-        MoveStack* last = generate<MV_LEGAL>(pos, mlist);
-        n = last - mlist;
-
-        for (MoveStack* cur = mlist; cur != last; cur++)
-            cout << move_to_uci(pos, cur->move, pos.is_chess960()) << ": 1" << endl;
+    if (!(up >> threads))
+        threads = Options["Threads"].value<int>();
 
-        cout << "\nNodes searched: " << n << endl;
-        return;
-    }
+    if (!(up >> hashMB))
+        hashMB = Options["Hash"].value<int>();
 
     time = get_system_time();
-    n = perft(pos, depth * ONE_PLY);
+    moveCount = perft_divide(pos, depth * ONE_PLY, threads, hashMB, mlist, counts);
     time = get_system_time() - time;
 
-    std::cout << "\nNodes " << n
-              << "\nTime (ms) " << time
-              << "\nNodes/second " << int(n / (time / 1000.0)) << std::endl;
+    for (int i = 0; i < moveCount; i++)
+    {
+        cout << move_to_uci(pos, mlist[i].move, pos.is_chess960()) << ": " << counts[i] << endl;
+        n += counts[i];
+    }
+
+    cout << "\nNodes " << n
+         << "\nTime (ms) " << time
+         << "\nNodes/second " << (time > 0 ? int64_t(n * 1000 / time) : n) << endl;
   }
 }
@@ -22,10 +22,10 @@
 #include <sstream>
 
 #include "misc.h"
+#include "search.h"
 #include "thread.h"
 #include "ucioption.h"
 
-#include "main.h"
 
 using std::string;
 using std::cout;
@@ -88,11 +88,7 @@ OptionsMap::OptionsMap() {
   o["Hash"] = UCIOption(256, 4, 8192);/////////////////////////////////////////////////
   o["Clear Hash"] = UCIOption(false, "button");
   o["Ponder"] = UCIOption(false);
-#ifdef FICS_VERSION
-  o["OwnBook"] = UCIOption(true);	// always use the book with fics version
-#else
   o["OwnBook"] = UCIOption(true);
-#endif
   o["MultiPV"] = UCIOption(1, 1, 500);
   o["Skill Level"] = UCIOption(20, 0, 20);
   o["Emergency Move Horizon"] = UCIOption(20, 0, 50); // standard was 40
@@ -102,6 +98,10 @@ OptionsMap::OptionsMap() {
   o["UCI_Chess960"] = UCIOption(false);
   o["UCI_AnalyseMode"] = UCIOption(false);
   o["EvalFile"] = UCIOption("atomic.nnue");
+  o["Bitbase Path"] = UCIOption("");
+
+  for (int i = 0; i < SEARCH_PARAM_NB; i++)
+      o[SearchParams[i].name] = UCIOption(SearchParams[i].defaultValue, SearchParams[i].minValue, SearchParams[i].maxValue);
 
   // Set some SMP parameters accordingly to the detected CPU count
   UCIOption& thr = o["Threads"];